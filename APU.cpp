@@ -8,7 +8,6 @@ APU::APU() {
 void APU::reset() {
 	registers.fill(0);  // Clear all registers
 	frame_counter = 0;
-	printf("APU reset.\n");
 }
 
 void APU::write_register(uint16_t address, uint8_t value) {
@@ -63,6 +62,28 @@ void APU::clock() {
 	}
 }
 
+void APU::run(int cycles) {
+	for (int i = 0; i < cycles; i++) {
+		clock();
+	}
+}
+
+void APU::saveState(StateWriter& state) const {
+	state.put(registers);
+	state.put(frame_counter);
+	state.put(frame_counter_mode);
+	state.put(pulse1);
+	state.put(pulse2);
+}
+
+void APU::loadState(StateReader& state) {
+	state.get(registers);
+	state.get(frame_counter);
+	state.get(frame_counter_mode);
+	state.get(pulse1);
+	state.get(pulse2);
+}
+
 void APU::step_envelope() {
 	// TODO: Implement step_envelope
 }
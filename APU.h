@@ -3,6 +3,7 @@
 
 #include <array>
 #include <cstdint>
+#include "SaveState.h"
 
 // Sound channels
 struct PulseChannel {
@@ -28,6 +29,9 @@ public:
     void write_register(uint16_t address, uint8_t value);  // Write to APU registers
     uint8_t read_register(uint16_t address);               // Read from APU registers
     void clock();                                          // Syncs APU to frames
+    void run(int cycles);                                  // Clock for a number of CPU cycles at once
+    void saveState(StateWriter& state) const;              // Registers and channels, for save states
+    void loadState(StateReader& state);
 
 private:
     std::array<uint8_t, 0x18> registers{};                 // APU memory-mapped registers
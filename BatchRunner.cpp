@@ -0,0 +1,136 @@
+#include "BatchRunner.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+#include "Movie.h"
+#include "NES.h"
+
+BatchRunner::BatchRunner(const Options& options) : options(options) {}
+
+int BatchRunner::hardwareThreads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+BatchRunner::Report BatchRunner::run(const std::vector<Job>& jobs) {
+    Report report;
+    report.jobs.resize(jobs.size());
+    int threads = options.threads > 0 ? options.threads : hardwareThreads();
+    report.threads = std::max(1, std::min<int>(threads, jobs.size()));
+
+    // Deal the jobs out round robin, neighbouring jobs are often alike in length
+    queues = std::vector<WorkQueue>(report.threads);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        queues[i % report.threads].jobs.push_back(i);
+    }
+
+    batchStart = Clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 1; t < report.threads; t++) {
+        pool.emplace_back(&BatchRunner::work, this, t, std::cref(jobs), std::ref(report));
+    }
+    work(0, jobs, report);
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    report.seconds = std::chrono::duration<double>(Clock::now() - batchStart).count();
+
+    for (const WorkQueue& queue : queues) {
+        report.steals += queue.steals;
+    }
+    queues.clear();
+    return report;
+}
+
+void BatchRunner::work(int thread, const std::vector<Job>& jobs, Report& report) {
+    // Each job's result has its own slot, so nothing here needs a lock
+    size_t index;
+    while (nextJob(thread, index)) {
+        JobResult& result = report.jobs[index];
+        result = runJob(jobs[index]);
+        result.thread = thread;
+        result.finishedAt = std::chrono::duration<double>(Clock::now() - batchStart).count();
+    }
+}
+
+bool BatchRunner::nextJob(int thread, size_t& index) {
+    {
+        WorkQueue& own = queues[thread];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            index = own.jobs.front();
+            own.jobs.pop_front();
+            return true;
+        }
+    }
+
+    int count = queues.size();
+    for (int i = 1; i < count; i++) {
+        WorkQueue& victim = queues[(thread + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            index = victim.jobs.back();
+            victim.jobs.pop_back();
+            queues[thread].steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+BatchRunner::JobResult BatchRunner::runJob(const Job& job) const {
+    JobResult result;
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.timeoutSeconds));
+
+    // The NES is large, keep it off the stack. Nothing looks at its frames.
+    auto nes = std::make_unique<NES>();
+    nes->catch_up = options.catchUp;
+    nes->bus.skipIdleLoops = options.skipIdleLoops;
+    nes->bus.recompile = options.recompile;
+    nes->headless = true;
+    nes->load_rom(job.rom.c_str());
+    if (!nes->rom_loaded) {
+        return result;
+    }
+    nes->initNES();
+
+    Movie movie;
+    size_t frames = std::max(job.frames, 0);
+    if (!job.movie.empty()) {
+        if (!movie.load(job.movie) || !movie.startReplay(*nes)) {
+            return result;
+        }
+        frames = movie.frames.size();
+    }
+
+    result.status = DONE;
+    result.frameMs.reserve(frames);
+    std::vector<uint8_t> state;
+    for (size_t i = 0; i < frames; i++) {
+        Clock::time_point frameStart = Clock::now();
+        if (options.timeoutSeconds > 0.0 && frameStart >= deadline) {
+            result.status = TIMED_OUT;
+            break;
+        }
+        bool matched = true;
+        if (job.movie.empty()) {
+            nes->runFrame();
+        } else {
+            matched = movie.replayFrame(*nes, i, state);
+        }
+        result.frameMs.push_back(std::chrono::duration<float, std::milli>(Clock::now() - frameStart).count());
+        if (!matched) {
+            result.status = DIVERGED;
+            break;
+        }
+        result.frames++;
+    }
+
+    nes->saveState(state);
+    result.hash = Movie::hashState(state);
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return result;
+}
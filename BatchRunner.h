@@ -0,0 +1,86 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Runs a batch of independent emulation jobs, each on its own NES, on a pool of threads. Jobs are
+// dealt out to one queue per thread up front, and a thread whose queue runs dry steals from the
+// back of the others, so a few long jobs don't leave the rest of the pool idle. Machines share
+// nothing, so throughput grows with the number of cores.
+class BatchRunner {
+public:
+    struct Job {
+        std::string rom;
+        std::string movie;      // Replay this movie, or when empty...
+        int frames = 0;         // ...run this many frames from power-on with no buttons held
+    };
+
+    enum STATUS {
+        DONE,
+        DIVERGED,               // A movie frame didn't end on its recorded state
+        TIMED_OUT,
+        FAILED,                 // The ROM or movie couldn't be loaded, or they don't go together
+    };
+
+    struct JobResult {
+        STATUS status = FAILED;
+        int frames = 0;                 // Frames run, the diverging one not counted
+        double seconds = 0.0;           // From picking the job up to finishing it, loading included
+        double finishedAt = 0.0;        // Seconds after the batch started
+        uint64_t hash = 0;              // Movie::hashState() of where the machine ended
+        int thread = -1;
+        std::vector<float> frameMs;     // Time each frame took
+    };
+
+    struct Options {
+        int threads = 0;                // 0 for one per hardware thread
+        double timeoutSeconds = 0.0;    // Per job, 0 for none. Checked between frames.
+        bool catchUp = true;
+        bool skipIdleLoops = false;
+        bool recompile = false;
+    };
+
+    struct Report {
+        std::vector<JobResult> jobs;    // In the order they were given
+        int threads = 0;
+        double seconds = 0.0;
+        uint64_t steals = 0;            // Jobs run by a thread other than the one dealt them
+    };
+
+    explicit BatchRunner(const Options& options);
+
+    Report run(const std::vector<Job>& jobs);
+    // Run a single job on the calling thread
+    JobResult runJob(const Job& job) const;
+
+    // Threads used when Options::threads is 0
+    static int hardwareThreads();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // One per thread, kept on separate cache lines so threads popping their own queue don't
+    // slow each other down
+    struct alignas(64) WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+        uint64_t steals = 0;            // Only touched by the queue's own thread
+    };
+
+    void work(int thread, const std::vector<Job>& jobs, Report& report);
+    // Take the next job, first off the front of the thread's own queue, then off the back of
+    // the others'. False once every queue is empty, no jobs are added after the start.
+    bool nextJob(int thread, size_t& index);
+
+    Options options;
+    std::vector<WorkQueue> queues;
+    Clock::time_point batchStart;
+};
+
+#endif // BATCHRUNNER_H
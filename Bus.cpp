@@ -1,114 +1,187 @@
 #include "Bus.h"
 
+#include <algorithm>
+#include <cstring>
 #include <thread>
 
 #include "CPU.cpp" // <-- need to implement CPU.h
+#include "Recompiler.h"
 
 
 Bus::Bus() {
-    cpu = new CPU();
-    apu = new APU();
+    cpu = std::make_unique<CPU>();
+    apu = std::make_unique<APU>();
     cpu->connectBus(this);  // Connect CPU to Bus
-    APU apu;                // not needed?
+    mapMemory();
 }
 
 Bus::~Bus() = default;
 
-void Bus::write(uint16_t address, uint8_t data) {
-    //printf("address 0x%04X   data: 0x%02x\n", address, data);
-    if (address >= 0x0000 && address <= 0x1FFF) {
-        cpuRam[address & 0x07FF] = data;
-    } else if (address >= 0x2000 && address <= 0x3FFF) {
-        ppu.cpuWrite(address & 0x0007, data);
-    } else if ((address >= 0x4000 && address <= 0x4013) || address == 0x4015 || address == 0x4017) {
+void Bus::mapMemory() {
+    // 2KB of RAM mirrored through 0x0000 - 0x1FFF
+    for (int page = 0x0000 >> 10; page < 0x2000 >> 10; page++) {
+        readPages[page] = writePages[page] = &cpuRam[(page % 2) * PAGE_SIZE];
+    }
+    // PPU registers mirrored through 0x2000 - 0x3FFF
+    for (int page = 0x2000 >> 10; page < 0x4000 >> 10; page++) {
+        readHandlers[page] = &Bus::readPPURegister;
+        writeHandlers[page] = &Bus::writePPURegister;
+    }
+    // APU and I/O registers share their page with the start of cartridge space
+    readHandlers[0x4000 >> 10] = &Bus::readIORegister;
+    writeHandlers[0x4000 >> 10] = &Bus::writeIORegister;
+    // Cartridge space, mapped to PRG RAM and the mapper's banks once a ROM is connected
+    for (int page = 0x4400 >> 10; page < PAGE_COUNT; page++) {
+        readHandlers[page] = &Bus::readCartridge;
+        writeHandlers[page] = &Bus::writeCartridge;
+    }
+}
+
+void Bus::mapReadPages(uint16_t start, uint16_t end, uint8_t* memory) {
+    for (int page = start >> 10; page <= end >> 10; page++) {
+        readPages[page] = memory == nullptr ? nullptr : memory + (page - (start >> 10)) * PAGE_SIZE;
+    }
+}
+
+void Bus::mapWritePages(uint16_t start, uint16_t end, uint8_t* memory) {
+    for (int page = start >> 10; page <= end >> 10; page++) {
+        writePages[page] = memory == nullptr ? nullptr : memory + (page - (start >> 10)) * PAGE_SIZE;
+    }
+}
+
+uint8_t Bus::readPPURegister(uint16_t address) {
+    syncPPU(ppuSyncTarget);
+    return ppu.cpuRead(address & 0x0007);
+}
+
+void Bus::writePPURegister(uint16_t address, uint8_t data) {
+    syncPPU(ppuSyncTarget);
+    ppu.cpuWrite(address & 0x0007, data);
+    // Writes to PPUCTRL can turn the NMI on or off, PPUCTRL and PPUMASK move A12 rises around
+    scheduleNMI();
+    scheduleIRQ();
+}
+
+uint8_t Bus::readIORegister(uint16_t address) {
+    if ((address >= 0x4000 && address <= 0x4013) || address == 0x4015 || address == 0x4017) {
+        syncAPU();
+        return apu->read_register(address);
+    } else if (address == 0x4014) {
+        // TODO: read from address for DMA transfer
+    } else if (address == 0x4016) {
+        if (controller_read == 8) {
+            copyController = controller1;
+            controller_read = 0;
+        }
+        uint8_t data = copyController.reg & 1;
+        copyController.reg = copyController.reg >> 1;
+        controller_read++;
+        return data;
+    } else if (address >= 0x4020) {
+        return readCartridge(address);
+    }
+    return -1;
+}
+
+void Bus::writeIORegister(uint16_t address, uint8_t data) {
+    if ((address >= 0x4000 && address <= 0x4013) || address == 0x4015 || address == 0x4017) {
+        syncAPU();
         apu->write_register(address, data);
     } else if (address == 0x4014) {
         DMATransfer = true;
-        // DMA Page + DMA Address make a 16-bit address for the CPU bus
         DMAPage = data;
-        DMAAddress = 0x00;
-    } else if (address >= 0x4016 && address <= 0x4017) {
+
+        // The CPU halts from its next cycle. The transfer waits for that or the one after to be odd,
+        // then takes 512 more, a read and a write for each byte.
+        uint64_t start = clockCounter + 3;
+        dmaCyclesLeft = (start % 2 == 1) ? 513 : 514;
+        cpuNextInstruction += 3 * dmaCyclesLeft;
+        scheduler.schedule(Scheduler::DMA, start + 3 * (dmaCyclesLeft - 1));
+    } else if (address == 0x4016) {
         // TODO: write to address and save controller state
-    } else if (address >= 0x4020 && address <= 0xFFFF) {
-        // TODO: write to cartridge memory
-        // Temporary way of getting rom information, current mappers write to old cpu memory
-        cpu->writerom(address, data);
+    } else if (address >= 0x4020) {
+        writeCartridge(address, data);
     }
 }
 
-uint8_t Bus::read(uint16_t address) {
-    if (address >= 0x0000 && address <= 0x1FFF) {
-        return cpuRam[address & 0x07FF];
-    } else if (address >= 0x2000 && address <= 0x3FFF) {
-        return ppu.cpuRead(address & 0x0007);
-    } else if ((address >= 0x4000 && address <= 0x4013) || address == 0x4015 || address == 0x4017) {
-        return apu->read_register(address);
-    } else if (address == 0x4014) {
-        // TODO: read from address for DMA transfer
-    } else if (address >= 0x4016 && address <= 0x4017) {
-        if (address == 0x4016) {
-            if (controller_read == 8) {
-                copyController = controller1;
-                controller_read = 0;
-            }
-            uint8_t data = copyController.reg & 1;
-            copyController.reg = copyController.reg >> 1;
-            controller_read++;
-            return data;
+uint8_t Bus::readCartridge(uint16_t address) {
+    // PRG RAM and ROM are read through their pages, nothing answers below them
+    if (mapper || noCartridge.empty()) {
+        return 0x00;
+    }
+    return noCartridge[address - 0x4000];
+}
+
+void Bus::writeCartridge(uint16_t address, uint8_t data) {
+    if (mapper) {
+        if (address >= 0x8000) {
+            // Bank switches and IRQ changes have to land on the right dot
+            syncPPU(ppuSyncTarget);
+            mapper->write(address, data);
+            updateBanks();
+            scheduleIRQ();
         }
-        return 0;
-    } else if (address >= 0x4020 && address <= 0xFFFF) {
-        // TODO: read from cartridge memory
-        // Temporary way of getting rom information, current mappers write to old cpu memory
-        return cpu->readrom(address);
+        return;
     }
-    return -1;
+
+    if (noCartridge.empty()) {
+        mapNoCartridge();
+    }
+    noCartridge[address - 0x4000] = data;
+}
+
+void Bus::mapNoCartridge() {
+    noCartridge.resize(0xC000);
+    mapReadPages(0x4400, 0xFFFF, &noCartridge[0x0400]);
+    mapWritePages(0x4400, 0xFFFF, &noCartridge[0x0400]);
+}
+
+void Bus::updateBanks() {
+    for (int window = 0; window < 4; window++) {
+        uint16_t start = 0x8000 + window * 0x2000;
+        mapReadPages(start, start + 0x1FFF, mapper->prgBanks[window]);
+    }
+    ppu.updateBanks();
 }
 
 void Bus::reset() {
     cpu->reset();
     apu->reset();
     ppu.reset();
+    if (mapper) {
+        mapper->reset();
+        updateBanks();
+    }
+    scheduler.reset();
     // TODO: add resets for other components
 }
 
 void Bus::clock() {
+    // The CPU only sees an IRQ raised on an earlier dot
+    bool irq = mapper && mapper->irq;
+
     // Cycle ppu every clock cycle
     ppu.clock();
+    ppuClockCounter++;
 
     // CPU is three times slower than ppu
     if (clockCounter % 3 == 0) {
 
         // Check if a DMA transfer is happening, it suspends the CPU
         if (DMATransfer) {
-            if (!DMACanStart) {
-                if (clockCounter % 2 == 1) {
-                    DMACanStart = true;
-                }
-            }
-            else {
-                // Read from the CPU bus on even clock cycles
-                if (clockCounter % 2 == 0) {
-                    DMAData = read(DMAPage << 8 | DMAAddress);
-                }
-                // Write to PPU OAM memory on odd clock cycles
-                else {
-                    ppu.OAMDATA[DMAAddress] = DMAData;
-                    DMAAddress++;
-
-                    // After transfering 256 bytes end the transfer
-                    if (DMAAddress == 0x00) {
-                        DMATransfer = false;
-                        DMACanStart = false;
-                    }
-                }
-            }
+            dmaStep();
         }
         // If no DMA transfer, cycle CPU
         else {
+            // An IRQ is taken instead of starting the next instruction
+            if (irq && cpu->cycles == 0 && !cpu->getFlag(CPU::I)) {
+                cpu->irq_interrupt();
+            }
             cpu->cycleExecute();
             cpuClockCounter++;
         }
+        apu->clock();
+        apuClockCounter++;
 
     }
 
@@ -121,7 +194,454 @@ void Bus::clock() {
     clockCounter++;
 }
 
-void Bus::connectROM(NESROM& ROM) {
+void Bus::dmaStep() {
+    dmaCyclesLeft--;
+    if (dmaCyclesLeft == 0) {
+        transferOAM();
+    }
+}
+
+void Bus::transferOAM() {
+    // Nothing else touches the page while the CPU is halted, so the whole of it lands in OAM on the
+    // last cycle. RAM and ROM pages are copied straight, anything else goes through read().
+    syncPPU(ppuSyncTarget);
+    uint16_t source = DMAPage << 8;
+    const uint8_t* page = readPages[source >> 10];
+    if (page != nullptr) {
+        std::memcpy(ppu.OAMDATA, page + (source & 0x03FF), 256);
+    } else {
+        for (int i = 0; i < 256; i++) {
+            ppu.OAMDATA[i] = read(source + i);
+        }
+    }
+    DMATransfer = false;
+    scheduler.cancel(Scheduler::DMA);
+}
+
+// First master clock at or after the given one that the CPU runs on
+static uint64_t nextCpuClock(uint64_t clock) {
+    return clock + (3 - clock % 3) % 3;
+}
+
+void Bus::run(uint64_t until) {
+    startRun();
+    while (runNext(until)) {
+    }
+    finishRun(until);
+}
+
+int Bus::step() {
+    startRun();
+    uint64_t start = nextCpuClock(clockCounter);
+
+    // Take whatever is in front of the next instruction, then the instruction itself
+    uint64_t instructions = cpu->instructions;
+    while (cpu->instructions == instructions && runNext(Scheduler::NEVER)) {
+    }
+
+    // Catch everything else up to where it ends
+    uint64_t end = cpuNextInstruction;
+    while (runNext(end)) {
+    }
+    finishRun(end);
+    return (clockCounter - start) / 3;
+}
+
+void Bus::startRun() {
+    // Track the CPU by when its next instruction starts instead of counting down its cycles
+    cpuNextInstruction = nextCpuClock(clockCounter) + 3 * cpu->cycles;
+    // Cycles are counted when an instruction starts, the ones left of this one already were
+    cpuClockCounter += cpu->cycles;
+    cpu->cycles = 0;
+    // A DMA left going holds the CPU off for its remaining cycles first
+    if (DMATransfer) {
+        cpuNextInstruction += 3 * dmaCyclesLeft;
+        scheduler.schedule(Scheduler::DMA, nextCpuClock(clockCounter) + 3 * (dmaCyclesLeft - 1));
+    } else {
+        scheduler.cancel(Scheduler::DMA);
+    }
+    scheduleNMI();
+    scheduleIRQ();
+}
+
+bool Bus::runNext(uint64_t until) {
+    // Every path below stops once nothing is left before until. An instruction starting on the
+    // last clock can still be followed by an event on that same clock.
+
+    // OAM DMA suspends the CPU, its cycles are already counted in cpuNextInstruction. The page is
+    // copied in one go on the last of them.
+    if (scheduler.pending(Scheduler::DMA)) {
+        uint64_t dmaClock = scheduler.timestampOf(Scheduler::DMA);
+        uint64_t event = scheduler.timestampOf(Scheduler::NMI);
+        if (event < dmaClock) {
+            if (event >= until) {
+                return false;
+            }
+            syncPPU(event + 1);
+            clockCounter = event + 1;
+            handleEvents();
+            return true;
+        }
+        if (dmaClock >= until) {
+            return false;
+        }
+
+        clockCounter = dmaClock;
+        ppuSyncTarget = clockCounter + 1;
+        transferOAM();
+        clockCounter++;
+
+        if (ppu.nmi) {
+            handleEvents();
+        }
+        return true;
+    }
+
+    // Handle events that happen before the next instruction
+    uint64_t event = scheduler.nextTimestamp();
+    if (event < cpuNextInstruction) {
+        if (event >= until) {
+            return false;
+        }
+        syncPPU(event + 1);
+        clockCounter = event + 1;
+        handleEvents();
+        return true;
+    }
+    if (cpuNextInstruction >= until) {
+        return false;
+    }
+
+    // An IRQ is taken instead of starting the next instruction
+    clockCounter = cpuNextInstruction;
+    if (mapper && mapper->irq && !cpu->getFlag(CPU::I)) {
+        cpu->irq_interrupt();
+        cpuNextInstruction += 3 * cpu->cycles;
+        cpuClockCounter += cpu->cycles;
+        cpu->cycles = 0;
+        return true;
+    }
+
+    if (skipIdleLoops && skipIdleLoop(until)) {
+        return true;
+    }
+    if (recompile && runBlock(until)) {
+        return true;
+    }
+
+    // Run the whole instruction on its first cycle, the ppu is only caught up if it gets touched
+    ppuSyncTarget = clockCounter + 1;
+    int cycles = cpu->runInstruction();
+    cpuNextInstruction += 3 * cycles;
+    cpuClockCounter += cycles;
+    clockCounter++;
+
+    // Catching the ppu up during the instruction can also raise the NMI
+    if (ppu.nmi) {
+        handleEvents();
+    }
+    return true;
+}
+
+bool Bus::runBlock(uint64_t until) {
+    const Recompiler::Block* block = recompiler ? recompiler->lookup(cpu->PC) : nullptr;
+    if (block == nullptr) {
+        return false;
+    }
+    // Events and IRQs are only looked at between blocks, so nothing can be due while one runs.
+    // Blocks never touch the ppu or apu, which catch up as usual afterwards.
+    uint64_t end = cpuNextInstruction + 3 * static_cast<uint64_t>(block->maxCycles);
+    if (end > until || end > scheduler.nextTimestamp() || mapper->irq) {
+        return false;
+    }
+
+    Recompiler::Result result = recompiler->run(*block);
+    if (result.instructions == 0) {
+        return false;
+    }
+    blocksRun++;
+    // The same as having run each instruction on its own, clockCounter ends one past the start
+    // of the last of them
+    clockCounter = cpuNextInstruction + 3 * static_cast<uint64_t>(result.lastStart);
+    ppuSyncTarget = clockCounter + 1;
+    cpuNextInstruction += 3 * static_cast<uint64_t>(result.cycles);
+    cpuClockCounter += result.cycles;
+    cpu->instructions += result.instructions;
+    clockCounter++;
+    return true;
+}
+
+void Bus::protectCode(uint8_t* page) {
+    for (int i = 0; i < PAGE_COUNT; i++) {
+        if (writePages[i] == page) {
+            writePages[i] = nullptr;
+            writeHandlers[i] = &Bus::writeCode;
+        }
+    }
+}
+
+void Bus::unprotectCode(uint8_t* page) {
+    for (int i = 0; i < PAGE_COUNT; i++) {
+        if (writePages[i] == nullptr && readPages[i] == page) {
+            writePages[i] = page;
+        }
+    }
+}
+
+void Bus::writeCode(uint16_t address, uint8_t data) {
+    recompiler->invalidatePage(readPages[address >> 10]);
+    write(address, data);
+}
+
+bool Bus::skipIdleLoop(uint64_t until) {
+    uint64_t limit = std::min(until, scheduler.nextTimestamp());
+    // Nothing is coming to end the loop and there is nowhere to stop
+    if (limit == Scheduler::NEVER) {
+        return false;
+    }
+    int instructions = 0;
+    int cycles = idleLoopCycles(limit, instructions);
+    if (cycles == 0) {
+        return false;
+    }
+
+    // The real iteration left at the end loads the registers the skipped ones would have
+    uint64_t clocks = 3 * cycles;
+    if (limit < clockCounter + 2 * clocks) {
+        return false;
+    }
+    uint64_t iterations = (limit - clockCounter) / clocks - 1;
+    cpuNextInstruction += iterations * clocks;
+    cpuClockCounter += iterations * cycles;
+    cpu->instructions += iterations * instructions;
+    idleIterationsSkipped += iterations;
+    return true;
+}
+
+int Bus::idleLoopCycles(uint64_t& limit, int& instructions) {
+    uint16_t pc = cpu->PC;
+    // Reading code out of the registers would have side effects
+    if (pc >= 0x2000 - 5 && pc < 0x4020) {
+        return 0;
+    }
+
+    uint8_t opcode = read(pc);
+
+    // JMP *
+    if (opcode == 0x4C) {
+        uint16_t target = read(pc + 1) | read(pc + 2) << 8;
+        instructions = 1;
+        return target == pc ? CPU_INSTRUCTIONS[opcode].cycles : 0;
+    }
+
+    // LDA, LDX, LDY or BIT of a zero page or absolute address, then a branch back to it
+    bool load = opcode == 0xA5 || opcode == 0xAD || opcode == 0xA6 || opcode == 0xAE ||
+                opcode == 0xA4 || opcode == 0xAC || opcode == 0x24 || opcode == 0x2C;
+    if (!load) {
+        return 0;
+    }
+    const CPU::Instruction& loadInstr = CPU_INSTRUCTIONS[opcode];
+    uint16_t address = read(pc + 1);
+    if (loadInstr.length == 3) {
+        address |= read(pc + 2) << 8;
+    }
+    uint16_t branch = pc + loadInstr.length;
+    uint8_t branchOpcode = read(branch);
+    if ((branchOpcode & 0x1F) != 0x10 || static_cast<uint16_t>(branch + 2 + static_cast<int8_t>(read(branch + 1))) != pc) {
+        return 0;
+    }
+
+    uint8_t value;
+    if (address < 0x2000) {
+        // RAM only changes when an event runs code or DMA
+        value = cpuRam[address & 0x07FF];
+    } else if (address < 0x4000 && (address & 0x0007) == 0x0002 && branchOpcode == 0x10) {
+        // Waiting for vblank with BPL. Reading the status clears vblank, so this only waits while
+        // it is already clear, and only until the ppu sets it.
+        syncPPU(clockCounter + 1);
+        if (ppu.status.vblank) {
+            return 0;
+        }
+        limit = std::min(limit, ppuClockCounter + ppu.dotsUntilVblank());
+        value = 0x00;
+    } else {
+        return 0;
+    }
+
+    // Flags after the load, the branch has to be taken to loop
+    uint8_t reg = value;
+    if (opcode == 0x24 || opcode == 0x2C) {
+        reg = cpu->A & value;
+    }
+    uint8_t p = (cpu->P & ~(CPU::Z | CPU::N)) | ZN_FLAGS[reg];
+    if (opcode == 0x24 || opcode == 0x2C) {
+        p = (p & ~(CPU::N | CPU::V)) | (value & (CPU::N | CPU::V));
+    }
+    // Branch opcodes pick N, V, C or Z with their top two bits and taken when set with bit 5
+    static const uint8_t BRANCH_FLAGS[4] = {CPU::N, CPU::V, CPU::C, CPU::Z};
+    bool set = p & BRANCH_FLAGS[branchOpcode >> 6];
+    if (set != static_cast<bool>(branchOpcode & 0x20)) {
+        return 0;
+    }
+
+    // A taken branch is one cycle longer, two if it lands in another page
+    int branchCycles = CPU_INSTRUCTIONS[branchOpcode].cycles + 1;
+    if (((branch + 2) & 0xFF00) != (pc & 0xFF00)) {
+        branchCycles++;
+    }
+    instructions = 2;
+    return loadInstr.cycles + branchCycles;
+}
+
+void Bus::finishRun(uint64_t until) {
+    // Nothing left to do until the end, let the CPU idle and catch the ppu up
+    if (clockCounter < until) {
+        clockCounter = until;
+    }
+    syncPPU(clockCounter);
+    syncAPU();
+    cpu->cycles = (cpuNextInstruction - nextCpuClock(clockCounter)) / 3;
+    // Hand an unfinished DMA back as a count, clock() doesn't count the CPU down while it goes
+    if (DMATransfer) {
+        dmaCyclesLeft = (scheduler.timestampOf(Scheduler::DMA) - nextCpuClock(clockCounter)) / 3 + 1;
+        cpu->cycles -= dmaCyclesLeft;
+    }
+    // Like clock(), only count the cycles that have gone by
+    cpuClockCounter -= cpu->cycles;
+}
+
+void Bus::syncPPU(uint64_t until) {
+    if (ppuClockCounter < until) {
+        ppu.run(until - ppuClockCounter);
+        ppuClockCounter = until;
+    }
+}
+
+void Bus::syncAPU() {
+    uint64_t until = (clockCounter + 2) / 3;
+    if (apuClockCounter < until) {
+        apu->run(until - apuClockCounter);
+        apuClockCounter = until;
+    }
+}
+
+void Bus::scheduleNMI() {
+    if (ppu.control.vblank_nmi_enable) {
+        scheduler.schedule(Scheduler::NMI, ppuClockCounter + ppu.dotsUntilVblank());
+    } else {
+        scheduler.cancel(Scheduler::NMI);
+    }
+}
+
+void Bus::scheduleIRQ() {
+    int rises = mapper ? mapper->risesUntilIRQ() : -1;
+    int dots = rises > 0 ? ppu.dotsUntilA12Rises(rises) : -1;
+    if (dots >= 0) {
+        scheduler.schedule(Scheduler::IRQ, ppuClockCounter + dots);
+    } else {
+        scheduler.cancel(Scheduler::IRQ);
+    }
+}
+
+void Bus::handleEvents() {
+    if (ppu.nmi) {
+        ppu.nmi = false;
+        cpu->nmi_interrupt();
+        cpuNextInstruction += 3 * cpu->cycles;
+        cpuClockCounter += cpu->cycles;
+        cpu->cycles = 0;
+    }
+    // A raised IRQ waits for the next instruction
+    scheduleNMI();
+    scheduleIRQ();
+}
+
+void Bus::saveState(StateWriter& state) const {
+    cpu->saveState(state);
+    state.put(cpuRam);
+    state.put(prgRam);
+    state.put(controller1.reg);
+    state.put(copyController.reg);
+    state.put(controller_read);
+    state.put(clockCounter);
+    state.put(cpuClockCounter);
+    state.put(ppuClockCounter);
+    state.put(apuClockCounter);
+    state.put(DMATransfer);
+    state.put(DMAPage);
+    state.put(dmaCyclesLeft);
+    ppu.saveState(state);
+    apu->saveState(state);
+
+    if (mapper) {
+        mapper->saveState(state);
+    } else {
+        // Memory standing in for the cartridge, if anything was written to it
+        state.put(!noCartridge.empty());
+        state.bytes(noCartridge.data(), noCartridge.size());
+    }
+}
+
+void Bus::loadState(StateReader& state) {
+    // RAM is replaced without going through the bus
+    if (recompiler) {
+        recompiler->invalidateRAM();
+    }
+    cpu->loadState(state);
+    state.get(cpuRam);
+    state.get(prgRam);
+    state.get(controller1.reg);
+    state.get(copyController.reg);
+    state.get(controller_read);
+    state.get(clockCounter);
+    state.get(cpuClockCounter);
+    state.get(ppuClockCounter);
+    state.get(apuClockCounter);
+    state.get(DMATransfer);
+    state.get(DMAPage);
+    state.get(dmaCyclesLeft);
+    ppu.loadState(state);
+    apu->loadState(state);
+
+    if (mapper) {
+        mapper->loadState(state);
+        updateBanks();
+    } else {
+        bool written = false;
+        state.get(written);
+        if (written && noCartridge.empty()) {
+            mapNoCartridge();
+        }
+        if (written) {
+            state.bytes(noCartridge.data(), noCartridge.size());
+        } else {
+            std::fill(noCartridge.begin(), noCartridge.end(), 0x00);
+        }
+    }
+}
+
+bool Bus::connectROM(NESROM& ROM) {
+    Mapper* cartridge = Mapper::create(ROM);
+    if (cartridge == nullptr) {
+        return false;
+    }
     ppu.connectROM(ROM);
+    // Give the old ROM's protected RAM pages back before they're mapped again
+    if (recompiler) {
+        recompiler->invalidateRAM();
+    }
     rom = &ROM;
+    mapper.reset(cartridge);
+    ppu.connectMapper(cartridge);
+
+    // PRG RAM and ROM are read straight from memory, ROM writes go to the mapper
+    noCartridge = std::vector<uint8_t>();
+    mapReadPages(0x4400, 0x5FFF, nullptr);
+    mapWritePages(0x4400, 0x5FFF, nullptr);
+    mapReadPages(0x6000, 0x7FFF, prgRam.data());
+    mapWritePages(0x6000, 0x7FFF, prgRam.data());
+    mapWritePages(0x8000, 0xFFFF, nullptr);
+    updateBanks();
+    recompiler = std::make_unique<Recompiler>(*this);
+    return true;
 }
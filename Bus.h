@@ -4,24 +4,32 @@
 #include <array>
 #include <cstdint>
 #include <chrono>
+#include <memory>
+#include <vector>
 #include "PPU.h"
 #include "ROM.h"
 #include "APU.h"
+#include "SaveState.h"
+#include "Scheduler.h"
 
 class CPU;
 class APU;
+class Recompiler;
 
 class Bus {
 public:
     Bus();  // Constructor
     ~Bus(); // Destructor
 
-    // Devices
-    CPU* cpu;
-    APU* apu;
+    // Devices, each bus has its own so any number of machines can run side by side
+    std::unique_ptr<CPU> cpu;
+    std::unique_ptr<APU> apu;
     PPU  ppu;
     std::array<uint8_t, 2 * 1024> cpuRam{};
-    NESROM* rom;
+    // Cartridge RAM at 0x6000 - 0x7FFF, there whether or not the header asks for it
+    std::array<uint8_t, 8 * 1024> prgRam{};
+    NESROM* rom = nullptr;
+    std::unique_ptr<Mapper> mapper;
 
     union controller {
 
@@ -35,8 +43,8 @@ public:
             uint8_t left: 1;
             uint8_t right: 1;
         }; uint8_t reg;
-    } controller1;
-    controller copyController;
+    } controller1{};
+    controller copyController{};
 
     int controller_read = 0;
     										
@@ -44,26 +52,157 @@ public:
     void write(uint16_t address, uint8_t data);
     uint8_t read(uint16_t address);
 
+    // The CPU address space is split into 1KB pages. A page backed by plain memory is read and
+    // written straight through its pointer, any other page goes through its handler.
+    static constexpr int PAGE_SIZE = 1024;
+    static constexpr int PAGE_COUNT = 64;
+    // Back the pages covering start..end with memory, nullptr hands them back to their handlers
+    void mapReadPages(uint16_t start, uint16_t end, uint8_t* memory);
+    void mapWritePages(uint16_t start, uint16_t end, uint8_t* memory);
+
+    // Where the byte at address is in the loaded PRG ROM image, nullptr if address isn't in PRG ROM
+    const uint8_t* prgROMByte(uint16_t address) const;
+
     // Reset function
     void reset();
     // Clock function
     void clock();
-    // Connect Game Rom to Bus
-    void connectROM(NESROM& ROM);
+    // Run until the master clock reaches the given value, a whole CPU instruction at a time
+    void run(uint64_t until);
+    // Run the next CPU instruction, or the interrupt or DMA in front of it, then catch the ppu and
+    // apu up to its end in one go. Returns the CPU cycles it took, the cycles of an NMI taken along
+    // the way are counted by the next step.
+    int step();
+    // Connect Game Rom to Bus, false if its mapper isn't supported
+    bool connectROM(NESROM& ROM);
+
+    // Everything the CPU, ppu, apu, memory and cartridge need to carry on from here, for save
+    // states. Only whole between calls to clock(), run() and step(), events are worked out again
+    // by the next run().
+    void saveState(StateWriter& state) const;
+    void loadState(StateReader& state);
+
+    // Let run() and step() skip whole iterations of loops that just wait, like JMP * or
+    // LDA $2002 / BPL, up to the next thing that could end them. Lockstep clock() runs every one.
+    bool skipIdleLoops = false;
+    uint64_t idleIterationsSkipped = 0;
 
-    uint32_t clockCounter = 0;
-    uint32_t cpuClockCounter = 0;
+    // Let run() and step() run code that keeps getting run as native code from the recompiler,
+    // when there is one for this machine. Lockstep clock() always interprets.
+    bool recompile = false;
+    uint64_t blocksRun = 0;
+    // Made for each ROM connected, translated code belongs to its PRG ROM
+    std::unique_ptr<Recompiler> recompiler;
+
+    uint64_t clockCounter = 0;
+    uint64_t cpuClockCounter = 0;
+    // Master clock the ppu has been run up to, can trail clockCounter while run() is going
+    uint64_t ppuClockCounter = 0;
+    // CPU cycles the apu has been clocked for, can also trail while run() is going
+    uint64_t apuClockCounter = 0;
+
+    Scheduler scheduler;
 
 private:
+    friend class Recompiler;
+
+    typedef uint8_t (Bus::*ReadHandler)(uint16_t address);
+    typedef void (Bus::*WriteHandler)(uint16_t address, uint8_t data);
+
+    std::array<uint8_t*, PAGE_COUNT> readPages{};
+    std::array<uint8_t*, PAGE_COUNT> writePages{};
+    std::array<ReadHandler, PAGE_COUNT> readHandlers{};
+    std::array<WriteHandler, PAGE_COUNT> writeHandlers{};
+
+    // Set up the power on memory map
+    void mapMemory();
+    // Handlers for the pages that aren't plain memory
+    uint8_t readPPURegister(uint16_t address);
+    void writePPURegister(uint16_t address, uint8_t data);
+    uint8_t readIORegister(uint16_t address);
+    void writeIORegister(uint16_t address, uint8_t data);
+    uint8_t readCartridge(uint16_t address);
+    void writeCartridge(uint16_t address, uint8_t data);
+    // Point the PRG pages and the ppu at the mapper's current banks
+    void updateBanks();
+    // Allocate noCartridge and map it in
+    void mapNoCartridge();
+
+    // Writable memory standing in for cartridge space at 0x4020 - 0xFFFF while no ROM is connected,
+    // so tests can poke in code and vectors. Only allocated once something is written there.
+    std::vector<uint8_t> noCartridge;
+
+    // Master clock of the next CPU instruction while run() is going
+    uint64_t cpuNextInstruction = 0;
+    // Master clock the ppu must reach before the current instruction touches it
+    uint64_t ppuSyncTarget = 0;
+
+    // Count down one CPU cycle of an OAM DMA transfer, called on CPU cycles while it is going
+    void dmaStep();
+    // Copy the DMA page into OAM and end the transfer
+    void transferOAM();
+    // Pieces of run() and step(). runNext() does the next thing due before until, whether that's
+    // an event, a DMA cycle, an IRQ or an instruction, and returns false if there is nothing.
+    void startRun();
+    bool runNext(uint64_t until);
+    void finishRun(uint64_t until);
+    // Skip iterations of the idle loop the CPU is about to start, if it is at one. The last
+    // iteration before until or the next event is always left to run.
+    bool skipIdleLoop(uint64_t until);
+    // Cycles and instructions in one iteration of the idle loop at PC, 0 cycles if there isn't
+    // one. limit is lowered to when the loop could first see something change.
+    int idleLoopCycles(uint64_t& limit, int& instructions);
+    // Run the recompiled block at PC if there is one and all of it starts before until and the
+    // next event
+    bool runBlock(uint64_t until);
+    // Send writes to a RAM page holding translated code through writeCode(), and back again
+    void protectCode(uint8_t* page);
+    void unprotectCode(uint8_t* page);
+    void writeCode(uint16_t address, uint8_t data);
+    // Clock the ppu until it reaches the given master clock
+    void syncPPU(uint64_t until);
+    // Clock the apu for every CPU cycle before clockCounter
+    void syncAPU();
+    // Work out when the ppu will next raise an NMI
+    void scheduleNMI();
+    // Work out when the cartridge will next raise an IRQ
+    void scheduleIRQ();
+    // Interrupt the CPU for whatever the ppu just raised and reschedule
+    void handleEvents();
+
     // Device status
 
     bool DMATransfer = false;
-    // DMA transfers need to start on an even clock cycle
-    bool DMACanStart = false;
     uint8_t DMAPage = 0x00;
-    uint8_t DMAAddress = 0x00;
-    uint8_t DMAData = 0x00;
+    // CPU cycles the transfer still holds the CPU for, 513 or 514 depending on when it starts
+    int dmaCyclesLeft = 0;
 
 };
 
+// Defined here so the CPU gets them inlined, RAM and ROM accesses are a single indexed load
+inline uint8_t Bus::read(uint16_t address) {
+    uint8_t* page = readPages[address >> 10];
+    if (page != nullptr) {
+        return page[address & (PAGE_SIZE - 1)];
+    }
+    return (this->*readHandlers[address >> 10])(address);
+}
+
+inline const uint8_t* Bus::prgROMByte(uint16_t address) const {
+    // Until a mapper is connected the cartridge space is writable stand in memory
+    if (address < 0x8000 || !mapper) {
+        return nullptr;
+    }
+    return readPages[address >> 10] + (address & (PAGE_SIZE - 1));
+}
+
+inline void Bus::write(uint16_t address, uint8_t data) {
+    uint8_t* page = writePages[address >> 10];
+    if (page != nullptr) {
+        page[address & (PAGE_SIZE - 1)] = data;
+        return;
+    }
+    (this->*writeHandlers[address >> 10])(address, data);
+}
+
 #endif // BUS_H
@@ -5,11 +5,22 @@
 #include <cstdint>
 #include <cstdlib>
 #include <array>
+#include <string>
 #include <iostream>
-#include <iomanip>
 #include <thread>
+#include <utility>
 #include "Bus.h"
 
+// N and Z flags for every 8 bit result, so setting both takes one lookup
+constexpr std::array<uint8_t, 256> buildZNFlags() {
+  std::array<uint8_t, 256> flags{};
+  for (int value = 0; value < 256; value++) {
+    flags[value] = (value & 0x80) | (value == 0 ? 0x02 : 0x00);
+  }
+  return flags;
+}
+constexpr std::array<uint8_t, 256> ZN_FLAGS = buildZNFlags();
+
 class CPU {
 public:
   // Registers
@@ -21,9 +32,7 @@ public:
   uint8_t P = I + U;        // Status Flags Register, start with I and U
   
   int cycles = 0;          // Countdown of cycles until the next instruction
-
-  // RAM for CPU
-  std::array<uint8_t, 64 * 1024> memory{};
+  uint64_t instructions = 0; // Instructions run since power on
 
   // Flags
   enum FLAGS {
@@ -40,8 +49,7 @@ public:
   // Struct for returning address
   struct AddressResult {
     uint16_t address;
-    int cycles;
-    bool additionalCycles;
+    bool pageCrossed;
   };
 
   void connectBus(Bus* bus) {this->bus = bus;}
@@ -56,20 +64,6 @@ public:
     return bus->read(address);
   }
 
-  uint8_t readrom(uint16_t address) {
-    if (address < memory.size()) {
-      return memory[address];
-    } else {
-      std::cerr << "Address out of bounds: " << address << '\n';
-      return -1;
-    }
-  }
-
-  uint8_t writerom(uint16_t address, uint8_t data) {
-    if (address < memory.size()) memory[address] = data;
-    else std::cerr << "Address out of bounds: " << address << '\n';
-  }
-
   // Returns value at memory address
   uint8_t readMemory(const uint16_t address) const {
     return bus->read(address);
@@ -99,23 +93,6 @@ public:
       A, X, Y, PC-1, S, P);
   }
 
-  // Print the contents of the memory
-  void printMemory() const {
-    constexpr size_t bytesPerLine = 16;
-
-    for (size_t i = 0; i < memory.size(); i += bytesPerLine) {
-      // Print the memory address at the start of the line
-      std::cout << std::hex << std::setw(8) << std::setfill('0') << i << ": ";
-
-      // Print the memory values
-      for (size_t j = 0; j < bytesPerLine && (i + j) < memory.size(); ++j) {
-        std::cout << std::setw(2) << std::setfill('0') << static_cast<int>(memory[i + j]) << " ";
-      }
-
-      std::cout << "\n";
-    }
-  }
-
   // Set the CPU registers as specified by a console reset
   void reset() {
     const uint16_t read_address = 0xFFFC;
@@ -128,6 +105,29 @@ public:
     setFlag(U, true);
   }
 
+  // Registers and the cycle countdown, for save states
+  void saveState(StateWriter& state) const {
+    state.put(A);
+    state.put(X);
+    state.put(Y);
+    state.put(S);
+    state.put(PC);
+    state.put(P);
+    state.put(cycles);
+    state.put(instructions);
+  }
+
+  void loadState(StateReader& state) {
+    state.get(A);
+    state.get(X);
+    state.get(Y);
+    state.get(S);
+    state.get(PC);
+    state.get(P);
+    state.get(cycles);
+    state.get(instructions);
+  }
+
   // Read and execute cycles until the next instruction has ran
   void execute() {
     int ran = 1;
@@ -142,30 +142,8 @@ public:
 
     // Ready to run next instruction
     if (cycles == 0) {
-      // Read the opcode
-      uint8_t opcode = readMemory(PC++);
-      // printf("Opcode: %02X\n", opcode);
-      // printRegisters();
-
-      // Get the address mode and instruction type from the opcode
-      //std::cout << "Opcode: 0x" << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << static_cast<int>(opcode) << std::endl;
-      Instruction opcodeInstr = instructionTable[opcode];
-      if (opcodeInstr.operation == nullptr || opcodeInstr.addressingMode == nullptr) {
-        std::cout << "Error: Invalid opcode"; 
-      }
-
-      // Find the address, cycles and additional cycles
-      AddressResult res = (this->*opcodeInstr.addressingMode)();
-      //std::cout << "Cycles: " << res.cycles << "\n";
-
-      // Execute the instruction
-      int instrCycles = (this->*opcodeInstr.operation)(res.address);
-
-      // Adds cycles to counter (if necessary)
-      cycles += res.cycles;
-      if (res.additionalCycles) {
-        cycles += instrCycles;
-      }
+      // Adds cycles to counter
+      cycles += runInstruction();
 
       // Return ran
       ran = 0;
@@ -178,309 +156,482 @@ public:
     return ran;
   }
 
-  // Instruction struct for storing addressingMode and operation
+  // Run the instruction at PC all at once, returning how many cycles it takes. Built with
+  // CPU_DECODE_CACHE, code in PRG ROM is decoded once and run from decodeCache after that.
+  int runInstruction();
+  // Fetch, decode and run the instruction at PC
+  int interpretInstruction();
+
+  // Run the next instruction all at once and return its exact cycle cost, including any cycles
+  // still owed from an interrupt or a cycleExecute() countdown so none are left pending
+  int step() {
+    int owed = cycles;
+    cycles = 0;
+    return owed + runInstruction();
+  }
+
+  // Run one opcode with its table entry known at compile time, so the addressing mode and
+  // operation can be inlined into a single function
+  template <uint8_t Opcode>
+  int runFused();
+
+  // An instruction whose opcode and operand bytes were read ahead of time, so running it again
+  // doesn't fetch anything
+  struct DecodedInstruction {
+    int (*run)(CPU& cpu, const DecodedInstruction& decoded);
+    uint16_t operand;   // Operand bytes as resolveOperand() takes them
+    uint16_t next;      // Address of the following instruction
+  };
+
+  // Read the instruction at address through the bus without running it
+  DecodedInstruction decode(uint16_t address);
+
+  // Run a decoded instruction that starts at PC, returning how many cycles it takes
+  int runDecoded(const DecodedInstruction& decoded) {
+    instructions++;
+    return decoded.run(*this, decoded);
+  }
+
+  template <uint8_t Opcode>
+  static int runDecodedOpcode(CPU& cpu, const DecodedInstruction& decoded);
+
+  // Decoded PRG ROM instructions, direct mapped by PC. Each remembers its PC and where its opcode
+  // is in the ROM image, so after a bank switch the old bank's instructions miss instead of
+  // running, and so do the same bytes seen through another window, whose next PC differs.
+  struct CachedInstruction {
+    const uint8_t* source = nullptr;
+    uint16_t pc = 0;
+    DecodedInstruction decoded;
+  };
+  // Only used built with CPU_DECODE_CACHE, but always there so every file including this one
+  // agrees on the CPU's layout
+  static constexpr int DECODE_CACHE_SIZE = 2048;
+  std::array<CachedInstruction, DECODE_CACHE_SIZE> decodeCache{};
+
+  // Addressing modes, one for each addressing mode function
+  enum MODES {
+    IMPLICIT,
+    ACCUMULATOR,
+    IMMEDIATE,
+    RELATIVE,
+    ZERO_PAGE,
+    ZERO_PAGE_X,
+    ZERO_PAGE_Y,
+    ABSOLUTE,
+    ABSOLUTE_X,
+    ABSOLUTE_Y,
+    INDIRECT_X,
+    INDIRECT_Y,
+    INDIRECT_JMP
+  };
+
+  // What an instruction does with the memory at its address
+  enum ACCESS {
+    NONE,
+    READ,
+    WRITE,
+    READ_MODIFY_WRITE
+  };
+
+  // Everything known about an opcode before it runs
   struct Instruction {
+    const char* mnemonic;
     int (CPU::*operation)(uint16_t);
     AddressResult (CPU::*addressingMode)();
+    MODES mode;
+    ACCESS access;
+    uint8_t cycles;       // Cycles taken without a page cross or branch
+    uint8_t pageCross;    // Cycles added when the address crosses a page
+    uint8_t length;       // Bytes including the opcode
   };
 
-  // Intialize instructionTable with null values
-  Instruction instructionTable[256];
+  static constexpr AddressResult (CPU::*modeFunction(MODES mode))() {
+    switch (mode) {
+      case IMPLICIT: return &CPU::Implicit;
+      case ACCUMULATOR: return &CPU::Accumulator;
+      case IMMEDIATE: return &CPU::Immediate;
+      case RELATIVE: return &CPU::Relative;
+      case ZERO_PAGE: return &CPU::ZeroPage;
+      case ZERO_PAGE_X: return &CPU::ZeroPageX;
+      case ZERO_PAGE_Y: return &CPU::ZeroPageY;
+      case ABSOLUTE: return &CPU::Absolute;
+      case ABSOLUTE_X: return &CPU::AbsoluteX;
+      case ABSOLUTE_Y: return &CPU::AbsoluteY;
+      case INDIRECT_X: return &CPU::IndirectX;
+      case INDIRECT_Y: return &CPU::IndirectY;
+      case INDIRECT_JMP: return &CPU::IndirectJMP;
+    }
+    return nullptr;
+  }
+
+  static constexpr uint8_t modeLength(MODES mode) {
+    switch (mode) {
+      case IMPLICIT:
+      case ACCUMULATOR:
+        return 1;
+      case ABSOLUTE:
+      case ABSOLUTE_X:
+      case ABSOLUTE_Y:
+      case INDIRECT_JMP:
+        return 3;
+      default:
+        return 2;
+    }
+  }
+
+  // Table entry for an opcode. Only reads pay for crossing a page, writes and read-modify-writes
+  // always take the extra cycle so it's counted in their base cycles.
+  static constexpr Instruction op(const char* mnemonic, int (CPU::*operation)(uint16_t), MODES mode,
+                                  uint8_t cycles, ACCESS access) {
+    bool indexed = mode == ABSOLUTE_X || mode == ABSOLUTE_Y || mode == INDIRECT_Y;
+    return {mnemonic, operation, modeFunction(mode), mode, access, cycles,
+            static_cast<uint8_t>(indexed && access == READ ? 1 : 0), modeLength(mode)};
+  }
 
-  void initInstructionTable() {
-      for (int i = 0; i < 256; i++) {
-        instructionTable[i] = {nullptr, nullptr};
-  };
+  // Disassemble the instruction at address, reading its operands through the bus
+  std::string disassemble(uint16_t address);
+
+  // Build the table at compile time. Every opcode has to be listed, CPU_INSTRUCTIONS is checked
+  // for holes right after the class
+  static constexpr std::array<Instruction, 256> buildInstructionTable() {
+  std::array<Instruction, 256> instructionTable{};
 
     // Brian's Instruction Table START ---------------------------- //
   // LDA
-  instructionTable[0xA9] = {&CPU::LDA, &CPU::Immediate};
-  instructionTable[0xA5] = {&CPU::LDA, &CPU::ZeroPage};
-  instructionTable[0xB5] = {&CPU::LDA, &CPU::ZeroPageX};
-  instructionTable[0xAD] = {&CPU::LDA, &CPU::Absolute};
-  instructionTable[0xBD] = {&CPU::LDA, &CPU::AbsoluteX};
-  instructionTable[0xB9] = {&CPU::LDA, &CPU::AbsoluteY};
-  instructionTable[0xA1] = {&CPU::LDA, &CPU::IndirectX};
-  instructionTable[0xB1] = {&CPU::LDA, &CPU::IndirectY};
+  instructionTable[0xA9] = op("LDA", &CPU::LDA, IMMEDIATE, 2, READ);
+  instructionTable[0xA5] = op("LDA", &CPU::LDA, ZERO_PAGE, 3, READ);
+  instructionTable[0xB5] = op("LDA", &CPU::LDA, ZERO_PAGE_X, 4, READ);
+  instructionTable[0xAD] = op("LDA", &CPU::LDA, ABSOLUTE, 4, READ);
+  instructionTable[0xBD] = op("LDA", &CPU::LDA, ABSOLUTE_X, 4, READ);
+  instructionTable[0xB9] = op("LDA", &CPU::LDA, ABSOLUTE_Y, 4, READ);
+  instructionTable[0xA1] = op("LDA", &CPU::LDA, INDIRECT_X, 6, READ);
+  instructionTable[0xB1] = op("LDA", &CPU::LDA, INDIRECT_Y, 5, READ);
 
   // LDX
-  instructionTable[0xA2] = {&CPU::LDX, &CPU::Immediate};
-  instructionTable[0xA6] = {&CPU::LDX, &CPU::ZeroPage};
-  instructionTable[0xB6] = {&CPU::LDX, &CPU::ZeroPageY};
-  instructionTable[0xAE] = {&CPU::LDX, &CPU::Absolute};
-  instructionTable[0xBE] = {&CPU::LDX, &CPU::AbsoluteY};
+  instructionTable[0xA2] = op("LDX", &CPU::LDX, IMMEDIATE, 2, READ);
+  instructionTable[0xA6] = op("LDX", &CPU::LDX, ZERO_PAGE, 3, READ);
+  instructionTable[0xB6] = op("LDX", &CPU::LDX, ZERO_PAGE_Y, 4, READ);
+  instructionTable[0xAE] = op("LDX", &CPU::LDX, ABSOLUTE, 4, READ);
+  instructionTable[0xBE] = op("LDX", &CPU::LDX, ABSOLUTE_Y, 4, READ);
 
   // LDY
-  instructionTable[0xA0] = {&CPU::LDY, &CPU::Immediate};
-  instructionTable[0xA4] = {&CPU::LDY, &CPU::ZeroPage};
-  instructionTable[0xB4] = {&CPU::LDY, &CPU::ZeroPageX};
-  instructionTable[0xAC] = {&CPU::LDY, &CPU::Absolute};
-  instructionTable[0xBC] = {&CPU::LDY, &CPU::AbsoluteX};
+  instructionTable[0xA0] = op("LDY", &CPU::LDY, IMMEDIATE, 2, READ);
+  instructionTable[0xA4] = op("LDY", &CPU::LDY, ZERO_PAGE, 3, READ);
+  instructionTable[0xB4] = op("LDY", &CPU::LDY, ZERO_PAGE_X, 4, READ);
+  instructionTable[0xAC] = op("LDY", &CPU::LDY, ABSOLUTE, 4, READ);
+  instructionTable[0xBC] = op("LDY", &CPU::LDY, ABSOLUTE_X, 4, READ);
 
   // STA
-  instructionTable[0x85] = {&CPU::STA, &CPU::ZeroPage};
-  instructionTable[0x95] = {&CPU::STA, &CPU::ZeroPageX};
-  instructionTable[0x8D] = {&CPU::STA, &CPU::Absolute};
-  instructionTable[0x9D] = {&CPU::STA, &CPU::AbsoluteX};
-  instructionTable[0x99] = {&CPU::STA, &CPU::AbsoluteY};
-  instructionTable[0x81] = {&CPU::STA, &CPU::IndirectX};
-  instructionTable[0x91] = {&CPU::STA, &CPU::IndirectY};
+  instructionTable[0x85] = op("STA", &CPU::STA, ZERO_PAGE, 3, WRITE);
+  instructionTable[0x95] = op("STA", &CPU::STA, ZERO_PAGE_X, 4, WRITE);
+  instructionTable[0x8D] = op("STA", &CPU::STA, ABSOLUTE, 4, WRITE);
+  instructionTable[0x9D] = op("STA", &CPU::STA, ABSOLUTE_X, 5, WRITE);
+  instructionTable[0x99] = op("STA", &CPU::STA, ABSOLUTE_Y, 5, WRITE);
+  instructionTable[0x81] = op("STA", &CPU::STA, INDIRECT_X, 6, WRITE);
+  instructionTable[0x91] = op("STA", &CPU::STA, INDIRECT_Y, 6, WRITE);
 
   // STX
-  instructionTable[0x86] = {&CPU::STX, &CPU::ZeroPage};
-  instructionTable[0x96] = {&CPU::STX, &CPU::ZeroPageY};
-  instructionTable[0x8E] = {&CPU::STX, &CPU::Absolute};
+  instructionTable[0x86] = op("STX", &CPU::STX, ZERO_PAGE, 3, WRITE);
+  instructionTable[0x96] = op("STX", &CPU::STX, ZERO_PAGE_Y, 4, WRITE);
+  instructionTable[0x8E] = op("STX", &CPU::STX, ABSOLUTE, 4, WRITE);
 
   // STY
-  instructionTable[0x84] = {&CPU::STY, &CPU::ZeroPage};
-  instructionTable[0x94] = {&CPU::STY, &CPU::ZeroPageX};
-  instructionTable[0x8C] = {&CPU::STY, &CPU::Absolute};
+  instructionTable[0x84] = op("STY", &CPU::STY, ZERO_PAGE, 3, WRITE);
+  instructionTable[0x94] = op("STY", &CPU::STY, ZERO_PAGE_X, 4, WRITE);
+  instructionTable[0x8C] = op("STY", &CPU::STY, ABSOLUTE, 4, WRITE);
 
   // TAX, TAY, TSX, TXA, TXS, TYA
-  instructionTable[0xAA] = {&CPU::TAX, &CPU::Implicit};
-  instructionTable[0xA8] = {&CPU::TAY, &CPU::Implicit};
-  instructionTable[0xBA] = {&CPU::TSX, &CPU::Implicit};
-  instructionTable[0x8A] = {&CPU::TXA, &CPU::Implicit};
-  instructionTable[0x9A] = {&CPU::TXS, &CPU::Implicit};
-  instructionTable[0x98] = {&CPU::TYA, &CPU::Implicit};
+  instructionTable[0xAA] = op("TAX", &CPU::TAX, IMPLICIT, 2, NONE);
+  instructionTable[0xA8] = op("TAY", &CPU::TAY, IMPLICIT, 2, NONE);
+  instructionTable[0xBA] = op("TSX", &CPU::TSX, IMPLICIT, 2, NONE);
+  instructionTable[0x8A] = op("TXA", &CPU::TXA, IMPLICIT, 2, NONE);
+  instructionTable[0x9A] = op("TXS", &CPU::TXS, IMPLICIT, 2, NONE);
+  instructionTable[0x98] = op("TYA", &CPU::TYA, IMPLICIT, 2, NONE);
 
   // Brian Instruction Table END -------------------------------- //
 
 
   // Add instructions
-  instructionTable[0x4C] = {&CPU::JMP, &CPU::Absolute};
-  instructionTable[0x6C] = {&CPU::JMP, &CPU::IndirectJMP};
-  instructionTable[0x20] = {&CPU::JSR, &CPU::Absolute};
-  instructionTable[0x60] = {&CPU::RTS, &CPU::Implicit};
-  instructionTable[0x00] = {&CPU::BRK, &CPU::Implicit};
-  instructionTable[0x40] = {&CPU::RTI, &CPU::Implicit};
-  instructionTable[0x48] = {&CPU::PHA, &CPU::Implicit};
-  instructionTable[0x68] = {&CPU::PLA, &CPU::Implicit};
-  instructionTable[0x08] = {&CPU::PHP, &CPU::Implicit};
-  instructionTable[0x28] = {&CPU::PLP, &CPU::Implicit};
-  instructionTable[0x58] = {&CPU::CLI, &CPU::Implicit};
-  instructionTable[0x78] = {&CPU::SEI, &CPU::Implicit};
-  instructionTable[0xF0] = {&CPU::BEQ, &CPU::Relative};
-  instructionTable[0xD0] = {&CPU::BNE, &CPU::Relative};
-  instructionTable[0x90] = {&CPU::BCC, &CPU::Relative};
-  instructionTable[0xB0] = {&CPU::BCS, &CPU::Relative};
-  instructionTable[0x30] = {&CPU::BMI, &CPU::Relative};
-  instructionTable[0x10] = {&CPU::BPL, &CPU::Relative};
-  instructionTable[0x50] = {&CPU::BVC, &CPU::Relative};
-  instructionTable[0x70] = {&CPU::BVS, &CPU::Relative};
-  instructionTable[0x18] = {&CPU::CLC, &CPU::Implicit};
-  instructionTable[0x38] = {&CPU::SEC, &CPU::Implicit};
-  instructionTable[0x0A] = {&CPU::ASL, &CPU::Accumulator};
-  instructionTable[0x06] = {&CPU::ASL, &CPU::ZeroPage};
-  instructionTable[0x16] = {&CPU::ASL, &CPU::ZeroPageX};
-  instructionTable[0x0E] = {&CPU::ASL, &CPU::Absolute};
-  instructionTable[0x1E] = {&CPU::ASL, &CPU::AbsoluteX};
-  instructionTable[0x4A] = {&CPU::LSR, &CPU::Accumulator};
-  instructionTable[0x46] = {&CPU::LSR, &CPU::ZeroPage};
-  instructionTable[0x56] = {&CPU::LSR, &CPU::ZeroPageX};
-  instructionTable[0x4E] = {&CPU::LSR, &CPU::Absolute};
-  instructionTable[0x5E] = {&CPU::LSR, &CPU::AbsoluteX};
-  instructionTable[0x2A] = {&CPU::ROL, &CPU::Accumulator};
-  instructionTable[0x26] = {&CPU::ROL, &CPU::ZeroPage};
-  instructionTable[0x36] = {&CPU::ROL, &CPU::ZeroPageX};
-  instructionTable[0x2E] = {&CPU::ROL, &CPU::Absolute};
-  instructionTable[0x3E] = {&CPU::ROL, &CPU::AbsoluteX};
-  instructionTable[0x6A] = {&CPU::ROR, &CPU::Accumulator};
-  instructionTable[0x66] = {&CPU::ROR, &CPU::ZeroPage};
-  instructionTable[0x76] = {&CPU::ROR, &CPU::ZeroPageX};
-  instructionTable[0x6E] = {&CPU::ROR, &CPU::Absolute};
-  instructionTable[0x7E] = {&CPU::ROR, &CPU::AbsoluteX};
-  instructionTable[0xC9] = {&CPU::CMP, &CPU::Immediate};
-  instructionTable[0xC5] = {&CPU::CMP, &CPU::ZeroPage};
-  instructionTable[0xD5] = {&CPU::CMP, &CPU::ZeroPageX};
-  instructionTable[0xCD] = {&CPU::CMP, &CPU::Absolute};
-  instructionTable[0xDD] = {&CPU::CMP, &CPU::AbsoluteX};
-  instructionTable[0xD9] = {&CPU::CMP, &CPU::AbsoluteY};
-  instructionTable[0xC1] = {&CPU::CMP, &CPU::IndirectX};
-  instructionTable[0xD1] = {&CPU::CMP, &CPU::IndirectY};
-  instructionTable[0xE0] = {&CPU::CPX, &CPU::Immediate};
-  instructionTable[0xE4] = {&CPU::CPX, &CPU::ZeroPage};
-  instructionTable[0xEC] = {&CPU::CPX, &CPU::Absolute};
-  instructionTable[0xC0] = {&CPU::CPY, &CPU::Immediate};
-  instructionTable[0xC4] = {&CPU::CPY, &CPU::ZeroPage};
-  instructionTable[0xCC] = {&CPU::CPY, &CPU::Absolute};
-  instructionTable[0xEA] = {&CPU::NOP, &CPU::Implicit};
-  instructionTable[0xD8] = {&CPU::CLD, &CPU::Implicit};
-  instructionTable[0xF8] = {&CPU::SED, &CPU::Implicit};
-  instructionTable[0xB8] = {&CPU::CLV, &CPU::Implicit};
-  instructionTable[0x69] = {&CPU::ADC, &CPU::Immediate};
-  instructionTable[0x65] = {&CPU::ADC, &CPU::ZeroPage};
-  instructionTable[0x75] = {&CPU::ADC, &CPU::ZeroPageX};
-  instructionTable[0x6D] = {&CPU::ADC, &CPU::Absolute};
-  instructionTable[0x7D] = {&CPU::ADC, &CPU::AbsoluteX};
-  instructionTable[0x79] = {&CPU::ADC, &CPU::AbsoluteY};
-  instructionTable[0x61] = {&CPU::ADC, &CPU::IndirectX};
-  instructionTable[0x71] = {&CPU::ADC, &CPU::IndirectY};
-  instructionTable[0xE9] = {&CPU::SBC, &CPU::Immediate};
-  instructionTable[0xE5] = {&CPU::SBC, &CPU::ZeroPage};
-  instructionTable[0xF5] = {&CPU::SBC, &CPU::ZeroPageX};
-  instructionTable[0xED] = {&CPU::SBC, &CPU::Absolute};
-  instructionTable[0xFD] = {&CPU::SBC, &CPU::AbsoluteX};
-  instructionTable[0xF9] = {&CPU::SBC, &CPU::AbsoluteY};
-  instructionTable[0xE1] = {&CPU::SBC, &CPU::IndirectX};
-  instructionTable[0xF1] = {&CPU::SBC, &CPU::IndirectY};
-  instructionTable[0x24] = {&CPU::BIT, &CPU::ZeroPage};
-  instructionTable[0x2C] = {&CPU::BIT, &CPU::Absolute};
-  instructionTable[0x29] = {&CPU::AND, &CPU::Immediate};
-  instructionTable[0x25] = {&CPU::AND, &CPU::ZeroPage};
-  instructionTable[0x35] = {&CPU::AND, &CPU::ZeroPageX};
-  instructionTable[0x2D] = {&CPU::AND, &CPU::Absolute};
-  instructionTable[0x3D] = {&CPU::AND, &CPU::AbsoluteX};
-  instructionTable[0x39] = {&CPU::AND, &CPU::AbsoluteY};
-  instructionTable[0x21] = {&CPU::AND, &CPU::IndirectX};
-  instructionTable[0x31] = {&CPU::AND, &CPU::IndirectY};
-  instructionTable[0x09] = {&CPU::ORA, &CPU::Immediate};
-  instructionTable[0x05] = {&CPU::ORA, &CPU::ZeroPage};
-  instructionTable[0x15] = {&CPU::ORA, &CPU::ZeroPageX};
-  instructionTable[0x0D] = {&CPU::ORA, &CPU::Absolute};
-  instructionTable[0x1D] = {&CPU::ORA, &CPU::AbsoluteX};
-  instructionTable[0x19] = {&CPU::ORA, &CPU::AbsoluteY};
-  instructionTable[0x01] = {&CPU::ORA, &CPU::IndirectX};
-  instructionTable[0x11] = {&CPU::ORA, &CPU::IndirectY};
-  instructionTable[0x49] = {&CPU::EOR, &CPU::Immediate};
-  instructionTable[0x45] = {&CPU::EOR, &CPU::ZeroPage};
-  instructionTable[0x55] = {&CPU::EOR, &CPU::ZeroPageX};
-  instructionTable[0x4D] = {&CPU::EOR, &CPU::Absolute};
-  instructionTable[0x5D] = {&CPU::EOR, &CPU::AbsoluteX};
-  instructionTable[0x59] = {&CPU::EOR, &CPU::AbsoluteY};
-  instructionTable[0x41] = {&CPU::EOR, &CPU::IndirectX};
-  instructionTable[0x51] = {&CPU::EOR, &CPU::IndirectY};
-  instructionTable[0xC8] = {&CPU::INY, &CPU::Implicit};
-  instructionTable[0xE8] = {&CPU::INX, &CPU::Implicit};
-  instructionTable[0x88] = {&CPU::DEY, &CPU::Implicit};
-  instructionTable[0xCA] = {&CPU::DEX, &CPU::Implicit};
-  instructionTable[0xE6] = {&CPU::INC, &CPU::ZeroPage};
-  instructionTable[0xF6] = {&CPU::INC, &CPU::ZeroPageX};
-  instructionTable[0xEE] = {&CPU::INC, &CPU::Absolute};
-  instructionTable[0xFE] = {&CPU::INC, &CPU::AbsoluteX};
-  instructionTable[0xC6] = {&CPU::DEC, &CPU::ZeroPage};
-  instructionTable[0xD6] = {&CPU::DEC, &CPU::ZeroPageX};
-  instructionTable[0xCE] = {&CPU::DEC, &CPU::Absolute};
-  instructionTable[0xDE] = {&CPU::DEC, &CPU::AbsoluteX};
+  instructionTable[0x4C] = op("JMP", &CPU::JMP, ABSOLUTE, 3, NONE);
+  instructionTable[0x6C] = op("JMP", &CPU::JMP, INDIRECT_JMP, 5, NONE);
+  instructionTable[0x20] = op("JSR", &CPU::JSR, ABSOLUTE, 6, NONE);
+  instructionTable[0x60] = op("RTS", &CPU::RTS, IMPLICIT, 6, NONE);
+  instructionTable[0x00] = op("BRK", &CPU::BRK, IMPLICIT, 7, NONE);
+  instructionTable[0x40] = op("RTI", &CPU::RTI, IMPLICIT, 6, NONE);
+  instructionTable[0x48] = op("PHA", &CPU::PHA, IMPLICIT, 3, NONE);
+  instructionTable[0x68] = op("PLA", &CPU::PLA, IMPLICIT, 4, NONE);
+  instructionTable[0x08] = op("PHP", &CPU::PHP, IMPLICIT, 3, NONE);
+  instructionTable[0x28] = op("PLP", &CPU::PLP, IMPLICIT, 4, NONE);
+  instructionTable[0x58] = op("CLI", &CPU::CLI, IMPLICIT, 2, NONE);
+  instructionTable[0x78] = op("SEI", &CPU::SEI, IMPLICIT, 2, NONE);
+  instructionTable[0xF0] = op("BEQ", &CPU::BEQ, RELATIVE, 2, NONE);
+  instructionTable[0xD0] = op("BNE", &CPU::BNE, RELATIVE, 2, NONE);
+  instructionTable[0x90] = op("BCC", &CPU::BCC, RELATIVE, 2, NONE);
+  instructionTable[0xB0] = op("BCS", &CPU::BCS, RELATIVE, 2, NONE);
+  instructionTable[0x30] = op("BMI", &CPU::BMI, RELATIVE, 2, NONE);
+  instructionTable[0x10] = op("BPL", &CPU::BPL, RELATIVE, 2, NONE);
+  instructionTable[0x50] = op("BVC", &CPU::BVC, RELATIVE, 2, NONE);
+  instructionTable[0x70] = op("BVS", &CPU::BVS, RELATIVE, 2, NONE);
+  instructionTable[0x18] = op("CLC", &CPU::CLC, IMPLICIT, 2, NONE);
+  instructionTable[0x38] = op("SEC", &CPU::SEC, IMPLICIT, 2, NONE);
+  instructionTable[0x0A] = op("ASL", &CPU::ASL, ACCUMULATOR, 2, NONE);
+  instructionTable[0x06] = op("ASL", &CPU::ASL, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0x16] = op("ASL", &CPU::ASL, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0x0E] = op("ASL", &CPU::ASL, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0x1E] = op("ASL", &CPU::ASL, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
+  instructionTable[0x4A] = op("LSR", &CPU::LSR, ACCUMULATOR, 2, NONE);
+  instructionTable[0x46] = op("LSR", &CPU::LSR, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0x56] = op("LSR", &CPU::LSR, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0x4E] = op("LSR", &CPU::LSR, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0x5E] = op("LSR", &CPU::LSR, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
+  instructionTable[0x2A] = op("ROL", &CPU::ROL, ACCUMULATOR, 2, NONE);
+  instructionTable[0x26] = op("ROL", &CPU::ROL, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0x36] = op("ROL", &CPU::ROL, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0x2E] = op("ROL", &CPU::ROL, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0x3E] = op("ROL", &CPU::ROL, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
+  instructionTable[0x6A] = op("ROR", &CPU::ROR, ACCUMULATOR, 2, NONE);
+  instructionTable[0x66] = op("ROR", &CPU::ROR, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0x76] = op("ROR", &CPU::ROR, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0x6E] = op("ROR", &CPU::ROR, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0x7E] = op("ROR", &CPU::ROR, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
+  instructionTable[0xC9] = op("CMP", &CPU::CMP, IMMEDIATE, 2, READ);
+  instructionTable[0xC5] = op("CMP", &CPU::CMP, ZERO_PAGE, 3, READ);
+  instructionTable[0xD5] = op("CMP", &CPU::CMP, ZERO_PAGE_X, 4, READ);
+  instructionTable[0xCD] = op("CMP", &CPU::CMP, ABSOLUTE, 4, READ);
+  instructionTable[0xDD] = op("CMP", &CPU::CMP, ABSOLUTE_X, 4, READ);
+  instructionTable[0xD9] = op("CMP", &CPU::CMP, ABSOLUTE_Y, 4, READ);
+  instructionTable[0xC1] = op("CMP", &CPU::CMP, INDIRECT_X, 6, READ);
+  instructionTable[0xD1] = op("CMP", &CPU::CMP, INDIRECT_Y, 5, READ);
+  instructionTable[0xE0] = op("CPX", &CPU::CPX, IMMEDIATE, 2, READ);
+  instructionTable[0xE4] = op("CPX", &CPU::CPX, ZERO_PAGE, 3, READ);
+  instructionTable[0xEC] = op("CPX", &CPU::CPX, ABSOLUTE, 4, READ);
+  instructionTable[0xC0] = op("CPY", &CPU::CPY, IMMEDIATE, 2, READ);
+  instructionTable[0xC4] = op("CPY", &CPU::CPY, ZERO_PAGE, 3, READ);
+  instructionTable[0xCC] = op("CPY", &CPU::CPY, ABSOLUTE, 4, READ);
+  instructionTable[0xEA] = op("NOP", &CPU::NOP, IMPLICIT, 2, NONE);
+  instructionTable[0xD8] = op("CLD", &CPU::CLD, IMPLICIT, 2, NONE);
+  instructionTable[0xF8] = op("SED", &CPU::SED, IMPLICIT, 2, NONE);
+  instructionTable[0xB8] = op("CLV", &CPU::CLV, IMPLICIT, 2, NONE);
+  instructionTable[0x69] = op("ADC", &CPU::ADC, IMMEDIATE, 2, READ);
+  instructionTable[0x65] = op("ADC", &CPU::ADC, ZERO_PAGE, 3, READ);
+  instructionTable[0x75] = op("ADC", &CPU::ADC, ZERO_PAGE_X, 4, READ);
+  instructionTable[0x6D] = op("ADC", &CPU::ADC, ABSOLUTE, 4, READ);
+  instructionTable[0x7D] = op("ADC", &CPU::ADC, ABSOLUTE_X, 4, READ);
+  instructionTable[0x79] = op("ADC", &CPU::ADC, ABSOLUTE_Y, 4, READ);
+  instructionTable[0x61] = op("ADC", &CPU::ADC, INDIRECT_X, 6, READ);
+  instructionTable[0x71] = op("ADC", &CPU::ADC, INDIRECT_Y, 5, READ);
+  instructionTable[0xE9] = op("SBC", &CPU::SBC, IMMEDIATE, 2, READ);
+  instructionTable[0xE5] = op("SBC", &CPU::SBC, ZERO_PAGE, 3, READ);
+  instructionTable[0xF5] = op("SBC", &CPU::SBC, ZERO_PAGE_X, 4, READ);
+  instructionTable[0xED] = op("SBC", &CPU::SBC, ABSOLUTE, 4, READ);
+  instructionTable[0xFD] = op("SBC", &CPU::SBC, ABSOLUTE_X, 4, READ);
+  instructionTable[0xF9] = op("SBC", &CPU::SBC, ABSOLUTE_Y, 4, READ);
+  instructionTable[0xE1] = op("SBC", &CPU::SBC, INDIRECT_X, 6, READ);
+  instructionTable[0xF1] = op("SBC", &CPU::SBC, INDIRECT_Y, 5, READ);
+  instructionTable[0x24] = op("BIT", &CPU::BIT, ZERO_PAGE, 3, READ);
+  instructionTable[0x2C] = op("BIT", &CPU::BIT, ABSOLUTE, 4, READ);
+  instructionTable[0x29] = op("AND", &CPU::AND, IMMEDIATE, 2, READ);
+  instructionTable[0x25] = op("AND", &CPU::AND, ZERO_PAGE, 3, READ);
+  instructionTable[0x35] = op("AND", &CPU::AND, ZERO_PAGE_X, 4, READ);
+  instructionTable[0x2D] = op("AND", &CPU::AND, ABSOLUTE, 4, READ);
+  instructionTable[0x3D] = op("AND", &CPU::AND, ABSOLUTE_X, 4, READ);
+  instructionTable[0x39] = op("AND", &CPU::AND, ABSOLUTE_Y, 4, READ);
+  instructionTable[0x21] = op("AND", &CPU::AND, INDIRECT_X, 6, READ);
+  instructionTable[0x31] = op("AND", &CPU::AND, INDIRECT_Y, 5, READ);
+  instructionTable[0x09] = op("ORA", &CPU::ORA, IMMEDIATE, 2, READ);
+  instructionTable[0x05] = op("ORA", &CPU::ORA, ZERO_PAGE, 3, READ);
+  instructionTable[0x15] = op("ORA", &CPU::ORA, ZERO_PAGE_X, 4, READ);
+  instructionTable[0x0D] = op("ORA", &CPU::ORA, ABSOLUTE, 4, READ);
+  instructionTable[0x1D] = op("ORA", &CPU::ORA, ABSOLUTE_X, 4, READ);
+  instructionTable[0x19] = op("ORA", &CPU::ORA, ABSOLUTE_Y, 4, READ);
+  instructionTable[0x01] = op("ORA", &CPU::ORA, INDIRECT_X, 6, READ);
+  instructionTable[0x11] = op("ORA", &CPU::ORA, INDIRECT_Y, 5, READ);
+  instructionTable[0x49] = op("EOR", &CPU::EOR, IMMEDIATE, 2, READ);
+  instructionTable[0x45] = op("EOR", &CPU::EOR, ZERO_PAGE, 3, READ);
+  instructionTable[0x55] = op("EOR", &CPU::EOR, ZERO_PAGE_X, 4, READ);
+  instructionTable[0x4D] = op("EOR", &CPU::EOR, ABSOLUTE, 4, READ);
+  instructionTable[0x5D] = op("EOR", &CPU::EOR, ABSOLUTE_X, 4, READ);
+  instructionTable[0x59] = op("EOR", &CPU::EOR, ABSOLUTE_Y, 4, READ);
+  instructionTable[0x41] = op("EOR", &CPU::EOR, INDIRECT_X, 6, READ);
+  instructionTable[0x51] = op("EOR", &CPU::EOR, INDIRECT_Y, 5, READ);
+  instructionTable[0xC8] = op("INY", &CPU::INY, IMPLICIT, 2, NONE);
+  instructionTable[0xE8] = op("INX", &CPU::INX, IMPLICIT, 2, NONE);
+  instructionTable[0x88] = op("DEY", &CPU::DEY, IMPLICIT, 2, NONE);
+  instructionTable[0xCA] = op("DEX", &CPU::DEX, IMPLICIT, 2, NONE);
+  instructionTable[0xE6] = op("INC", &CPU::INC, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0xF6] = op("INC", &CPU::INC, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0xEE] = op("INC", &CPU::INC, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0xFE] = op("INC", &CPU::INC, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
+  instructionTable[0xC6] = op("DEC", &CPU::DEC, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0xD6] = op("DEC", &CPU::DEC, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0xCE] = op("DEC", &CPU::DEC, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0xDE] = op("DEC", &CPU::DEC, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
 
   // Unofficial Opcodes
   // SLO
-  instructionTable[0x07] = {&CPU::SLO, &CPU::ZeroPage};
-  instructionTable[0x17] = {&CPU::SLO, &CPU::ZeroPageX};
-  instructionTable[0x03] = {&CPU::SLO, &CPU::IndirectX};
-  instructionTable[0x13] = {&CPU::SLO, &CPU::IndirectY};
-  instructionTable[0x0F] = {&CPU::SLO, &CPU::Absolute};
-  instructionTable[0x1F] = {&CPU::SLO, &CPU::AbsoluteX};
-  instructionTable[0x1B] = {&CPU::SLO, &CPU::AbsoluteY};
+  instructionTable[0x07] = op("SLO", &CPU::SLO, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0x17] = op("SLO", &CPU::SLO, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0x03] = op("SLO", &CPU::SLO, INDIRECT_X, 8, READ_MODIFY_WRITE);
+  instructionTable[0x13] = op("SLO", &CPU::SLO, INDIRECT_Y, 8, READ_MODIFY_WRITE);
+  instructionTable[0x0F] = op("SLO", &CPU::SLO, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0x1F] = op("SLO", &CPU::SLO, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
+  instructionTable[0x1B] = op("SLO", &CPU::SLO, ABSOLUTE_Y, 7, READ_MODIFY_WRITE);
 
   // RLA
-  instructionTable[0x27] = {&CPU::RLA, &CPU::ZeroPage};
-  instructionTable[0x37] = {&CPU::RLA, &CPU::ZeroPageX};
-  instructionTable[0x23] = {&CPU::RLA, &CPU::IndirectX};
-  instructionTable[0x33] = {&CPU::RLA, &CPU::IndirectY};
-  instructionTable[0x2F] = {&CPU::RLA, &CPU::Absolute};
-  instructionTable[0x3F] = {&CPU::RLA, &CPU::AbsoluteX};
-  instructionTable[0x3B] = {&CPU::RLA, &CPU::AbsoluteY};
+  instructionTable[0x27] = op("RLA", &CPU::RLA, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0x37] = op("RLA", &CPU::RLA, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0x23] = op("RLA", &CPU::RLA, INDIRECT_X, 8, READ_MODIFY_WRITE);
+  instructionTable[0x33] = op("RLA", &CPU::RLA, INDIRECT_Y, 8, READ_MODIFY_WRITE);
+  instructionTable[0x2F] = op("RLA", &CPU::RLA, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0x3F] = op("RLA", &CPU::RLA, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
+  instructionTable[0x3B] = op("RLA", &CPU::RLA, ABSOLUTE_Y, 7, READ_MODIFY_WRITE);
 
   // SRE
-  instructionTable[0x47] = {&CPU::SRE, &CPU::ZeroPage};
-  instructionTable[0x57] = {&CPU::SRE, &CPU::ZeroPageX};
-  instructionTable[0x43] = {&CPU::SRE, &CPU::IndirectX};
-  instructionTable[0x53] = {&CPU::SRE, &CPU::IndirectY};
-  instructionTable[0x4F] = {&CPU::SRE, &CPU::Absolute};
-  instructionTable[0x5F] = {&CPU::SRE, &CPU::AbsoluteX};
-  instructionTable[0x5B] = {&CPU::SRE, &CPU::AbsoluteY};
+  instructionTable[0x47] = op("SRE", &CPU::SRE, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0x57] = op("SRE", &CPU::SRE, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0x43] = op("SRE", &CPU::SRE, INDIRECT_X, 8, READ_MODIFY_WRITE);
+  instructionTable[0x53] = op("SRE", &CPU::SRE, INDIRECT_Y, 8, READ_MODIFY_WRITE);
+  instructionTable[0x4F] = op("SRE", &CPU::SRE, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0x5F] = op("SRE", &CPU::SRE, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
+  instructionTable[0x5B] = op("SRE", &CPU::SRE, ABSOLUTE_Y, 7, READ_MODIFY_WRITE);
 
   // RRA
-  instructionTable[0x67] = {&CPU::RRA, &CPU::ZeroPage};
-  instructionTable[0x77] = {&CPU::RRA, &CPU::ZeroPageX};
-  instructionTable[0x63] = {&CPU::RRA, &CPU::IndirectX};
-  instructionTable[0x73] = {&CPU::RRA, &CPU::IndirectY};
-  instructionTable[0x6F] = {&CPU::RRA, &CPU::Absolute};
-  instructionTable[0x7F] = {&CPU::RRA, &CPU::AbsoluteX};
-  instructionTable[0x7B] = {&CPU::RRA, &CPU::AbsoluteY};
+  instructionTable[0x67] = op("RRA", &CPU::RRA, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0x77] = op("RRA", &CPU::RRA, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0x63] = op("RRA", &CPU::RRA, INDIRECT_X, 8, READ_MODIFY_WRITE);
+  instructionTable[0x73] = op("RRA", &CPU::RRA, INDIRECT_Y, 8, READ_MODIFY_WRITE);
+  instructionTable[0x6F] = op("RRA", &CPU::RRA, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0x7F] = op("RRA", &CPU::RRA, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
+  instructionTable[0x7B] = op("RRA", &CPU::RRA, ABSOLUTE_Y, 7, READ_MODIFY_WRITE);
 
   // SAX
-  instructionTable[0x87] = {&CPU::SAX, &CPU::ZeroPage};
-  instructionTable[0x97] = {&CPU::SAX, &CPU::ZeroPageY};
-  instructionTable[0x83] = {&CPU::SAX, &CPU::IndirectX};
-  instructionTable[0x8F] = {&CPU::SAX, &CPU::Absolute};
+  instructionTable[0x87] = op("SAX", &CPU::SAX, ZERO_PAGE, 3, WRITE);
+  instructionTable[0x97] = op("SAX", &CPU::SAX, ZERO_PAGE_Y, 4, WRITE);
+  instructionTable[0x83] = op("SAX", &CPU::SAX, INDIRECT_X, 6, WRITE);
+  instructionTable[0x8F] = op("SAX", &CPU::SAX, ABSOLUTE, 4, WRITE);
 
   // LAX
-  instructionTable[0xA7] = {&CPU::LAX, &CPU::ZeroPage};
-  instructionTable[0xB7] = {&CPU::LAX, &CPU::ZeroPageY};
-  instructionTable[0xA3] = {&CPU::LAX, &CPU::IndirectX};
-  instructionTable[0xB3] = {&CPU::LAX, &CPU::IndirectY};
-  instructionTable[0xAF] = {&CPU::LAX, &CPU::Absolute};
-  instructionTable[0xBF] = {&CPU::LAX, &CPU::AbsoluteY};
+  instructionTable[0xA7] = op("LAX", &CPU::LAX, ZERO_PAGE, 3, READ);
+  instructionTable[0xB7] = op("LAX", &CPU::LAX, ZERO_PAGE_Y, 4, READ);
+  instructionTable[0xA3] = op("LAX", &CPU::LAX, INDIRECT_X, 6, READ);
+  instructionTable[0xB3] = op("LAX", &CPU::LAX, INDIRECT_Y, 5, READ);
+  instructionTable[0xAF] = op("LAX", &CPU::LAX, ABSOLUTE, 4, READ);
+  instructionTable[0xBF] = op("LAX", &CPU::LAX, ABSOLUTE_Y, 4, READ);
 
   // DCP
-  instructionTable[0xC7] = {&CPU::DCP, &CPU::ZeroPage};
-  instructionTable[0xD7] = {&CPU::DCP, &CPU::ZeroPageX};
-  instructionTable[0xC3] = {&CPU::DCP, &CPU::IndirectX};
-  instructionTable[0xD3] = {&CPU::DCP, &CPU::IndirectY};
-  instructionTable[0xCF] = {&CPU::DCP, &CPU::Absolute};
-  instructionTable[0xDF] = {&CPU::DCP, &CPU::AbsoluteX};
-  instructionTable[0xDB] = {&CPU::DCP, &CPU::AbsoluteY};
+  instructionTable[0xC7] = op("DCP", &CPU::DCP, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0xD7] = op("DCP", &CPU::DCP, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0xC3] = op("DCP", &CPU::DCP, INDIRECT_X, 8, READ_MODIFY_WRITE);
+  instructionTable[0xD3] = op("DCP", &CPU::DCP, INDIRECT_Y, 8, READ_MODIFY_WRITE);
+  instructionTable[0xCF] = op("DCP", &CPU::DCP, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0xDF] = op("DCP", &CPU::DCP, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
+  instructionTable[0xDB] = op("DCP", &CPU::DCP, ABSOLUTE_Y, 7, READ_MODIFY_WRITE);
 
   // ISC
-  instructionTable[0xE7] = {&CPU::ISC, &CPU::ZeroPage};
-  instructionTable[0xF7] = {&CPU::ISC, &CPU::ZeroPageX};
-  instructionTable[0xE3] = {&CPU::ISC, &CPU::IndirectX};
-  instructionTable[0xF3] = {&CPU::ISC, &CPU::IndirectY};
-  instructionTable[0xEF] = {&CPU::ISC, &CPU::Absolute};
-  instructionTable[0xFF] = {&CPU::ISC, &CPU::AbsoluteX};
-  instructionTable[0xFB] = {&CPU::ISC, &CPU::AbsoluteY};
+  instructionTable[0xE7] = op("ISC", &CPU::ISC, ZERO_PAGE, 5, READ_MODIFY_WRITE);
+  instructionTable[0xF7] = op("ISC", &CPU::ISC, ZERO_PAGE_X, 6, READ_MODIFY_WRITE);
+  instructionTable[0xE3] = op("ISC", &CPU::ISC, INDIRECT_X, 8, READ_MODIFY_WRITE);
+  instructionTable[0xF3] = op("ISC", &CPU::ISC, INDIRECT_Y, 8, READ_MODIFY_WRITE);
+  instructionTable[0xEF] = op("ISC", &CPU::ISC, ABSOLUTE, 6, READ_MODIFY_WRITE);
+  instructionTable[0xFF] = op("ISC", &CPU::ISC, ABSOLUTE_X, 7, READ_MODIFY_WRITE);
+  instructionTable[0xFB] = op("ISC", &CPU::ISC, ABSOLUTE_Y, 7, READ_MODIFY_WRITE);
 
   // ANC
-  instructionTable[0x0B] = {&CPU::ANC, &CPU::Immediate};
-  instructionTable[0x2B] = {&CPU::ANC, &CPU::Immediate};
+  instructionTable[0x0B] = op("ANC", &CPU::ANC, IMMEDIATE, 2, READ);
+  instructionTable[0x2B] = op("ANC", &CPU::ANC, IMMEDIATE, 2, READ);
 
   // ALR
-  instructionTable[0x4B] = {&CPU::ALR, &CPU::Immediate};
+  instructionTable[0x4B] = op("ALR", &CPU::ALR, IMMEDIATE, 2, READ);
 
   // ARR
-  instructionTable[0x6B] = {&CPU::ARR, &CPU::Immediate};
+  instructionTable[0x6B] = op("ARR", &CPU::ARR, IMMEDIATE, 2, READ);
 
   // AXS
-  instructionTable[0xCB] = {&CPU::AXS, &CPU::Immediate};
+  instructionTable[0xCB] = op("AXS", &CPU::AXS, IMMEDIATE, 2, READ);
 
   // SBC Unofficial
-  instructionTable[0xEB] = {&CPU::SBC, &CPU::Immediate};
+  instructionTable[0xEB] = op("SBC", &CPU::SBC, IMMEDIATE, 2, READ);
 
   // NOP
-  instructionTable[0x04] = {&CPU::NOP, &CPU::ZeroPage};
-  instructionTable[0x44] = {&CPU::NOP, &CPU::ZeroPageY};
-  instructionTable[0x64] = {&CPU::NOP, &CPU::ZeroPageX};
-  instructionTable[0x0C] = {&CPU::NOP, &CPU::Absolute};
-  instructionTable[0x14] = {&CPU::NOP, &CPU::IndirectX};
-  instructionTable[0x34] = {&CPU::NOP, &CPU::IndirectX};
-  instructionTable[0x54] = {&CPU::NOP, &CPU::IndirectX};
-  instructionTable[0x74] = {&CPU::NOP, &CPU::IndirectX};
-  instructionTable[0xD4] = {&CPU::NOP, &CPU::IndirectX};
-  instructionTable[0xF4] = {&CPU::NOP, &CPU::IndirectX};
-  instructionTable[0x1A] = {&CPU::NOP, &CPU::Implicit};
-  instructionTable[0x3A] = {&CPU::NOP, &CPU::Implicit};
-  instructionTable[0x5A] = {&CPU::NOP, &CPU::Implicit};
-  instructionTable[0x7A] = {&CPU::NOP, &CPU::Implicit};
-  instructionTable[0xDA] = {&CPU::NOP, &CPU::Implicit};
-  instructionTable[0xFA] = {&CPU::NOP, &CPU::Implicit};
-  instructionTable[0x80] = {&CPU::NOP, &CPU::IndirectX};
-  instructionTable[0x1C] = {&CPU::NOP, &CPU::Absolute};
-  instructionTable[0x3C] = {&CPU::NOP, &CPU::Absolute};
-  instructionTable[0x3C] = {&CPU::NOP, &CPU::Absolute};
-  instructionTable[0x5C] = {&CPU::NOP, &CPU::Absolute};
-  instructionTable[0x7C] = {&CPU::NOP, &CPU::Absolute};
-  instructionTable[0xDC] = {&CPU::NOP, &CPU::Absolute};
-  instructionTable[0xFC] = {&CPU::NOP, &CPU::Absolute};
+  instructionTable[0x04] = op("NOP", &CPU::NOP, ZERO_PAGE, 3, READ);
+  instructionTable[0x44] = op("NOP", &CPU::NOP, ZERO_PAGE, 3, READ);
+  instructionTable[0x64] = op("NOP", &CPU::NOP, ZERO_PAGE_X, 4, READ);
+  instructionTable[0x0C] = op("NOP", &CPU::NOP, ABSOLUTE, 4, READ);
+  instructionTable[0x14] = op("NOP", &CPU::NOP, ZERO_PAGE_X, 4, READ);
+  instructionTable[0x34] = op("NOP", &CPU::NOP, ZERO_PAGE_X, 4, READ);
+  instructionTable[0x54] = op("NOP", &CPU::NOP, ZERO_PAGE_X, 4, READ);
+  instructionTable[0x74] = op("NOP", &CPU::NOP, ZERO_PAGE_X, 4, READ);
+  instructionTable[0xD4] = op("NOP", &CPU::NOP, ZERO_PAGE_X, 4, READ);
+  instructionTable[0xF4] = op("NOP", &CPU::NOP, ZERO_PAGE_X, 4, READ);
+  instructionTable[0x1A] = op("NOP", &CPU::NOP, IMPLICIT, 2, NONE);
+  instructionTable[0x3A] = op("NOP", &CPU::NOP, IMPLICIT, 2, NONE);
+  instructionTable[0x5A] = op("NOP", &CPU::NOP, IMPLICIT, 2, NONE);
+  instructionTable[0x7A] = op("NOP", &CPU::NOP, IMPLICIT, 2, NONE);
+  instructionTable[0xDA] = op("NOP", &CPU::NOP, IMPLICIT, 2, NONE);
+  instructionTable[0xFA] = op("NOP", &CPU::NOP, IMPLICIT, 2, NONE);
+  instructionTable[0x80] = op("NOP", &CPU::NOP, IMMEDIATE, 2, READ);
+  instructionTable[0x1C] = op("NOP", &CPU::NOP, ABSOLUTE_X, 4, READ);
+  instructionTable[0x3C] = op("NOP", &CPU::NOP, ABSOLUTE_X, 4, READ);
+  instructionTable[0x5C] = op("NOP", &CPU::NOP, ABSOLUTE_X, 4, READ);
+  instructionTable[0x7C] = op("NOP", &CPU::NOP, ABSOLUTE_X, 4, READ);
+  instructionTable[0xDC] = op("NOP", &CPU::NOP, ABSOLUTE_X, 4, READ);
+  instructionTable[0xFC] = op("NOP", &CPU::NOP, ABSOLUTE_X, 4, READ);
+  instructionTable[0x82] = op("NOP", &CPU::NOP, IMMEDIATE, 2, READ);
+  instructionTable[0x89] = op("NOP", &CPU::NOP, IMMEDIATE, 2, READ);
+  instructionTable[0xC2] = op("NOP", &CPU::NOP, IMMEDIATE, 2, READ);
+  instructionTable[0xE2] = op("NOP", &CPU::NOP, IMMEDIATE, 2, READ);
+
+  // Unstable opcodes, not implemented
+  instructionTable[0x8B] = op("XAA", &CPU::Invalid, IMMEDIATE, 2, NONE);
+  instructionTable[0xAB] = op("LXA", &CPU::Invalid, IMMEDIATE, 2, NONE);
+  instructionTable[0x93] = op("AHX", &CPU::Invalid, INDIRECT_Y, 6, NONE);
+  instructionTable[0x9F] = op("AHX", &CPU::Invalid, ABSOLUTE_Y, 5, NONE);
+  instructionTable[0x9B] = op("TAS", &CPU::Invalid, ABSOLUTE_Y, 5, NONE);
+  instructionTable[0x9C] = op("SHY", &CPU::Invalid, ABSOLUTE_X, 5, NONE);
+  instructionTable[0x9E] = op("SHX", &CPU::Invalid, ABSOLUTE_Y, 5, NONE);
+  instructionTable[0xBB] = op("LAS", &CPU::Invalid, ABSOLUTE_Y, 4, NONE);
+
+  // KIL, locks up the CPU on hardware
+  instructionTable[0x02] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  instructionTable[0x12] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  instructionTable[0x22] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  instructionTable[0x32] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  instructionTable[0x42] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  instructionTable[0x52] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  instructionTable[0x62] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  instructionTable[0x72] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  instructionTable[0x92] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  instructionTable[0xB2] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  instructionTable[0xD2] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  instructionTable[0xF2] = op("KIL", &CPU::Invalid, IMPLICIT, 2, NONE);
+  return instructionTable;
   }
 
   // --------------------------------------  Instructions
   // BRIAN INSTRUCTIONS BEGIN ------------------------------------- //
   // Helper function to update Z and N flags
   void updateZeroNegativeFlags(uint8_t value) {
-    setFlag(FLAGS::Z, value == 0);
-    setFlag(FLAGS::N, value & 0x80);
+    P = (P & ~(Z | N)) | ZN_FLAGS[value];
+  }
+
+  // Helper function to update C, Z and N flags after a shift, compare or similar
+  void updateCarryZeroNegativeFlags(bool carry, uint8_t value) {
+    P = (P & ~(C | Z | N)) | (carry ? C : 0) | ZN_FLAGS[value];
+  }
+
+  // A + value + C, setting C, V, Z and N. SBC adds the value's complement.
+  void addWithCarry(uint8_t value) {
+    uint16_t result = A + value + (P & C);
+    uint8_t trunc_result = result & 0xFF;
+    // V is set if both inputs have the same sign and the result doesn't
+    uint8_t overflow = (trunc_result ^ A) & (trunc_result ^ value) & 0x80;
+    P = (P & ~(C | V | Z | N)) | (result >> 8) | (overflow >> 1) | ZN_FLAGS[trunc_result];
+    A = trunc_result;
+  }
+
+  // Compare a register to a value, setting C, Z and N
+  void compare(uint8_t reg, uint8_t value) {
+    updateCarryZeroNegativeFlags(reg >= value, reg - value);
   }
 
   // Access Instructions
@@ -582,77 +733,40 @@ public:
 
   // Add carry flag and value to A
   int ADC(uint16_t address) {
-    uint8_t value = readMemory(address);
-    uint16_t result = A + value + getFlag(CPU::FLAGS::C);
-
-    // Set C flag if overflow
-    setFlag(CPU::FLAGS::C, result > 0xFF);
-
-
-
-    // Set V flag if signed overflow
-    uint8_t trunc_result = result & 0xFF;
-    if ((trunc_result ^ A) & (trunc_result ^ value) & 0x80) {
-      setFlag(CPU::FLAGS::V, true);
-    } else {
-      setFlag(CPU::FLAGS::V, false);
-    }
-
-    // Set Z flag if zero
-    setFlag(CPU::FLAGS::Z, trunc_result == 0);
-
-    // Set N flag if negative
-    setFlag(CPU::FLAGS::N, trunc_result & 0x80);
-
-    // Update A
-    A = trunc_result;
+    addWithCarry(readMemory(address));
     return 0;
   }
 
   // Subtract value from A with carry flag
   int SBC(uint16_t address) {
-    uint8_t value = readMemory(address);
-
-    uint16_t result = value ^ 0x00FF;
-
-    uint16_t temp_value = (uint16_t)A + result + (uint16_t)getFlag(C);
-
-    setFlag(C, temp_value & 0xFF00);
-    setFlag(Z, ((temp_value & 0x00FF) == 0));
-    setFlag(V, (temp_value ^ (uint16_t)A) & (temp_value ^ result) & 0x0080);
-    setFlag(N, temp_value & 0x0080);
-    A = temp_value & 0x00FF;
-
+    // A - value - (1 - C) is A + ~value + C
+    addWithCarry(readMemory(address) ^ 0xFF);
     return 0;
   }
 
   int BIT(uint16_t address) {
     uint8_t value = readMemory(address);
     uint8_t result = A & value;
-    setFlag(Z, result == 0);
-    setFlag(N, value & (1 << 7));
-    setFlag(V, value & (1 << 6));
+    // N and V are copied from the value
+    P = (P & ~(Z | V | N)) | (value & (N | V)) | (result == 0 ? Z : 0);
     return 0;
   }
 
   int AND(uint16_t address) {
     A = A & readMemory(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
+    updateZeroNegativeFlags(A);
     return 0;
   }
 
   int ORA(uint16_t address) {
     A = A | readMemory(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
+    updateZeroNegativeFlags(A);
     return 0;
   }
 
   int EOR(uint16_t address) {
     A = A ^ readMemory(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
+    updateZeroNegativeFlags(A);
     return 0;
   }
 
@@ -662,8 +776,7 @@ public:
     }
 
     Y++;
-    setFlag(Z, Y == 0x00);
-    setFlag(N, Y & (1 << 7));
+    updateZeroNegativeFlags(Y);
     return 0;
   }
 
@@ -673,8 +786,7 @@ public:
     }
 
     X++;
-    setFlag(Z, X == 0x00);
-    setFlag(N, X & (1 << 7));
+    updateZeroNegativeFlags(X);
     return 0;
   }
 
@@ -684,8 +796,7 @@ public:
     }
 
     Y--;
-    setFlag(Z, Y == 0x00);
-    setFlag(N, Y & (1 << 7));
+    updateZeroNegativeFlags(Y);
     return 0;
   }
 
@@ -695,8 +806,7 @@ public:
     }
 
     X--;
-    setFlag(Z, X == 0x00);
-    setFlag(N, X & (1 << 7));
+    updateZeroNegativeFlags(X);
     return 0;
   }
 
@@ -704,20 +814,16 @@ public:
     uint8_t value = readMemory(address);
     value ++;
     writeMemory(address, value);
-    setFlag(Z, value == 0x00);
-    setFlag(N, value & (1 << 7));
-    // Requires 2 additional cycles
-    return 2;
+    updateZeroNegativeFlags(value);
+    return 0;
   }
 
   int DEC(uint16_t address) {
     uint8_t value = readMemory(address);
     value --;
     writeMemory(address, value);
-    setFlag(Z, value == 0x00);
-    setFlag(N, value & (1 << 7));
-    // Requires 2 additional cycles
-    return 2;
+    updateZeroNegativeFlags(value);
+    return 0;
   }
 
   // Ethan's instructions
@@ -727,9 +833,7 @@ public:
   // Jump to address
   int JMP(uint16_t address) {
     PC = address;
-    // Absolute is 1 cycle faster
-    // Indirect unchanged
-    return -1;
+    return 0;
   }
 
   // Jump to subroutine
@@ -737,8 +841,7 @@ public:
     PC--;
     stack_push16(PC);
     PC = address;
-    // Requires 2 additional cycles
-    return 2;
+    return 0;
   }
 
   // Return from subroutine
@@ -753,8 +856,7 @@ public:
     PC = (hi << 8) | lo;
     PC ++;
 
-    // Also requires 4 additional cycles
-    return 4;
+    return 0;
   }
 
   // Break(software IRQ)
@@ -778,8 +880,7 @@ public:
     uint16_t hi = readMemory(read_address + 1);
     PC = (hi << 8) | lo;
 
-    // Takes 7 cycles for some reason
-    return 5;
+    return 0;
   }
 
   // Return from Interrupt
@@ -799,8 +900,7 @@ public:
     uint8_t hi = stack_pop();
     PC = (hi << 8) | lo;
 
-    // Requirse a MASSIVE 4 additional cycles
-    return 4;
+    return 0;
   }
 
     // Stack instructions
@@ -812,8 +912,7 @@ public:
     }
 
     stack_push(A);
-    // For some reason requires 1 additional cycle
-    return 1;
+    return 0;
   }
 
   // Pop stack into A register
@@ -823,10 +922,8 @@ public:
     }
 
     A = stack_pop();
-    setFlag(Z, A == 0);
-    setFlag(N, A & (1 << 7));
-    // For some reason requires 2 additional cycles
-    return 2;
+    updateZeroNegativeFlags(A);
+    return 0;
   }
 
   // Push status flags to stack
@@ -839,8 +936,7 @@ public:
     setFlag(U, true);
     stack_push(P);
     setFlag(B, false);
-    // Also requires 1 additional cycle
-    return 1;
+    return 0;
   }
 
   // Pop status flags
@@ -852,8 +948,7 @@ public:
     P = stack_pop();
     setFlag(U, true);
     setFlag(B, false);
-    // Also requires 2 additional cycles
-    return 2;
+    return 0;
   }
 
     // Flag instructions
@@ -957,6 +1052,7 @@ public:
 	int BMI(uint16_t address) {
     int res = 0;
 		if (getFlag(N)) {
+      res++;
 			int8_t value = address;
 
       // Add another cycle if page crossed
@@ -1055,14 +1151,9 @@ public:
     } else {
       value = readMemory(address);
     }
-    // MSB = Most Significant Bit
-    int value_msb = (value >> 7) & 1;
     uint8_t shifted_value = value << 1;
-    int shifted_value_msb = (shifted_value >> 7) & 1;
-    // C, N, Z flags are affected
-    setFlag(C, value_msb);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
+    // C, N, Z flags are affected, C gets the MSB (Most Significant Bit)
+    updateCarryZeroNegativeFlags(value & 0x80, shifted_value);
     if (address == 0xFFFF) {
       A = shifted_value;
     } else {
@@ -1070,8 +1161,7 @@ public:
       writeMemory(address, shifted_value);
     }
 
-    // 2 additional cycles
-    return 2;
+    return 0;
   }
 
   // Logical Shift Right
@@ -1082,21 +1172,16 @@ public:
     } else {
       value = readMemory(address); 
     }
-    // LSB = Least Significant Bit
-    int value_lsb = value & 1;
     uint8_t shifted_value = value >> 1;
-    int shifted_value_msb = (shifted_value >> 7) & 1;
-    setFlag(C, value_lsb);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
+    // C gets the LSB (Least Significant Bit)
+    updateCarryZeroNegativeFlags(value & 0x01, shifted_value);
     if (address == 0xFFFF) {
       A = shifted_value;
     } else {
       writeMemory(address, value);
       writeMemory(address, shifted_value);
     }
-    // Requires 2 additional cycles for all modes but absolute
-    return 2;
+    return 0;
   }
 
   // Rotate Left
@@ -1107,24 +1192,16 @@ public:
     } else {
       value = readMemory(address);
     }
-    int value_msb = (value >> 7) & 1;
-    uint8_t shifted_value = value << 1;
-    int shifted_value_msb = (shifted_value >> 7) & 1;
     // The value held in the Carry flag is shifted into the LSB of the new value
-    if (getFlag(C) == 1) {
-      shifted_value |= 1;
-    }
-    setFlag(C, value_msb);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
+    uint8_t shifted_value = (value << 1) | (P & C);
+    updateCarryZeroNegativeFlags(value & 0x80, shifted_value);
     if (address == 0xFFFF) {
       A = shifted_value;
     } else {
       writeMemory(address, value);
       writeMemory(address, shifted_value);
     }
-    // Requires 2 additional cycles for all modes but absolute
-    return 2;
+    return 0;
   }
 
   // Rotate Right
@@ -1135,59 +1212,35 @@ public:
     } else {
       value = readMemory(address);
     }
-    int value_lsb = value & 1;
-    uint8_t shifted_value = value >> 1;
-
     // The value held in the Carry flag is shifted into the MSB of the new value
-    if (getFlag(C) == 1) {
-      shifted_value |= 0x80;
-    }
-    int shifted_value_msb = (shifted_value & 0x80);
-    setFlag(C, value_lsb);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
+    uint8_t shifted_value = (value >> 1) | ((P & C) << 7);
+    updateCarryZeroNegativeFlags(value & 0x01, shifted_value);
     if (address == 0xFFFF) {
       A = shifted_value;
     } else {
       writeMemory(address, value);
       writeMemory(address, shifted_value);
     }
-    // Also requires 2 additional cycles for all modes but absolute
-    return 2;
+    return 0;
   }
 
   // Compare Instructions
 
   // Compare to Accumulator
   int CMP(uint16_t address) {
-    uint8_t value = readMemory(address);
-    uint8_t result = A - value;
-    int result_msb = (result >> 7) & 1;
-    setFlag(C, A >= value);
-    setFlag(N, result_msb);
-    setFlag(Z, A == value);
+    compare(A, readMemory(address));
     return 0;
   }
 
   // Compare to X Register
   int CPX(uint16_t address) {
-    uint8_t value = readMemory(address);
-    uint8_t result = X - value;
-    int result_msb = (result >> 7) & 1;
-    setFlag(C, X >= value);
-    setFlag(N, result_msb);
-    setFlag(Z, X == value);
+    compare(X, readMemory(address));
     return 0;
   }
 
   // Compare to Y Register
   int CPY(uint16_t address) {
-    uint8_t value = readMemory(address);
-    uint8_t result = Y - value;
-    int result_msb = (result >> 7) & 1;
-    setFlag(C, Y >= value);
-    setFlag(N, result_msb);
-    setFlag(Z, Y == value);
+    compare(Y, readMemory(address));
     return 0;
   }
 
@@ -1197,6 +1250,11 @@ public:
     return 0;
   }
 
+  // Opcodes that aren't implemented, run as a NOP
+  int Invalid(uint16_t) {
+    return 0;
+  }
+
   // Flag Instructions
 
   // Clear Decimal Flag
@@ -1289,28 +1347,18 @@ public:
   // AND then setting NZC flags
   int ANC(uint16_t address) {
     A = A & readMemory(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
-    setFlag(C, A & (1 << 7));
+    updateCarryZeroNegativeFlags(A & 0x80, A);
     return 0;
   }
 
   // AND then LSR A
   int ALR(uint16_t address) {
     // AND - Immediate
-    A = A & readMemory(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
+    uint8_t value = A & readMemory(address);
 
     // LSR - Accumulator
-    uint8_t value = A;
-
-    int value_lsb = value & 1;
     uint8_t shifted_value = value >> 1;
-    int shifted_value_msb = (shifted_value >> 7) & 1;
-    setFlag(C, value_lsb);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
+    updateCarryZeroNegativeFlags(value & 0x01, shifted_value);
 
     A = shifted_value;
     return 0;
@@ -1319,26 +1367,16 @@ public:
   // AND then ROR A (CV flags set differently)
   int ARR(uint16_t address) {
     // AND - Immediate
-    A = A & readMemory(address);
-    setFlag(Z, A == 0x00);
-    setFlag(N, A & (1 << 7));
+    uint8_t value = A & readMemory(address);
 
     // ROR - Accumulator
-    uint8_t value = A;
-
-    uint8_t shifted_value = value >> 1;
     // The value held in the Carry flag is shifted into the MSB of the new value
-    if (getFlag(C) == 1) {
-      shifted_value |= 0x80;
-    }
-    int shifted_value_msb = (shifted_value >> 7) & 1;
+    uint8_t shifted_value = (value >> 1) | ((P & C) << 7);
     int bit_five = (shifted_value >> 5) & 1;
     int bit_six = (shifted_value >> 6) & 1;
 
-    setFlag(C, bit_six);
-    setFlag(N, shifted_value_msb);
-    setFlag(Z, shifted_value == 0);
-    setFlag(V, bit_six^bit_five);
+    updateCarryZeroNegativeFlags(bit_six, shifted_value);
+    setFlag(V, bit_six ^ bit_five);
 
     A = shifted_value;
     return 0;
@@ -1349,122 +1387,74 @@ public:
     uint8_t value = readMemory(address);
     X = (A & X) - value;
 
-    setFlag(C, 0);
-    setFlag(N, (X >> 7) & 1);
-    setFlag(Z, X == 0);
+    updateCarryZeroNegativeFlags(false, X);
     return 0;
   }
 
   // --------------------------------------  Addressing Modes
+  // Cycles come from the opcode's table entry, the modes only report whether indexing crossed a page
+
+  // Each mode reads its operand bytes after the opcode, then resolveOperand() works out the
+  // address from them, so an instruction decoded ahead of time resolves the same way
+
   // Address is implied, returning 0xFFFF as indicator
   AddressResult Implicit() {
-    uint16_t address = 0xFFFF;
-    int cycles = 2;
-    // Set to true to allow for special cases
-    bool additionalCycles = true;
-
-    return {address, cycles, additionalCycles};
+    return resolveOperand<IMPLICIT>(0);
   }
 
   // Address is directly at the next PC
   AddressResult Immediate() {
-    uint16_t address = PC++;
-    int cycles = 2;
-    bool additionalCycles = false;
-
-    return {address, cycles, additionalCycles};
+    return resolveOperand<IMMEDIATE>(PC++);
   }
 
   // Address is the accumulator, returning 0xFFFF as indicator
   // Logic to be handled in instruction
   AddressResult Accumulator() {
-    uint16_t address = 0xFFFF;
-    int cycles = 2;
-    bool additionalCycles = false;
-
-    return {address, cycles, additionalCycles};
+    return resolveOperand<ACCUMULATOR>(0);
   }
 
   // Return next PC += offset, stored in PC
   AddressResult Relative() {
     // Offset is unsigned, at the memory location stored in PC
-    int8_t offset = static_cast<int8_t>(readMemory(PC));
+    uint8_t offset = readMemory(PC);
     PC++;
-    // Return a uint16_t as forced, which will be converted back into
-    // an int8_t in the branch instructions
-    uint16_t addr = offset & 0xFF;
-    int cycles = 2;
-    // Branch instructions will modify cycles based on 
-    // branch taken and page crossing
-    bool additionalCycles = true;
-
-    return {addr, cycles, additionalCycles};
+    return resolveOperand<RELATIVE>(offset);
   }
 
   // Return address from zero page memory
   AddressResult ZeroPage() {
-    uint16_t address = readMemory(PC++);
-    int cycles = 3;
-    bool additionalCycles = true;
-
-    return {address, cycles, additionalCycles};
+    return resolveOperand<ZERO_PAGE>(readMemory(PC++));
   }
 
   // Reuturn address + X from zero page memory, wrapped
   AddressResult ZeroPageX() {
-    uint16_t address = readMemory(PC++) + X & 0xFF;
-    int cycles = 4;
-    bool additionalCycles = true;
-
-    return {address, cycles, additionalCycles};
+    return resolveOperand<ZERO_PAGE_X>(readMemory(PC++));
   }
 
   // Reuturn address + Y from zero page memory, wrapped
   AddressResult ZeroPageY() {
-    uint16_t address = readMemory(PC++) + Y & 0xFF;
-    int cycles = 4;
-    bool additionalCycles = true;
-
-    return {address, cycles, additionalCycles};
+    return resolveOperand<ZERO_PAGE_Y>(readMemory(PC++));
   }
 
   // Return a full 16 bit address from the next two PC
   AddressResult Absolute() {
     uint16_t addr = readMemory(PC) | readMemory(PC + 1) << 8;
     PC += 2;
-    int cycles = 4;
-    bool additionalCycles = true;
-
-    return {addr, cycles, additionalCycles};
+    return resolveOperand<ABSOLUTE>(addr);
   }
 
   // Return a full 16 bit address from the next two PC + X
   AddressResult AbsoluteX() {
-    uint16_t addr = readMemory(PC) | readMemory(PC + 1) << 8;
-    addr += X;
-    int cycles = 4;
-    // additionalCycles dependent on page boundary crossed
-    if ((addr & 0xFF00) != (readMemory(PC + 1) << 8)) {
-      cycles++;
-    }
-    bool additionalCycles = true;
+    uint16_t base = readMemory(PC) | readMemory(PC + 1) << 8;
     PC += 2;
-
-    return {addr, cycles, additionalCycles};
+    return resolveOperand<ABSOLUTE_X>(base);
   }
 
   // Return a full 16 bit address from the next two PC + Y
   AddressResult AbsoluteY() {
-    uint16_t addr = readMemory(PC) | readMemory(PC + 1) << 8;
-    addr += Y;
-    int cycles = 4;
-    if ((addr & 0xFF00) != (readMemory(PC + 1) << 8)) {
-      cycles++;
-    }
-    bool additionalCycles = true;
+    uint16_t base = readMemory(PC) | readMemory(PC + 1) << 8;
     PC += 2;
-
-    return {addr, cycles, additionalCycles};
+    return resolveOperand<ABSOLUTE_Y>(base);
   }
 
   // Return an address using the operand as a pointer
@@ -1474,51 +1464,18 @@ public:
     // Find address referenced by pointer
     uint16_t addr = readMemory(pointer) | readMemory((pointer + 1) & 0xFFFF) << 8;
     PC += 2;
-    int cycles = 5;
-    bool additionalCycles = false;
 
-    return {addr, cycles, additionalCycles};
+    return {addr, false};
   }
 
   // Return a full 16 bit address from a pointer in the zero page + X
   AddressResult IndirectX() {
-    uint16_t ptrAddr = (readMemory(PC++) + X) & 0xFF;
-    uint16_t lo = readMemory((uint16_t)(ptrAddr) & 0xFFFF);
-    uint16_t hi;
-    if (ptrAddr == 0xFF) {
-      hi = (readMemory(0x0000) & 0xFF) << 8;
-    }
-    else {
-      hi = (readMemory(ptrAddr + 1) & 0xFF) << 8;
-    }
-
-    uint16_t addr = lo | hi;
-    int cycles = 6;
-    bool additionalCycles = false;
-
-    return {addr, cycles, additionalCycles};
+    return resolveOperand<INDIRECT_X>(readMemory(PC++));
   }
 
   // Return a full 16 bit address from a pointer in the zero page + Y
   AddressResult IndirectY() {
-    uint16_t ptrAddr = readMemory(PC++);
-    uint16_t lo = readMemory(ptrAddr);
-    uint16_t hi;
-    if (ptrAddr == 0xFF) {
-      hi = (readMemory(0x0000) & 0xFF) << 8;
-    }
-    else {
-      hi = (readMemory(ptrAddr + 1) & 0xFF) << 8;
-    }
-    uint16_t addr = lo | hi;
-    addr += Y;
-    int cycles = 5;
-    // Add 1 cycle if page crossed
-    if ((addr & 0xFF00) != ((readMemory(ptrAddr + 1) & 0xFF) << 8)) {
-      cycles++;
-    }
-    bool additionalCycles = true;
-    return {addr, cycles, additionalCycles};
+    return resolveOperand<INDIRECT_Y>(readMemory(PC++));
   }
 
   // Special Indirect mode for JMP
@@ -1527,28 +1484,51 @@ public:
     PC ++;
     uint16_t hi = readMemory(PC);
     PC ++;
-
-    uint16_t addr = (hi << 8) | lo;
-
-    if (lo == 0x00FF) {
-        hi = readMemory(addr & 0xFF00);
-    }
-    else {
-        hi = readMemory(addr + 1);
+    return resolveOperand<INDIRECT_JMP>((hi << 8) | lo);
+  }
+
+  // Address an instruction uses given the operand bytes after its opcode. Immediate operands
+  // are the address of the byte, relative ones the branch offset.
+  template <MODES Mode>
+  AddressResult resolveOperand(uint16_t operand) {
+    if constexpr (Mode == IMPLICIT || Mode == ACCUMULATOR) {
+      return {0xFFFF, false};
+    } else if constexpr (Mode == IMMEDIATE || Mode == ZERO_PAGE || Mode == ABSOLUTE) {
+      return {operand, false};
+    } else if constexpr (Mode == RELATIVE) {
+      // Return a uint16_t as forced, which will be converted back into
+      // an int8_t in the branch instructions. Branch instructions add
+      // their own cycles for being taken and crossing a page
+      return {static_cast<uint16_t>(operand & 0xFF), false};
+    } else if constexpr (Mode == ZERO_PAGE_X) {
+      return {static_cast<uint16_t>((operand + X) & 0xFF), false};
+    } else if constexpr (Mode == ZERO_PAGE_Y) {
+      return {static_cast<uint16_t>((operand + Y) & 0xFF), false};
+    } else if constexpr (Mode == ABSOLUTE_X || Mode == ABSOLUTE_Y) {
+      uint16_t addr = operand + (Mode == ABSOLUTE_X ? X : Y);
+      return {addr, (addr & 0xFF00) != (operand & 0xFF00)};
+    } else if constexpr (Mode == INDIRECT_X) {
+      // The pointer wraps around the zero page
+      uint16_t ptrAddr = (operand + X) & 0xFF;
+      uint16_t lo = readMemory(ptrAddr);
+      uint16_t hi = readMemory((ptrAddr + 1) & 0xFF) << 8;
+      return {static_cast<uint16_t>(lo | hi), false};
+    } else if constexpr (Mode == INDIRECT_Y) {
+      uint16_t ptrAddr = operand & 0xFF;
+      uint16_t lo = readMemory(ptrAddr);
+      uint16_t hi = readMemory((ptrAddr + 1) & 0xFF) << 8;
+      uint16_t addr = (lo | hi) + Y;
+      return {addr, (addr & 0xFF00) != hi};
+    } else {
+      // The pointer's high byte comes from the same page, the 6502 doesn't carry into it
+      uint16_t hi = readMemory((operand & 0xFF00) | ((operand + 1) & 0x00FF));
+      uint16_t lo = readMemory(operand);
+      return {static_cast<uint16_t>((hi << 8) | lo), false};
     }
-    lo = readMemory(addr);
-
-    addr = (hi << 8) | lo;
-    int cycles = 5;
-    bool additionalCycles = false;
-
-    return {addr, cycles, additionalCycles};
   }
 
   // Constructor
-  CPU() {
-    initInstructionTable();
-  }
+  CPU() = default;
 
 	// Push to the stack (8 bits)
   void stack_push(uint8_t value) {
@@ -1604,10 +1584,171 @@ public:
     uint16_t lo = readMemory(read_address);
     uint16_t hi = readMemory(read_address + 1);
     PC = (hi << 8) | lo;
+    cycles += 7;
     }
   }
 
   private:
   Bus *bus = nullptr;
 };
+
+// Descriptor of every opcode, driving dispatch, cycle counts and the disassembler
+constexpr std::array<CPU::Instruction, 256> CPU_INSTRUCTIONS = CPU::buildInstructionTable();
+
+// Every opcode has an entry that can be run
+constexpr bool instructionTableComplete() {
+  for (const CPU::Instruction& instr : CPU_INSTRUCTIONS) {
+    if (instr.mnemonic == nullptr || instr.operation == nullptr || instr.addressingMode == nullptr ||
+        instr.cycles == 0 || instr.length == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(instructionTableComplete(), "CPU_INSTRUCTIONS is missing an opcode");
+
+template <uint8_t Opcode>
+inline int CPU::runFused() {
+  constexpr Instruction instr = CPU_INSTRUCTIONS[Opcode];
+  AddressResult res = (this->*instr.addressingMode)();
+  int branchCycles = (this->*instr.operation)(res.address);
+  return instr.cycles + (res.pageCrossed ? instr.pageCross : 0) + branchCycles;
+}
+
+template <uint8_t Opcode>
+inline int CPU::runDecodedOpcode(CPU& cpu, const DecodedInstruction& decoded) {
+  constexpr Instruction instr = CPU_INSTRUCTIONS[Opcode];
+  // Leave PC where fetching the operand would have
+  cpu.PC = decoded.next;
+  AddressResult res = cpu.resolveOperand<instr.mode>(decoded.operand);
+  int branchCycles = (cpu.*instr.operation)(res.address);
+  return instr.cycles + (res.pageCrossed ? instr.pageCross : 0) + branchCycles;
+}
+
+template <size_t... Opcodes>
+constexpr std::array<int (*)(CPU&, const CPU::DecodedInstruction&), 256> buildDecodedHandlers(std::index_sequence<Opcodes...>) {
+  return {&CPU::runDecodedOpcode<Opcodes>...};
+}
+
+// runDecodedOpcode for every opcode
+constexpr std::array<int (*)(CPU&, const CPU::DecodedInstruction&), 256> CPU_DECODED_HANDLERS =
+    buildDecodedHandlers(std::make_index_sequence<256>());
+
+inline CPU::DecodedInstruction CPU::decode(uint16_t address) {
+  uint8_t opcode = readMemory(address);
+  const Instruction& instr = CPU_INSTRUCTIONS[opcode];
+  uint16_t operand = 0;
+  if (instr.mode == IMMEDIATE) {
+    operand = address + 1;
+  } else if (instr.length > 1) {
+    operand = readMemory(address + 1);
+    if (instr.length > 2) {
+      operand |= readMemory(address + 2) << 8;
+    }
+  }
+  return {CPU_DECODED_HANDLERS[opcode], operand, static_cast<uint16_t>(address + instr.length)};
+}
+
+inline std::string CPU::disassemble(uint16_t address) {
+  const Instruction& instr = CPU_INSTRUCTIONS[readMemory(address)];
+  uint8_t lo = instr.length > 1 ? readMemory(address + 1) : 0;
+  uint8_t hi = instr.length > 2 ? readMemory(address + 2) : 0;
+  uint16_t absolute = (hi << 8) | lo;
+
+  char operand[16] = "";
+  switch (instr.mode) {
+    case IMPLICIT: break;
+    case ACCUMULATOR: snprintf(operand, sizeof(operand), " A"); break;
+    case IMMEDIATE: snprintf(operand, sizeof(operand), " #$%02X", lo); break;
+    // Show where the branch goes rather than the offset
+    case RELATIVE: snprintf(operand, sizeof(operand), " $%04X", (address + 2 + static_cast<int8_t>(lo)) & 0xFFFF); break;
+    case ZERO_PAGE: snprintf(operand, sizeof(operand), " $%02X", lo); break;
+    case ZERO_PAGE_X: snprintf(operand, sizeof(operand), " $%02X,X", lo); break;
+    case ZERO_PAGE_Y: snprintf(operand, sizeof(operand), " $%02X,Y", lo); break;
+    case ABSOLUTE: snprintf(operand, sizeof(operand), " $%04X", absolute); break;
+    case ABSOLUTE_X: snprintf(operand, sizeof(operand), " $%04X,X", absolute); break;
+    case ABSOLUTE_Y: snprintf(operand, sizeof(operand), " $%04X,Y", absolute); break;
+    case INDIRECT_X: snprintf(operand, sizeof(operand), " ($%02X,X)", lo); break;
+    case INDIRECT_Y: snprintf(operand, sizeof(operand), " ($%02X),Y", lo); break;
+    case INDIRECT_JMP: snprintf(operand, sizeof(operand), " ($%04X)", absolute); break;
+  }
+  return std::string(instr.mnemonic) + operand;
+}
+
+#ifdef CPU_TABLE_DISPATCH
+
+// Look the opcode up in the table and call through its member function pointers
+inline int CPU::interpretInstruction() {
+  instructions++;
+  // Read the opcode
+  uint8_t opcode = readMemory(PC++);
+
+  // Get the address mode and instruction type from the opcode
+  const Instruction& opcodeInstr = CPU_INSTRUCTIONS[opcode];
+
+  // Find the address and whether indexing crossed a page
+  AddressResult res = (this->*opcodeInstr.addressingMode)();
+
+  // Execute the instruction, only branches take a variable number of cycles
+  int branchCycles = (this->*opcodeInstr.operation)(res.address);
+
+  return opcodeInstr.cycles + (res.pageCrossed ? opcodeInstr.pageCross : 0) + branchCycles;
+}
+
+#else
+
+// One case per opcode, each running its own specialization of runFused
+#define CPU_FUSED_CASE(opcode) \
+  case opcode: return runFused<opcode>();
+#define CPU_FUSED_CASES4(opcode) \
+  CPU_FUSED_CASE(opcode) CPU_FUSED_CASE(opcode + 1) CPU_FUSED_CASE(opcode + 2) CPU_FUSED_CASE(opcode + 3)
+#define CPU_FUSED_CASES16(opcode) \
+  CPU_FUSED_CASES4(opcode) CPU_FUSED_CASES4(opcode + 4) CPU_FUSED_CASES4(opcode + 8) CPU_FUSED_CASES4(opcode + 12)
+#define CPU_FUSED_CASES64(opcode) \
+  CPU_FUSED_CASES16(opcode) CPU_FUSED_CASES16(opcode + 16) CPU_FUSED_CASES16(opcode + 32) CPU_FUSED_CASES16(opcode + 48)
+
+inline int CPU::interpretInstruction() {
+  instructions++;
+  uint8_t opcode = readMemory(PC++);
+  switch (opcode) {
+    CPU_FUSED_CASES64(0x00)
+    CPU_FUSED_CASES64(0x40)
+    CPU_FUSED_CASES64(0x80)
+    CPU_FUSED_CASES64(0xC0)
+  }
+  return 0;
+}
+
+#undef CPU_FUSED_CASE
+#undef CPU_FUSED_CASES4
+#undef CPU_FUSED_CASES16
+#undef CPU_FUSED_CASES64
+
+#endif // CPU_TABLE_DISPATCH
+
+#ifdef CPU_DECODE_CACHE
+
+inline int CPU::runInstruction() {
+  const uint8_t* source = bus->prgROMByte(PC);
+  // Operand bytes in the next 8KB window can come from a different bank than the opcode
+  if (source == nullptr || (PC & 0x1FFF) >= 0x1FFE) {
+    return interpretInstruction();
+  }
+  CachedInstruction& cached = decodeCache[PC & (DECODE_CACHE_SIZE - 1)];
+  if (cached.source != source || cached.pc != PC) {
+    cached.source = source;
+    cached.pc = PC;
+    cached.decoded = decode(PC);
+  }
+  return runDecoded(cached.decoded);
+}
+
+#else
+
+inline int CPU::runInstruction() {
+  return interpretInstruction();
+}
+
+#endif // CPU_DECODE_CACHE
+
 #endif
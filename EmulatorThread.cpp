@@ -0,0 +1,208 @@
+#include "EmulatorThread.h"
+
+#include <iostream>
+
+void EmulatorThread::Timing::record(double workSeconds, double wallSeconds) {
+    // Weight of the newest frame in the moving averages
+    const double weight = 1.0 / 32.0;
+
+    frames++;
+    lastFrameMs = workSeconds * 1000.0;
+    averageFrameMs += (lastFrameMs - averageFrameMs) * weight;
+    if (wallSeconds > 0.0) {
+        busy += (workSeconds / wallSeconds - busy) * weight;
+    }
+}
+
+EmulatorThread::EmulatorThread(NES& nes) : nes(nes) {}
+
+EmulatorThread::~EmulatorThread() {
+    stop();
+}
+
+void EmulatorThread::start() {
+    if (thread.joinable()) {
+        return;
+    }
+    quit = false;
+    thread = std::thread(&EmulatorThread::loop, this);
+}
+
+void EmulatorThread::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    quit = true;
+    commandReady.notify_one();
+    thread.join();
+}
+
+void EmulatorThread::send(const Command& command) {
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        commands.push_back(command);
+    }
+    commandReady.notify_one();
+}
+
+void EmulatorThread::setController(uint8_t buttons) {
+    send({SET_CONTROLLER, buttons, ""});
+}
+
+void EmulatorThread::pause() {
+    send({PAUSE, 0x00, ""});
+}
+
+void EmulatorThread::resume() {
+    send({RESUME, 0x00, ""});
+}
+
+void EmulatorThread::step() {
+    send({STEP, 0x00, ""});
+}
+
+void EmulatorThread::loadROM(const std::string& path) {
+    send({LOAD_ROM, 0x00, path});
+}
+
+void EmulatorThread::setRewinding(bool rewinding) {
+    send({REWIND, static_cast<uint8_t>(rewinding), ""});
+}
+
+void EmulatorThread::setRunAhead(int frames) {
+    send({SET_RUN_AHEAD, static_cast<uint8_t>(frames), ""});
+}
+
+void EmulatorThread::recordMovie(const std::string& path) {
+    send({RECORD_MOVIE, 0x00, path});
+}
+
+void EmulatorThread::stopMovie() {
+    send({STOP_MOVIE, 0x00, ""});
+}
+
+EmulatorThread::Snapshot EmulatorThread::snapshot() {
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    return latest;
+}
+
+void EmulatorThread::loop() {
+    while (!quit) {
+        std::deque<Command> pending;
+        {
+            std::unique_lock<std::mutex> lock(commandMutex);
+            // Nothing to emulate, sleep until the UI asks for something
+            if (commands.empty() && !(nes.on && nes.rom_loaded && !nes.paused)) {
+                commandReady.wait(lock, [this]() { return quit || !commands.empty(); });
+            }
+            pending.swap(commands);
+        }
+
+        for (const Command& command : pending) {
+            execute(command);
+        }
+        if (!pending.empty()) {
+            publishSnapshot();
+        }
+
+        if (!quit && nes.on && nes.rom_loaded && !nes.paused) {
+            emulateFrame(true);
+        }
+    }
+}
+
+void EmulatorThread::execute(const Command& command) {
+    switch (command.type) {
+        case SET_CONTROLLER:
+            nes.bus.controller1.reg = command.buttons;
+            break;
+        case PAUSE:
+            nes.paused = true;
+            break;
+        case RESUME:
+            nes.paused = false;
+            nes.pacer.reset();
+            break;
+        case STEP:
+            if (nes.paused && nes.on && nes.rom_loaded) {
+                emulateFrame(false);
+            }
+            break;
+        case LOAD_ROM:
+            finishMovie();
+            nes.on = false;
+            nes.load_rom(command.path.c_str());
+            nes.initNES();
+            break;
+        case REWIND:
+            rewinding = command.buttons != 0;
+            if (rewinding) {
+                finishMovie();
+            }
+            break;
+        case SET_RUN_AHEAD:
+            nes.runAhead = command.buttons;
+            break;
+        case RECORD_MOVIE:
+            finishMovie();
+            if (nes.on && movie.start(nes)) {
+                moviePath = command.path;
+                recording = true;
+            }
+            break;
+        case STOP_MOVIE:
+            finishMovie();
+            break;
+    }
+}
+
+void EmulatorThread::finishMovie() {
+    if (!recording) {
+        return;
+    }
+    recording = false;
+    if (!movie.save(moviePath)) {
+        std::cerr << "Failed to write movie: " << moviePath << std::endl;
+    }
+    movie.frames.clear();
+    movie.startState.clear();
+}
+
+void EmulatorThread::emulateFrame(bool paced) {
+    auto start = std::chrono::steady_clock::now();
+    // Once rewind runs out the picture stays on the oldest frame
+    if (rewinding) {
+        nes.rewindFrame();
+    } else if (recording) {
+        movie.recordFrame(nes);
+    } else {
+        nes.runFrame();
+    }
+    std::chrono::duration<double> work = std::chrono::steady_clock::now() - start;
+    if (paced) {
+        nes.pacer.wait();
+    }
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+    timing.record(work.count(), wall.count());
+    publishSnapshot();
+}
+
+void EmulatorThread::publishSnapshot() {
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    latest.A = nes.cpu.A;
+    latest.X = nes.cpu.X;
+    latest.Y = nes.cpu.Y;
+    latest.S = nes.cpu.S;
+    latest.P = nes.cpu.P;
+    latest.PC = nes.cpu.PC;
+    latest.controller = nes.bus.controller1.reg;
+    latest.running = nes.on && nes.rom_loaded && !nes.paused;
+    latest.rewinding = rewinding;
+    latest.rewindSeconds = nes.rewind.frames() / NES_FPS;
+    latest.rewindBytes = nes.rewind.bytes();
+    latest.runAhead = nes.runAhead;
+    latest.runAheadFrameMs = nes.runAheadFrameMs;
+    latest.recording = recording;
+    latest.movieFrames = movie.frames.size();
+    latest.timing = timing;
+}
@@ -0,0 +1,116 @@
+#ifndef EMULATORTHREAD_H
+#define EMULATORTHREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Movie.h"
+#include "NES.h"
+
+// Runs the NES on its own thread so the UI's render loop, vsync and debug windows can't steal
+// emulation time. The UI sends input and pause/step/load requests through a command queue and
+// picks finished frames up from the PPU's triple buffer with NES::getFramebuffer(), the one part
+// of the NES that is safe to touch from another thread while this one is running.
+class EmulatorThread {
+public:
+    enum COMMANDS {
+        SET_CONTROLLER,     // New state for controller 1, used from the next frame on
+        PAUSE,
+        RESUME,
+        STEP,               // Run a single frame while paused
+        LOAD_ROM,
+        REWIND,             // Start (buttons 1) or stop (buttons 0) running frames backwards
+        SET_RUN_AHEAD,      // Frames to run ahead, in buttons
+        RECORD_MOVIE,       // Record from here on into the movie at path
+        STOP_MOVIE,         // Stop recording and write the movie out
+    };
+
+    struct Command {
+        COMMANDS type;
+        uint8_t buttons = 0x00;
+        std::string path;
+    };
+
+    // How a thread spends its time, updated once per frame
+    struct Timing {
+        uint64_t frames = 0;
+        double lastFrameMs = 0.0;       // Time spent working on the last frame
+        double averageFrameMs = 0.0;    // Moving average of the work time
+        double busy = 0.0;              // Moving average of work time over wall time
+
+        void record(double workSeconds, double wallSeconds);
+    };
+
+    // State as of the end of the last frame, for the debug window
+    struct Snapshot {
+        uint8_t A = 0x00;
+        uint8_t X = 0x00;
+        uint8_t Y = 0x00;
+        uint8_t S = 0x00;
+        uint8_t P = 0x00;
+        uint16_t PC = 0x0000;
+        uint8_t controller = 0x00;
+        bool running = false;           // ROM loaded and not paused
+        bool rewinding = false;
+        double rewindSeconds = 0.0;     // How far back rewind can still go
+        size_t rewindBytes = 0;
+        int runAhead = 0;
+        double runAheadFrameMs = 0.0;   // Cost of each frame run ahead
+        bool recording = false;
+        size_t movieFrames = 0;         // Frames recorded so far
+        Timing timing;
+    };
+
+    explicit EmulatorThread(NES& nes);
+    ~EmulatorThread();
+
+    void start();
+    void stop();
+
+    // Queue a command, safe to call from any thread
+    void send(const Command& command);
+    void setController(uint8_t buttons);
+    void pause();
+    void resume();
+    void step();
+    void loadROM(const std::string& path);
+    void setRewinding(bool rewinding);
+    void setRunAhead(int frames);
+    // A movie is one unbroken run, so rewinding or loading a ROM stops the recording too
+    void recordMovie(const std::string& path);
+    void stopMovie();
+
+    Snapshot snapshot();
+
+private:
+    void loop();
+    void execute(const Command& command);
+    // Run one frame, waiting for the pacer afterwards unless single-stepping
+    void emulateFrame(bool paced);
+    void publishSnapshot();
+    // Write out the movie being recorded, if there is one
+    void finishMovie();
+
+    NES& nes;
+    std::thread thread;
+    std::atomic<bool> quit{false};
+
+    std::mutex commandMutex;
+    std::condition_variable commandReady;
+    std::deque<Command> commands;
+
+    std::mutex snapshotMutex;
+    Snapshot latest;
+    Timing timing;
+    bool rewinding = false;
+    Movie movie;
+    std::string moviePath;
+    bool recording = false;
+};
+
+#endif // EMULATORTHREAD_H
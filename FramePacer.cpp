@@ -0,0 +1,75 @@
+#include "FramePacer.h"
+
+#include <thread>
+
+namespace {
+    // Sleeping can overshoot by about a scheduler tick, so the last bit is spun instead
+    const auto SPIN_TAIL = std::chrono::microseconds(1500);
+    const auto AUDIO_POLL = std::chrono::milliseconds(1);
+}
+
+FramePacer::FramePacer(MODES mode, double fps)
+    : mode(mode),
+      frameTime(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps))) {}
+
+void FramePacer::setMode(MODES mode) {
+    this->mode = mode;
+    reset();
+}
+
+FramePacer::MODES FramePacer::getMode() const {
+    return mode;
+}
+
+void FramePacer::setAudioQueue(std::function<double()> queuedSeconds, double targetSeconds) {
+    audioQueued = std::move(queuedSeconds);
+    audioTarget = targetSeconds;
+}
+
+void FramePacer::wait() {
+    Clock::time_point start = Clock::now();
+
+    if (mode == UNTHROTTLED) {
+        waited = 0.0;
+        return;
+    }
+
+    if (mode == AUDIO && audioQueued) {
+        while (audioQueued() > audioTarget) {
+            std::this_thread::sleep_for(AUDIO_POLL);
+        }
+    }
+    else {
+        Clock::time_point due = schedule(start);
+        if (due - start > SPIN_TAIL) {
+            std::this_thread::sleep_until(due - SPIN_TAIL);
+        }
+        while (Clock::now() < due) {
+            std::this_thread::yield();
+        }
+    }
+
+    waited = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+FramePacer::Clock::time_point FramePacer::schedule(Clock::time_point now) {
+    if (!scheduled) {
+        deadline = now;
+        scheduled = true;
+    }
+    deadline += frameTime;
+
+    // More than a frame behind: don't try to catch up, start over from now
+    if (now > deadline + frameTime) {
+        deadline = now;
+    }
+    return deadline;
+}
+
+void FramePacer::reset() {
+    scheduled = false;
+}
+
+double FramePacer::lastWaitSeconds() const {
+    return waited;
+}
@@ -0,0 +1,54 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <chrono>
+#include <functional>
+
+// NTSC frame rate, 1.789773 MHz CPU clock / 29780.5 CPU cycles per frame
+const double NES_FPS = 60.0988;
+
+// Decides when the next frame may start. Emulating a frame is a fixed amount of work,
+// only the waiting in between depends on the host.
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum MODES {
+        SLEEP,          // Sleep until the next frame is due, spinning only for the last stretch
+        AUDIO,          // Wait while the audio output still has enough queued to play
+        UNTHROTTLED,    // Never wait, for benchmarks
+    };
+
+    explicit FramePacer(MODES mode = SLEEP, double fps = NES_FPS);
+
+    void setMode(MODES mode);
+    MODES getMode() const;
+
+    // For AUDIO pacing: returns how many seconds of audio are queued, and how much to keep queued.
+    // Without it AUDIO paces like SLEEP.
+    void setAudioQueue(std::function<double()> queuedSeconds, double targetSeconds);
+
+    // Block until the next frame is due
+    void wait();
+    // Move the schedule on a frame for one asked for at now and return when it's due, which is
+    // now or earlier when there's no need to wait. wait() without the waiting.
+    Clock::time_point schedule(Clock::time_point now);
+    // Start the schedule over from now, e.g. after a pause
+    void reset();
+
+    // Time the last wait() blocked for
+    double lastWaitSeconds() const;
+
+private:
+    MODES mode;
+    Clock::duration frameTime;
+    Clock::time_point deadline;
+    bool scheduled = false;
+
+    std::function<double()> audioQueued;
+    double audioTarget = 0.0;
+
+    double waited = 0.0;
+};
+
+#endif // FRAMEPACER_H
@@ -0,0 +1,336 @@
+#include "Mapper.h"
+
+#include <algorithm>
+
+Mapper::Mapper(NESROM& rom) : rom(rom) {
+    chrWritable = rom.chrRam;
+    mirroring = (rom.ROMheader.flags6 & 0x01) ? VERTICAL : HORIZONTAL;
+
+    // Decode every tile row once so bank switches don't have to
+    chrDecoded.resize(rom.chrSize * 4);
+    decodeCHR();
+}
+
+void Mapper::decodeCHR() {
+    for (size_t addr = 0; addr < rom.chrSize; addr++) {
+        size_t tile = addr / 16;
+        size_t row = addr % 8;
+        uint8_t low = rom.chrRom[tile * 16 + row];
+        uint8_t high = rom.chrRom[tile * 16 + row + 8];
+        for (int j = 0; j < 8; j++) {
+            chrDecoded[tile * 64 + row * 8 + j] = (((high >> (7 - j)) & 0x01) << 1) | ((low >> (7 - j)) & 0x01);
+        }
+    }
+}
+
+Mapper* Mapper::create(NESROM& rom) {
+    Mapper* mapper = nullptr;
+    switch (rom.mapper) {
+        case 0: mapper = new NROM(rom); break;
+        case 1: mapper = new MMC1(rom); break;
+        case 2: mapper = new UxROM(rom); break;
+        case 3: mapper = new CNROM(rom); break;
+        case 4: mapper = new MMC3(rom); break;
+        default:
+            std::cerr << "Unsupported mapper: " << static_cast<int>(rom.mapper) << std::endl;
+            return nullptr;
+    }
+    mapper->reset();
+    return mapper;
+}
+
+void Mapper::mapPRG(int window, int bank, int size) {
+    int banks = std::max<int>(rom.prgSize / size, 1);
+    bank = ((bank % banks) + banks) % banks;
+    // Offsets wrap so a window bigger than the ROM mirrors it
+    for (int i = 0; i < size / 0x2000; i++) {
+        prgBanks[window + i] = rom.prgRom + (bank * size + i * 0x2000) % rom.prgSize;
+    }
+}
+
+void Mapper::mapCHR(int window, int bank, int size) {
+    int banks = std::max<int>(rom.chrSize / size, 1);
+    bank %= banks;
+    for (int i = 0; i < size / 0x0400; i++) {
+        size_t offset = (bank * size + i * 0x0400) % rom.chrSize;
+        chrBanks[window + i] = rom.chrRom + offset;
+        chrDecodedBanks[window + i] = chrDecoded.data() + offset * 4;
+    }
+}
+
+void Mapper::saveState(StateWriter& state) const {
+    // Windows go in as offsets into the images, the pointers are rebuilt on load
+    for (uint8_t* bank : prgBanks) {
+        state.put(static_cast<uint32_t>(bank - rom.prgRom));
+    }
+    for (uint8_t* bank : chrBanks) {
+        state.put(static_cast<uint32_t>(bank - rom.chrRom));
+    }
+    state.put(mirroring);
+    state.put(irq);
+    if (chrWritable) {
+        state.bytes(rom.chrRom, rom.chrSize);
+    }
+}
+
+void Mapper::loadState(StateReader& state) {
+    for (uint8_t*& bank : prgBanks) {
+        uint32_t offset = 0;
+        state.get(offset);
+        bank = rom.prgRom + offset % rom.prgSize;
+    }
+    for (int i = 0; i < 8; i++) {
+        uint32_t offset = 0;
+        state.get(offset);
+        offset %= rom.chrSize;
+        chrBanks[i] = rom.chrRom + offset;
+        chrDecodedBanks[i] = chrDecoded.data() + offset * 4;
+    }
+    state.get(mirroring);
+    state.get(irq);
+    if (chrWritable) {
+        state.bytes(rom.chrRom, rom.chrSize);
+        decodeCHR();
+    }
+}
+
+// NROM ---------------------------------------------------------------------------------------------------------------
+
+void NROM::reset() {
+    // NROM-128 shows its 16KB at both 0x8000 and 0xC000
+    mapPRG(0, 0, 0x4000);
+    mapPRG(2, -1, 0x4000);
+    mapCHR(0, 0, 0x2000);
+}
+
+void NROM::write(uint16_t, uint8_t) {
+}
+
+// MMC1 ---------------------------------------------------------------------------------------------------------------
+
+void MMC1::reset() {
+    shift = 0x10;
+    control = 0x0C;
+    chrBank0 = 0x00;
+    chrBank1 = 0x00;
+    prgBank = 0x00;
+    updateBanks();
+}
+
+void MMC1::write(uint16_t address, uint8_t data) {
+    // Writing with bit 7 set clears the shift register and locks the last PRG bank at 0xC000
+    if (data & 0x80) {
+        shift = 0x10;
+        control |= 0x0C;
+        updateBanks();
+        return;
+    }
+
+    bool full = shift & 0x01;
+    shift = (shift >> 1) | ((data & 0x01) << 4);
+    if (!full) {
+        return;
+    }
+
+    // The fifth write picks the register with bits 13 and 14 of its address
+    switch ((address >> 13) & 0x03) {
+        case 0: control = shift; break;
+        case 1: chrBank0 = shift; break;
+        case 2: chrBank1 = shift; break;
+        case 3: prgBank = shift & 0x0F; break;
+    }
+    shift = 0x10;
+    updateBanks();
+}
+
+void MMC1::saveState(StateWriter& state) const {
+    Mapper::saveState(state);
+    state.put(shift);
+    state.put(control);
+    state.put(chrBank0);
+    state.put(chrBank1);
+    state.put(prgBank);
+}
+
+void MMC1::loadState(StateReader& state) {
+    Mapper::loadState(state);
+    state.get(shift);
+    state.get(control);
+    state.get(chrBank0);
+    state.get(chrBank1);
+    state.get(prgBank);
+}
+
+void MMC1::updateBanks() {
+    switch (control & 0x03) {
+        case 0: mirroring = ONE_SCREEN_LOW; break;
+        case 1: mirroring = ONE_SCREEN_HIGH; break;
+        case 2: mirroring = VERTICAL; break;
+        case 3: mirroring = HORIZONTAL; break;
+    }
+
+    switch ((control >> 2) & 0x03) {
+        // 32KB at 0x8000, ignoring the low bit of the bank number
+        case 0:
+        case 1:
+            mapPRG(0, prgBank >> 1, 0x8000);
+            break;
+        // First bank fixed at 0x8000, switch 0xC000
+        case 2:
+            mapPRG(0, 0, 0x4000);
+            mapPRG(2, prgBank, 0x4000);
+            break;
+        // Switch 0x8000, last bank fixed at 0xC000
+        case 3:
+            mapPRG(0, prgBank, 0x4000);
+            mapPRG(2, -1, 0x4000);
+            break;
+    }
+
+    // One 8KB bank or two 4KB banks
+    if (control & 0x10) {
+        mapCHR(0, chrBank0, 0x1000);
+        mapCHR(4, chrBank1, 0x1000);
+    } else {
+        mapCHR(0, chrBank0 >> 1, 0x2000);
+    }
+}
+
+// UxROM --------------------------------------------------------------------------------------------------------------
+
+void UxROM::reset() {
+    mapPRG(0, 0, 0x4000);
+    mapPRG(2, -1, 0x4000);
+    mapCHR(0, 0, 0x2000);
+}
+
+void UxROM::write(uint16_t, uint8_t data) {
+    mapPRG(0, data, 0x4000);
+}
+
+// CNROM --------------------------------------------------------------------------------------------------------------
+
+void CNROM::reset() {
+    mapPRG(0, 0, 0x4000);
+    mapPRG(2, -1, 0x4000);
+    mapCHR(0, 0, 0x2000);
+}
+
+void CNROM::write(uint16_t, uint8_t data) {
+    mapCHR(0, data, 0x2000);
+}
+
+// MMC3 ---------------------------------------------------------------------------------------------------------------
+
+void MMC3::reset() {
+    bankSelect = 0x00;
+    for (int i = 0; i < 8; i++) {
+        registers[i] = 0x00;
+    }
+    irqLatch = 0x00;
+    irqCounter = 0x00;
+    irqReload = false;
+    irqEnabled = false;
+    irq = false;
+    updateBanks();
+}
+
+void MMC3::write(uint16_t address, uint8_t data) {
+    bool even = (address & 0x01) == 0;
+    switch (address & 0xE000) {
+        case 0x8000:
+            if (even) {
+                bankSelect = data;
+            } else {
+                registers[bankSelect & 0x07] = data;
+            }
+            updateBanks();
+            break;
+        case 0xA000:
+            // Odd writes protect PRG RAM, which isn't emulated, PRG RAM is always writable
+            if (even && !(rom.ROMheader.flags6 & 0x08)) {
+                mirroring = (data & 0x01) ? HORIZONTAL : VERTICAL;
+            }
+            break;
+        case 0xC000:
+            if (even) {
+                irqLatch = data;
+            } else {
+                irqCounter = 0;
+                irqReload = true;
+            }
+            break;
+        case 0xE000:
+            // Even writes also acknowledge a pending IRQ
+            irqEnabled = !even;
+            if (even) {
+                irq = false;
+            }
+            break;
+    }
+}
+
+void MMC3::updateBanks() {
+    // R6 and the second to last bank swap places with bit 6, R7 is always at 0xA000
+    if (bankSelect & 0x40) {
+        mapPRG(0, -2, 0x2000);
+        mapPRG(2, registers[6], 0x2000);
+    } else {
+        mapPRG(0, registers[6], 0x2000);
+        mapPRG(2, -2, 0x2000);
+    }
+    mapPRG(1, registers[7], 0x2000);
+    mapPRG(3, -1, 0x2000);
+
+    // Two 2KB banks and four 1KB banks, which half each group goes in is swapped by bit 7
+    int big = (bankSelect & 0x80) ? 4 : 0;
+    int small = (bankSelect & 0x80) ? 0 : 4;
+    mapCHR(big, registers[0] >> 1, 0x0800);
+    mapCHR(big + 2, registers[1] >> 1, 0x0800);
+    for (int i = 0; i < 4; i++) {
+        mapCHR(small + i, registers[2 + i], 0x0400);
+    }
+}
+
+void MMC3::a12Rise() {
+    if (irqCounter == 0 || irqReload) {
+        irqCounter = irqLatch;
+        irqReload = false;
+    } else {
+        irqCounter--;
+    }
+    if (irqCounter == 0 && irqEnabled) {
+        irq = true;
+    }
+}
+
+int MMC3::risesUntilIRQ() const {
+    if (!irqEnabled) {
+        return -1;
+    }
+    if (irqCounter == 0 || irqReload) {
+        // Reloads on the next rise, then counts down the latch
+        return irqLatch + 1;
+    }
+    return irqCounter;
+}
+
+void MMC3::saveState(StateWriter& state) const {
+    Mapper::saveState(state);
+    state.put(bankSelect);
+    state.put(registers);
+    state.put(irqLatch);
+    state.put(irqCounter);
+    state.put(irqReload);
+    state.put(irqEnabled);
+}
+
+void MMC3::loadState(StateReader& state) {
+    Mapper::loadState(state);
+    state.get(bankSelect);
+    state.get(registers);
+    state.get(irqLatch);
+    state.get(irqCounter);
+    state.get(irqReload);
+    state.get(irqEnabled);
+}
@@ -0,0 +1,129 @@
+#ifndef MAPPER_H
+#define MAPPER_H
+
+#include <cstdint>
+#include <vector>
+#include "ROM.h"
+#include "SaveState.h"
+
+// How the four nametables map onto the PPU's 2KB of nametable memory
+enum MIRRORING {
+    HORIZONTAL,
+    VERTICAL,
+    ONE_SCREEN_LOW,
+    ONE_SCREEN_HIGH
+};
+
+// Cartridge hardware. The CPU sees PRG through four 8KB windows at 0x8000 - 0xFFFF and the PPU sees
+// CHR through eight 1KB windows at 0x0000 - 0x1FFF. Switching banks only moves window pointers into
+// the loaded images, nothing gets copied.
+class Mapper {
+public:
+    explicit Mapper(NESROM& rom);
+    virtual ~Mapper() = default;
+
+    // Make the mapper for the ROM's mapper number, nullptr if it isn't supported
+    static Mapper* create(NESROM& rom);
+
+    // Power on bank layout
+    virtual void reset() = 0;
+    // CPU write to 0x8000 - 0xFFFF
+    virtual void write(uint16_t address, uint8_t data) = 0;
+
+    // PPU address line A12 went from low to high
+    virtual void a12Rise() {}
+    // Number of A12 rises until the IRQ goes off, -1 if it won't
+    virtual int risesUntilIRQ() const { return -1; }
+
+    // Bank windows, mirroring, the IRQ line and CHR RAM, for save states. Mappers with
+    // registers save them after these.
+    virtual void saveState(StateWriter& state) const;
+    virtual void loadState(StateReader& state);
+
+    uint8_t* prgBanks[4]{};
+    uint8_t* chrBanks[8]{};
+    // chrBanks with every pixel of a tile row decoded, 4 bytes for each byte of CHR
+    uint8_t* chrDecodedBanks[8]{};
+    bool chrWritable = false;
+    MIRRORING mirroring = HORIZONTAL;
+    // IRQ line to the CPU
+    bool irq = false;
+
+protected:
+    // Point an 8KB PRG window at a bank of the given size, negative banks count from the end
+    void mapPRG(int window, int bank, int size);
+    // Point 1KB CHR windows starting at window at a bank of the given size
+    void mapCHR(int window, int bank, int size);
+    // Decode every tile row of CHR into chrDecoded
+    void decodeCHR();
+
+    NESROM& rom;
+    std::vector<uint8_t> chrDecoded;
+};
+
+// Mapper 0
+class NROM : public Mapper {
+public:
+    using Mapper::Mapper;
+    void reset() override;
+    void write(uint16_t address, uint8_t data) override;
+};
+
+// Mapper 1
+class MMC1 : public Mapper {
+public:
+    using Mapper::Mapper;
+    void reset() override;
+    void write(uint16_t address, uint8_t data) override;
+    void saveState(StateWriter& state) const override;
+    void loadState(StateReader& state) override;
+
+private:
+    void updateBanks();
+
+    uint8_t shift = 0x10;   // Bits come in at the top, full when the marker bit reaches the bottom
+    uint8_t control = 0x0C;
+    uint8_t chrBank0 = 0x00;
+    uint8_t chrBank1 = 0x00;
+    uint8_t prgBank = 0x00;
+};
+
+// Mapper 2
+class UxROM : public Mapper {
+public:
+    using Mapper::Mapper;
+    void reset() override;
+    void write(uint16_t address, uint8_t data) override;
+};
+
+// Mapper 3
+class CNROM : public Mapper {
+public:
+    using Mapper::Mapper;
+    void reset() override;
+    void write(uint16_t address, uint8_t data) override;
+};
+
+// Mapper 4
+class MMC3 : public Mapper {
+public:
+    using Mapper::Mapper;
+    void reset() override;
+    void write(uint16_t address, uint8_t data) override;
+    void a12Rise() override;
+    int risesUntilIRQ() const override;
+    void saveState(StateWriter& state) const override;
+    void loadState(StateReader& state) override;
+
+private:
+    void updateBanks();
+
+    uint8_t bankSelect = 0x00;
+    uint8_t registers[8]{};
+    uint8_t irqLatch = 0x00;
+    uint8_t irqCounter = 0x00;
+    bool irqReload = false;
+    bool irqEnabled = false;
+};
+
+#endif // MAPPER_H
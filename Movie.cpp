@@ -0,0 +1,163 @@
+#include "Movie.h"
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "SaveState.h"
+
+// Bump whenever the file layout changes
+const uint32_t MOVIE_VERSION = 1;
+
+// Start of a movie file, followed by the start state and then each frame's buttons and hash
+struct MovieHeader {
+    char magic[4];          // "NESM"
+    uint32_t version;       // MOVIE_VERSION
+    uint64_t romHash;
+    uint32_t stateSize;
+    uint32_t frameCount;
+};
+
+// FNV-1a over 8 bytes at a time, plenty to tell two states apart and quick enough to run on
+// every frame of a replay
+static uint64_t hashBytes(uint64_t hash, const uint8_t* data, size_t size) {
+    const uint64_t prime = 0x100000001B3ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * prime;
+    }
+    return hash;
+}
+
+static const uint64_t HASH_START = 0xCBF29CE484222325ULL;
+
+uint64_t Movie::hashROM(const NESROM& rom) {
+    uint64_t hash = hashBytes(HASH_START, rom.prgRom, rom.prgSize);
+    // CHR RAM is part of the state, not the cartridge
+    if (!rom.chrRam) {
+        hash = hashBytes(hash, rom.chrRom, rom.chrSize);
+    }
+    return hashBytes(hash, &rom.mapper, sizeof(rom.mapper));
+}
+
+uint64_t Movie::hashState(const std::vector<uint8_t>& state) {
+    return hashBytes(HASH_START, state.data(), state.size());
+}
+
+bool Movie::start(const NES& nes) {
+    frames.clear();
+    startState.clear();
+    if (!nes.rom_loaded) {
+        return false;
+    }
+    romHash = hashROM(nes.rom);
+    nes.saveState(startState);
+    return true;
+}
+
+void Movie::recordFrame(NES& nes) {
+    uint8_t buttons = nes.bus.controller1.reg;
+    nes.runFrame();
+    nes.saveState(state);
+    frames.push_back({buttons, hashState(state)});
+}
+
+Movie::ReplayResult Movie::replay(NES& nes) const {
+    ReplayResult result;
+    if (!startReplay(nes)) {
+        return result;
+    }
+    result.started = true;
+
+    bool headless = nes.headless;
+    nes.headless = true;
+    std::vector<uint8_t> frameState;
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (!replayFrame(nes, i, frameState)) {
+            result.diverged = true;
+            break;
+        }
+        result.frames++;
+    }
+    nes.headless = headless;
+    return result;
+}
+
+bool Movie::startReplay(NES& nes) const {
+    if (!nes.rom_loaded || hashROM(nes.rom) != romHash) {
+        return false;
+    }
+    nes.initNES();
+    return nes.loadState(startState);
+}
+
+bool Movie::replayFrame(NES& nes, size_t frame, std::vector<uint8_t>& state) const {
+    nes.bus.controller1.reg = frames[frame].buttons;
+    nes.runFrame();
+    nes.saveState(state);
+    return hashState(state) == frames[frame].hash;
+}
+
+bool Movie::save(const std::string& path) const {
+    std::vector<uint8_t> buffer;
+    StateWriter out(buffer);
+    MovieHeader header{{'N', 'E', 'S', 'M'}, MOVIE_VERSION, romHash,
+                       static_cast<uint32_t>(startState.size()), static_cast<uint32_t>(frames.size())};
+    out.put(header);
+    out.bytes(startState.data(), startState.size());
+    for (const Frame& frame : frames) {
+        out.put(frame.buttons);
+        out.put(frame.hash);
+    }
+
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool written = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    return std::fclose(file) == 0 && written;
+}
+
+bool Movie::load(const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> buffer;
+    uint8_t chunk[4096];
+    size_t count;
+    while ((count = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        buffer.insert(buffer.end(), chunk, chunk + count);
+    }
+    std::fclose(file);
+
+    // Everything is checked before the movie is replaced
+    StateReader in(buffer.data(), buffer.size());
+    MovieHeader header{};
+    in.get(header);
+    const size_t frameSize = sizeof(Frame::buttons) + sizeof(Frame::hash);
+    if (std::memcmp(header.magic, "NESM", 4) != 0 || header.version != MOVIE_VERSION ||
+        buffer.size() != sizeof(header) + header.stateSize + header.frameCount * frameSize) {
+        return false;
+    }
+    std::vector<uint8_t> loadedState(header.stateSize);
+    in.bytes(loadedState.data(), loadedState.size());
+    std::vector<Frame> loadedFrames(header.frameCount);
+    for (Frame& frame : loadedFrames) {
+        in.get(frame.buttons);
+        in.get(frame.hash);
+    }
+    if (!in.done()) {
+        return false;
+    }
+
+    romHash = header.romHash;
+    startState = std::move(loadedState);
+    frames = std::move(loadedFrames);
+    return true;
+}
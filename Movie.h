@@ -0,0 +1,57 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "NES.h"
+
+// The buttons held on every frame of a run, with the state it started from and a hash of the
+// state after each frame. Playing it back from the same ROM has to end every frame on the same
+// hash, so the first frame that doesn't is where the emulation stopped being deterministic.
+class Movie {
+public:
+    struct Frame {
+        uint8_t buttons = 0x00;     // Controller 1 for the whole frame
+        uint64_t hash = 0;          // Hash of the save state at the end of the frame
+    };
+
+    struct ReplayResult {
+        bool started = false;       // The ROM and the start state matched
+        size_t frames = 0;          // Frames that ended on their recorded hash
+        bool diverged = false;      // A frame ended somewhere else, the one after the matching ones
+    };
+
+    uint64_t romHash = 0;
+    std::vector<uint8_t> startState;
+    std::vector<Frame> frames;
+
+    // Start a new recording from where nes is now, false if it has no ROM
+    bool start(const NES& nes);
+    // Run a frame with the buttons in controller 1 and add it to the recording
+    void recordFrame(NES& nes);
+
+    // Play the movie back on nes, which has to have the same ROM loaded, from its start state.
+    // Runs headless and as fast as it can, stopping at the first frame that doesn't match.
+    ReplayResult replay(NES& nes) const;
+    // The same a frame at a time: load the start state, false if nes has another ROM, then run
+    // each frame in order, false if it didn't end on the recorded state. state is scratch space
+    // for hashing it, reused between frames.
+    bool startReplay(NES& nes) const;
+    bool replayFrame(NES& nes, size_t frame, std::vector<uint8_t>& state) const;
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+    // Hashes of what a movie checks
+    static uint64_t hashROM(const NESROM& rom);
+    static uint64_t hashState(const std::vector<uint8_t>& state);
+
+private:
+    // Scratch state for hashing each frame
+    std::vector<uint8_t> state;
+};
+
+#endif // MOVIE_H
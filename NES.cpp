@@ -3,46 +3,18 @@
 
 void NES::load_rom(const char *filename) {
     if (on == false) {
-        rom.load(filename);
-        rom_loaded = true;
-        uint16_t memory_address = 0x0000;
-        bus.connectROM(rom);
-
-
-        // write CHR ROM to ppu memory
-        for (int i = 0; i < 1024 * 8; i++) {
-            bus.ppu.writePatternTable(memory_address, rom.chrRom[memory_address]);
-            memory_address++;
-        }
-        bus.ppu.decodePatternTable();
-        memory_address = 0x0000;
-
-        // Write prg ROM to CPU Memory
-        // this section is specifically for NROM, changes will be necessary for future mappers
-        if (rom.mirrored) {
-            uint16_t memory_address_cpu = 0x8000;
-            uint16_t memory_address_cpu_mirror = 0xC000;
-
-			// NROM-128
-            for (int i = 0; i < 1024 * 16; i++) {
-                uint8_t prgByte = rom.prgRom[memory_address];
-                memory_address ++;
-                cpu.writerom(memory_address_cpu, prgByte);
-                cpu.writerom(memory_address_cpu_mirror, prgByte);
-                memory_address_cpu ++;
-                memory_address_cpu_mirror ++;
-            }
-        } else {
-        	uint16_t memory_address_cpu = 0x8000;
-
-			// NROM-256
-            for (int i = 0; i < 1024 * 32; i++) {
-                uint8_t prgByte = rom.prgRom[memory_address];
-                memory_address ++;
-                cpu.writerom(memory_address_cpu, prgByte);
-                memory_address_cpu ++;
+        // The mapper shows the CPU and PPU the ROM's banks in place, nothing is copied. The old
+        // ROM stays mapped until the new one is connected, and stays in if it can't be.
+        NESROM loaded;
+        rom_loaded = loaded.load(filename);
+        if (rom_loaded) {
+            rom.swap(loaded);
+            rom_loaded = bus.connectROM(rom);
+            if (!rom_loaded) {
+                rom.swap(loaded);
             }
         }
+        rewind.clear();
     }
 }
 
@@ -76,26 +48,55 @@ void NES::run() {
     }
 }
 
+void NES::runFrame() {
+    if (on == true) {
+        // With run-ahead the frame the machine is really on isn't shown
+        bus.ppu.outputFrames = runAhead == 0 && !headless;
+        emulateFrame();
+
+        if (rewind.capacity() > 0) {
+            saveState(rewindState);
+            rewind.push(rewindState);
+        }
+        if (runAhead > 0) {
+            runFramesAhead();
+        }
+    }
+}
+
+void NES::emulateFrame() {
+    // Run up to and including the dot that starts vblank
+    uint64_t frameEnd = bus.clockCounter + bus.ppu.dotsUntilVblank() + 1;
+    if (catch_up) {
+        bus.run(frameEnd);
+    } else {
+        while (bus.clockCounter < frameEnd) {
+            bus.clock();
+        }
+    }
+}
+
+void NES::runFramesAhead() {
+    auto start = std::chrono::steady_clock::now();
+
+    // Run on with the buttons held now and show only the last frame, then put the machine
+    // back where it really is
+    saveState(runAheadState);
+    for (int i = 1; i <= runAhead; i++) {
+        bus.ppu.outputFrames = i == runAhead && !headless;
+        emulateFrame();
+    }
+    loadState(runAheadState);
+    bus.ppu.outputFrames = !headless;
+
+    std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+    runAheadFrameMs = took.count() / runAhead;
+}
+
 void NES::cycle() {
-    if(on == true) {
-        // Uncomment to test NES at full speed, might need to add more code if system is running too fast.
-          double fps = 1./60.;
-          auto start = std::chrono::high_resolution_clock::now();
-          int count = 0;
-          while (true) {
-              if (!(count % 2 == 0)) {
-                  bus.clock();
-              }
-              count++;
-              auto end = std::chrono::high_resolution_clock::now();
-              std::chrono::duration<double> elapsed_time = end - start;
-              std::chrono::duration<double> frame_time(fps);
-              if ((elapsed_time) > frame_time) {
-                  bus.cpuClockCounter = 0;
-                  break;
-              }
-          }
-        //bus.clock();
+    if (on == true) {
+        runFrame();
+        pacer.wait();
     }
 }
 
@@ -103,14 +104,76 @@ void NES::end() {
     on = false;
 }
 
+// Identifies the cartridge a state belongs to, size left for the caller
+static SaveStateHeader stateHeader(const Bus& bus) {
+    SaveStateHeader header{{'N', 'E', 'S', 'S'}, SAVE_STATE_VERSION, 0, 0xFFFFFFFF, 0, 0};
+    if (bus.mapper) {
+        header.mapper = bus.rom->mapper;
+        header.prgSize = bus.rom->prgSize;
+        header.chrSize = bus.rom->chrSize;
+    }
+    return header;
+}
+
+void NES::saveState(std::vector<uint8_t>& buffer) const {
+    buffer.clear();
+    StateWriter state(buffer);
+    SaveStateHeader header = stateHeader(bus);
+    state.put(header);
+    bus.saveState(state);
+
+    header.size = buffer.size();
+    std::memcpy(buffer.data(), &header, sizeof(header));
+}
+
+bool NES::loadState(const std::vector<uint8_t>& buffer) {
+    // Everything is checked before anything is touched
+    SaveStateHeader header{};
+    if (buffer.size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    SaveStateHeader expected = stateHeader(bus);
+    expected.size = buffer.size();
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0) {
+        return false;
+    }
+
+    StateReader state(buffer.data() + sizeof(header), buffer.size() - sizeof(header));
+    bus.loadState(state);
+    return state.done();
+}
+
+void NES::setRewindSeconds(double seconds) {
+    rewind.setCapacity(static_cast<size_t>(seconds * NES_FPS));
+}
+
+bool NES::rewindFrame() {
+    // The newest state is the frame on screen. Going back one means loading the state before
+    // that one and running its frame again, which draws it and stores it again.
+    if (!on || rewind.frames() < 3) {
+        return false;
+    }
+    rewind.pop();
+    rewind.pop();
+    rewind.latest(rewindState);
+    // Buttons held now don't go back in time with the rest
+    uint8_t buttons = bus.controller1.reg;
+    bool loaded = loadState(rewindState);
+    if (loaded) {
+        runFrame();
+    }
+    bus.controller1.reg = buttons;
+    return loaded;
+}
 
-uint32_t* NES::getFramebuffer() {
+const uint32_t* NES::getFramebuffer() {
     // for (int i = 0; i < 256 * 240; i++) {
     //     rgbFramebuffer[i] = nesPalette[i % 64];
     //     uint8_t colorIndex = framebuffer[i];  // Get NES color index
     //     rgbFramebuffer[i] = 0xFF000000 | nesPalette[colorIndex % 64];  // Convert to 32-bit ARGB
     // }
-    return bus.ppu.rgbFramebuffer;
+    return bus.ppu.frames.acquire();
 }
 
 void NES::RandomizeFramebuffer() {
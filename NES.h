@@ -5,9 +5,12 @@
 #include <thread>
 #include <cstdlib>
 #include <ctime>
+#include <vector>
 
 #include "Bus.h"
 #include "ROM.h"
+#include "FramePacer.h"
+#include "Rewind.h"
 #include "CPU.cpp"
 class NES {
 public:
@@ -20,6 +23,16 @@ public:
     bool A_changed = false;
     int count = 0;
     bool paused = false;
+    // Only catch the PPU up when the CPU touches it instead of clocking it in lockstep
+    bool catch_up = true;
+    // When cycle() lets the next frame start
+    FramePacer pacer;
+    // Nothing shows the frames, so the PPU doesn't convert or publish them
+    bool headless = false;
+
+    // Scratch states for rewind and run-ahead, reused every frame
+    std::vector<uint8_t> rewindState;
+    std::vector<uint8_t> runAheadState;
 
     uint8_t framebuffer[256 * 240]{};  // 8-bit color indices
     uint32_t rgbFramebuffer[256 * 240]{}; // 32-bit color for SDL
@@ -39,12 +52,40 @@ public:
     void load_rom(const char *filename);
     void initNES();
     void run();
+    // Emulate until the PPU finishes the current frame (vblank starts)
+    void runFrame();
+    // runFrame(), then wait until the next frame is due
     void cycle();
     void end();
 
-    uint32_t* getFramebuffer();
+    // Snapshot the whole machine into buffer, replacing what's in it but keeping its memory.
+    // Taken between frames, a state is a few KB and restores exactly.
+    void saveState(std::vector<uint8_t>& buffer) const;
+    // Restore a snapshot taken with this ROM, false and nothing changed if it was another one
+    bool loadState(const std::vector<uint8_t>& buffer);
+
+    // Have runFrame() keep the states of the last seconds of frames, 0 turns it off
+    void setRewindSeconds(double seconds);
+    // Go back a frame and draw it again, false once there's nothing older left
+    bool rewindFrame();
+    Rewind rewind;
+
+    // Frames runFrame() emulates past the real one to show, taking that many frames of input lag
+    // off. The machine itself still only moves a frame each time, 0 turns it off.
+    int runAhead = 0;
+    // Time each of those extra frames took on the last runFrame(), save and load included
+    double runAheadFrameMs = 0.0;
+
+    // Latest finished frame, without copying it
+    const uint32_t* getFramebuffer();
     void RandomizeFramebuffer();
 
+private:
+    // Run up to and including the dot that starts vblank
+    void emulateFrame();
+    // Run the run-ahead frames past the current one and come back, showing the last of them
+    void runFramesAhead();
+
 };
 
 #endif // NES_H
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <cstdio>
 #include <cstdint>
 #include <cstdlib>
+#include <algorithm>
 #include <array>
 #include <iostream>
 #include <iomanip>
@@ -106,41 +107,14 @@ void PPU::writePPU(uint16_t addr, uint8_t data) {
     //printf("PPU::writePPU: addr: %04x, data: %02x\n", addr, data);
     addr &= 0x3FFF;
     if (addr >= 0x000 && addr <= 0x1FFF) {
-        patternTables[addr] = data;
+        // Only CHR RAM can be written
+        if (chrWritable) {
+            chrBanks[addr >> 10][addr & 0x03FF] = data;
+            decodePatternRow(addr);
+        }
     }
     else if (addr >= 0x2000 && addr <= 0x3EFF) {
-
-        addr &= 0x0FFF;
-        // Vertical mirror
-        if (ROM->ROMheader.flags6 == 1) {
-            if (addr >= 0x0000 && addr <= 0x03FF) {
-                nameTables[addr & 0x03FF] = data;
-            }
-            if (addr >= 0x0400 && addr <= 0x07FF) {
-                nameTables[(addr & 0x03FF) + 1024] = data;
-            }
-            if (addr >= 0x0800 && addr <= 0x0BFF) {
-                nameTables[addr & 0x03FF] = data;
-            }
-            if (addr >= 0x0C00 && addr <= 0x0FFF) {
-                nameTables[(addr & 0x03FF) + 1024] = data;
-            }
-        }
-        // Horizontal mirror
-        if (ROM->ROMheader.flags6 == 0) {
-            if (addr >= 0x0000 && addr <= 0x03FF) {
-                nameTables[addr & 0x03FF] = data;
-            }
-            if (addr >= 0x0400 && addr <= 0x07FF) {
-                nameTables[addr & 0x03FF] = data;
-            }
-            if (addr >= 0x0800 && addr <= 0x0BFF) {
-                nameTables[(addr & 0x03FF) + 1024] = data;
-            }
-            if (addr >= 0x0C00 && addr <= 0x0FFF) {
-                nameTables[(addr & 0x03FF) + 1024] = data;
-            }
-        }
+        nameTableBanks[(addr >> 10) & 0x03][addr & 0x03FF] = data;
     }
     else if (addr >= 0x3F00 && addr <= 0x3FFF) {
         addr &= 0x001F;
@@ -157,41 +131,11 @@ uint8_t PPU::readPPU(uint16_t addr) {
     uint8_t data = 0x00;
     addr &= 0x3FFF;
     if (addr >= 0x0000 && addr <= 0x1FFF) {
-        data = patternTables[addr];
+        data = chrBanks[addr >> 10][addr & 0x03FF];
         return data;
     }
     else if (addr >= 0x2000 && addr <= 0x3EFF) {
-        addr &= 0x0FFF;
-        // Vertical mirror
-        if (ROM->ROMheader.flags6 == 1) {
-            if (addr >= 0x0000 && addr <= 0x03FF) {
-                data = nameTables[addr & 0x03FF];
-            }
-            if (addr >= 0x0400 && addr <= 0x07FF) {
-                data = nameTables[(addr & 0x03FF) + 0x0400];
-            }
-            if (addr >= 0x0800 && addr <= 0x0BFF) {
-                data = nameTables[addr & 0x03FF];
-            }
-            if (addr >= 0x0C00 && addr <= 0x0FFF) {
-                data = nameTables[(addr & 0x03FF) + 0x0400];
-            }
-        }
-        // Horizontal mirror
-        if (ROM->ROMheader.flags6 == 0) {
-            if (addr >= 0x0000 && addr <= 0x03FF) {
-                data = nameTables[addr & 0x03FF];
-            }
-            if (addr >= 0x0400 && addr <= 0x07FF) {
-                data = nameTables[addr & 0x03FF];
-            }
-            if (addr >= 0x0800 && addr <= 0x0BFF) {
-                data = nameTables[(addr & 0x03FF) + 0x0400];
-            }
-            if (addr >= 0x0C00 && addr <= 0x0FFF) {
-                data = nameTables[(addr & 0x03FF) + 0x0400];
-            }
-        }
+        data = nameTableBanks[(addr >> 10) & 0x03][addr & 0x03FF];
         return data;
     }
     else if (addr >= 0x3F00 && addr <= 0x3FFF) {
@@ -204,19 +148,49 @@ uint8_t PPU::readPPU(uint16_t addr) {
     }
 }
 
+PPU::PPU() {
+    updateBanks();
+}
+
 void PPU::connectROM(NESROM& ROM) {
     this->ROM = &ROM;
 }
 
+void PPU::connectMapper(Mapper* mapper) {
+    this->mapper = mapper;
+    updateBanks();
+}
+
+void PPU::updateBanks() {
+    // With no cartridge the pattern tables act as 8KB of CHR RAM
+    for (int i = 0; i < 8; i++) {
+        chrBanks[i] = mapper ? mapper->chrBanks[i] : &patternTables[i * 0x0400];
+        chrDecodedBanks[i] = mapper ? mapper->chrDecodedBanks[i] : &patternTablesDecoded[i * 0x1000];
+    }
+    chrWritable = mapper ? mapper->chrWritable : true;
+
+    // Nametables 0 - 3 in 1KB of nametable memory each
+    static const uint8_t layouts[4][4] = {
+        {0, 0, 1, 1},   // HORIZONTAL
+        {0, 1, 0, 1},   // VERTICAL
+        {0, 0, 0, 0},   // ONE_SCREEN_LOW
+        {1, 1, 1, 1}    // ONE_SCREEN_HIGH
+    };
+    MIRRORING mirroring = mapper ? mapper->mirroring : HORIZONTAL;
+    for (int i = 0; i < 4; i++) {
+        nameTableBanks[i] = &nameTables[layouts[mirroring][i] * 0x0400];
+    }
+}
+
 // Pattern tables ----------------------------------------------------------------------------------------------------
 
 // modify to allow specification of table, tile, plane?
 uint8_t PPU::readPatternTable(uint16_t addr) {
-    return patternTables[addr];
+    return chrBanks[addr >> 10][addr & 0x03FF];
 }
 
 void PPU::writePatternTable(uint16_t addr, uint8_t data) {
-    patternTables[addr] = data;
+    chrBanks[addr >> 10][addr & 0x03FF] = data;
 }
 
 void PPU::printPatternTable() {
@@ -286,6 +260,18 @@ void PPU::decodePatternTable() {
          }
      }
 }
+void PPU::decodePatternRow(uint16_t addr) {
+    // Tiles are 16 bytes of CHR and 64 pixels decoded, so a row decodes to 4 times its offset
+    const uint8_t* tile = chrBanks[addr >> 10] + (addr & 0x03F0);
+    uint8_t row = addr % 8;
+    uint8_t low = tile[row];
+    uint8_t high = tile[row + 8];
+    uint8_t* decoded = chrDecodedBanks[addr >> 10] + (addr & 0x03F0) * 4 + row * 8;
+    for (int j = 0; j < 8; ++j) {
+        decoded[j] = (((high >> (7 - j)) & 0x01) << 1) | ((low >> (7 - j)) & 0x01);
+    }
+}
+
 void PPU::printDecodedPatternTable() {
 
     for (int i = 0; i < 512; i++) {
@@ -320,18 +306,18 @@ void PPU::displayPatternTableOnScreen() {
         current_tile = 0;
     }
     //u_int8_t current_palette = readPPU(0x3F00 + (4 << 2) + current_tile) & 0x3F;
-    uint32_t current_color;
+    uint8_t current_color;
     if (current_tile == 3) {
-        current_color = getColor(22);
+        current_color = 22;
     }
     else if (current_tile == 2) {
-        current_color = getColor(14);
+        current_color = 14;
     }
     else if (current_tile == 1) {
-        current_color = getColor(32);
+        current_color = 32;
     }
     else {
-        current_color = getColor(1);
+        current_color = 1;
     }
     //uint32_t current_color = getColor(current_palette);
     //printf("Current color %08x \n", current_palette);
@@ -342,31 +328,20 @@ void PPU::displayNameTableOnScreen(uint8_t table) {
     uint8_t nameTableByte = nameTables[(table * 1024) + ((scanline / 8) * 32) + (cycle / 8)];
 
     uint8_t current_tile = patternTablesDecoded[(nameTableByte * 64) + ((scanline * 8) % 64) + (cycle % 8) + (control.background_pattern * 16384)];
-    uint32_t current_color;
+    uint8_t current_color;
 
-    current_color = getColor(readPPU(0x3F00 + (0 << 2) + current_tile) % 64);
+    current_color = readPPU(0x3F00 + (0 << 2) + current_tile) % 64;
 
     setPixel(cycle, scanline, current_color);
 }
 
 
-void PPU::setPixel(uint8_t x, uint8_t y, uint32_t color) {
-    rgbFramebuffer[y * 256 + x] = 0xFF000000 | color;
-    if (complete_frame == true) {
-        std::memcpy(nextFrame, rgbFramebuffer, sizeof(nextFrame));
-        complete_frame = false;
-    }
+void PPU::setPixel(uint8_t x, uint8_t y, uint8_t index) {
+    framebuffer[y * 256 + x] = index;
 }
 
 unsigned PPU::getColor(int index) {
-    std::array<uint32_t, 64> nesPalette = {
-        0x545454, 0xB41D01, 0xA01008, 0x880030, 0x4C0044, 0x20005C, 0x000454, 0x00183C, 0x002A20, 0x003A08, 0x004000, 0x0A3C00, 0x383200, 0x000000, 0x000000, 0x000000,
-        0x969698, 0x644C07, 0xEC3230, 0xEC1E5C, 0xB01488, 0x6414A0, 0x0000FF, 0x0A3C78, 0x003C22, 0x00660A, 0x006400, 0x3A5800, 0x3B3900, 0x2A1B00, 0x1F1F1F, 0x111111,
-        0xA9A9A9, 0x9C3C02, 0xCC4924, 0xCF403E, 0x996C6B, 0xAA777F, 0xC2958B, 0x009EFA, 0xA000FF, 0x00EB74, 0x4E1A8C, 0x531D80, 0xF7D52B, 0x6E4A9E, 0x525192, 0x534E77,
-        0xFFFFFF, 0xE89D0B, 0xE0672F, 0xFF7F6A, 0xF2B9A2, 0xDBC69C, 0x70A5E9, 0xC7825C, 0x990F08, 0xF6D113, 0xFDC835, 0x9E8F7F, 0xF5E0C8, 0xFFFBF3, 0xFFEBC8, 0xF79F7F
-    };
-
-    return 0xFF000000 | nesPalette[index];
+    return colorPalette.color(index, 0);
 }
 
 void PPU::shiftLeft(uint8_t arr[], int size) {
@@ -430,101 +405,234 @@ void PPU::reset() {
 
 }
 
-void PPU::clock() {
-    // Debugging tools
-    if (scanline < 241 && cycle < 256) {
-        //displayPatternTableOnScreen();
-        //displayNameTableOnScreen(0);
-        //status.sprite_zerohit = 1;
-        //printNameTable();
-        //printf("\n");
+void PPU::saveState(StateWriter& state) const {
+    state.put(v.vram_register);
+    state.put(t.vram_register);
+    state.put(x);
+    state.put(w);
+    state.put(status.reg);
+    state.put(control.reg);
+    state.put(mask.reg);
+    state.put(OAMADDR);
+    state.put(PPUSCROLL);
+    state.put(PPUADDR);
+    state.put(PPUDATA);
+    state.put(OAMDMA);
+    state.put(OAM);
+    state.put(spriteScanline);
+    state.put(numOfSprites);
+    state.put(paletteMemory);
+    state.put(dataBuffer);
+    state.put(nameTables);
+    state.put(cycle);
+    state.put(scanline);
+    state.put(total_frames);
+    state.put(complete_frame);
+    state.put(nmi);
+
+    state.put(next_bg_tile_id);
+    state.put(next_bg_tile_attribute);
+    state.put(next_bg_tile_lsb);
+    state.put(next_bg_tile_msb);
+    state.put(bg_shifter_tile_lo);
+    state.put(bg_shifter_tile_hi);
+    state.put(bg_shifter_attribute_lo);
+    state.put(bg_shifter_attribute_hi);
+    state.put(arr);
+    state.put(sprite_shifter_pattern_lo);
+    state.put(sprite_shifter_pattern_hi);
+    state.put(bSpriteZeroHitPossible);
+    state.put(bSpriteZeroBeingRendered);
+
+    // The 8KB the pattern tables stand in for
+    if (mapper == nullptr) {
+        state.bytes(patternTables.data(), 0x2000);
     }
+}
 
-    // Increments the coarse x in the vram during rendering.
-    auto IncrementScrollX = [&]() {
-        // Check if rendering is enabled
-        if (mask.enable_background_rendering || mask.enable_sprite_rendering) {
-            // if the coarse x is at the end of the table, wrap around and go to the next table
-            if (v.coarse_x == 31) {
-                v.coarse_x = 0;
-                v.nametable_x = ~v.nametable_x;
-            }
-            // Otherwise increment
-            else {
-                v.coarse_x++;
+void PPU::loadState(StateReader& state) {
+    state.get(v.vram_register);
+    state.get(t.vram_register);
+    state.get(x);
+    state.get(w);
+    state.get(status.reg);
+    state.get(control.reg);
+    state.get(mask.reg);
+    state.get(OAMADDR);
+    state.get(PPUSCROLL);
+    state.get(PPUADDR);
+    state.get(PPUDATA);
+    state.get(OAMDMA);
+    state.get(OAM);
+    state.get(spriteScanline);
+    state.get(numOfSprites);
+    state.get(paletteMemory);
+    state.get(dataBuffer);
+    state.get(nameTables);
+    state.get(cycle);
+    state.get(scanline);
+    state.get(total_frames);
+    state.get(complete_frame);
+    state.get(nmi);
+
+    state.get(next_bg_tile_id);
+    state.get(next_bg_tile_attribute);
+    state.get(next_bg_tile_lsb);
+    state.get(next_bg_tile_msb);
+    state.get(bg_shifter_tile_lo);
+    state.get(bg_shifter_tile_hi);
+    state.get(bg_shifter_attribute_lo);
+    state.get(bg_shifter_attribute_hi);
+    state.get(arr);
+    state.get(sprite_shifter_pattern_lo);
+    state.get(sprite_shifter_pattern_hi);
+    state.get(bSpriteZeroHitPossible);
+    state.get(bSpriteZeroBeingRendered);
+
+    if (mapper == nullptr) {
+        state.bytes(patternTables.data(), 0x2000);
+        updateBanks();
+        for (uint16_t addr = 0; addr < 0x2000; addr += 16) {
+            for (uint16_t row = 0; row < 8; row++) {
+                decodePatternRow(addr + row);
             }
         }
-    };
+    }
+}
+
+int PPU::dotsUntilVblank() const {
+    // Vblank starts on scanline 241, cycle 1. Scanlines run from -1 to 260.
+    int position = (scanline + 1) * DOTS_PER_SCANLINE + cycle;
+    int vblank = (241 + 1) * DOTS_PER_SCANLINE + 1;
+    return (vblank - position + DOTS_PER_FRAME) % DOTS_PER_FRAME;
+}
+
+int PPU::a12RiseDot() const {
+    if (!mask.enable_background_rendering && !mask.enable_sprite_rendering) {
+        return -1;
+    }
+    // 8x16 sprites fetch from both tables, empty slots fetch tile 0xFF from 0x1000
+    bool spritesHigh = control.sprite_size || control.sprite_pattern;
+    if (!control.background_pattern && spritesHigh) {
+        return 260;
+    }
+    if (control.background_pattern && !spritesHigh) {
+        return 324;
+    }
+    return -1;
+}
+
+int PPU::dotsUntilA12Rises(int rises) const {
+    int dot = a12RiseDot();
+    if (dot < 0 || rises <= 0) {
+        return -1;
+    }
+    // A12 rises once on each of the 241 scanlines from -1 to 239
+    int position = (scanline + 1) * DOTS_PER_SCANLINE + cycle;
+    int first = position <= dot ? 0 : (position - dot + DOTS_PER_SCANLINE - 1) / DOTS_PER_SCANLINE;
+    // Past scanline 239 the next one is on the pre-render line of the next frame
+    first = std::min(first, 241);
+    int rise = first + rises - 1;
+    int frames = rise / 241;
+    return frames * DOTS_PER_FRAME + (rise % 241) * DOTS_PER_SCANLINE + dot - position;
+}
+
+// Increments the coarse x in the vram during rendering.
+void PPU::incrementScrollX() {
+    // Check if rendering is enabled
+    if (mask.enable_background_rendering || mask.enable_sprite_rendering) {
+        // if the coarse x is at the end of the table, wrap around and go to the next table
+        if (v.coarse_x == 31) {
+            v.coarse_x = 0;
+            v.nametable_x = ~v.nametable_x;
+        }
+        // Otherwise increment
+        else {
+            v.coarse_x++;
+        }
+    }
+}
 
-    // Increment fine y  and coarse y during rendering
-    auto IncrementScrollY = [&]() {
-        if (mask.enable_background_rendering || mask.enable_sprite_rendering) {
-            if (v.fine_y < 7) {
-                v.fine_y++;
+// Increment fine y  and coarse y during rendering
+void PPU::incrementScrollY() {
+    if (mask.enable_background_rendering || mask.enable_sprite_rendering) {
+        if (v.fine_y < 7) {
+            v.fine_y++;
+        }
+        else {
+            v.fine_y = 0;
+            if (v.coarse_y == 29) {
+                v.coarse_y = 0;
+                v.nametable_y = ~v.nametable_y;
+            }
+            else if (v.coarse_y == 31) {
+                v.coarse_y = 0;
             }
             else {
-                v.fine_y = 0;
-                if (v.coarse_y == 29) {
-                    v.coarse_y = 0;
-                    v.nametable_y = ~v.nametable_y;
-                }
-                else if (v.coarse_y == 31) {
-                    v.coarse_y = 0;
-                }
-                else {
-                    v.coarse_y++;
-                }
+                v.coarse_y++;
             }
         }
-    };
-    auto loadShiftRegisters = [&]() {
-        bg_shifter_tile_lo = (bg_shifter_tile_lo & 0xFF00 | (next_bg_tile_lsb));
-        bg_shifter_tile_hi = (bg_shifter_tile_hi & 0xFF00 | (next_bg_tile_msb));
-        bg_shifter_attribute_lo  = (bg_shifter_attribute_lo  & 0xFF00) | ((next_bg_tile_attribute & 0b01) ? 0xFF : 0x00);
-        bg_shifter_attribute_hi  = (bg_shifter_attribute_hi  & 0xFF00) | ((next_bg_tile_attribute & 0b10) ? 0xFF : 0x00);
-        for (int i = 0; i < 8; ++i) {
-            arr[7+i] = (next_bg_tile_attribute);
-        }
-    };
+    }
+}
+void PPU::loadShiftRegisters() {
+    bg_shifter_tile_lo = (bg_shifter_tile_lo & 0xFF00 | (next_bg_tile_lsb));
+    bg_shifter_tile_hi = (bg_shifter_tile_hi & 0xFF00 | (next_bg_tile_msb));
+    bg_shifter_attribute_lo  = (bg_shifter_attribute_lo  & 0xFF00) | ((next_bg_tile_attribute & 0b01) ? 0xFF : 0x00);
+    bg_shifter_attribute_hi  = (bg_shifter_attribute_hi  & 0xFF00) | ((next_bg_tile_attribute & 0b10) ? 0xFF : 0x00);
+    for (int i = 0; i < 8; ++i) {
+        arr[7+i] = (next_bg_tile_attribute);
+    }
+}
 
-    auto updateShifters = [&]() {
-        if (mask.enable_background_rendering) {
-            bg_shifter_tile_lo <<= 1;
-            bg_shifter_tile_hi <<= 1;
-            bg_shifter_attribute_lo <<= 1;
-            bg_shifter_attribute_hi <<= 1;
-            shiftLeft(arr, 16);
-        }
-        if (mask.enable_sprite_rendering && cycle >= 1 && cycle < 258) {
-            for (int i = 0; i < numOfSprites; i++) {
-                // decrement sprite until its ready to render
-                if (spriteScanline[i].x > 0) {
-                    spriteScanline[i].x--;
-                }
-                // Once its rendered, shift it out of the array
-                else {
-                    sprite_shifter_pattern_lo[i] <<= 1;
-                    sprite_shifter_pattern_hi[i] <<= 1;
-                }
+void PPU::updateShifters() {
+    if (mask.enable_background_rendering) {
+        bg_shifter_tile_lo <<= 1;
+        bg_shifter_tile_hi <<= 1;
+        bg_shifter_attribute_lo <<= 1;
+        bg_shifter_attribute_hi <<= 1;
+        shiftLeft(arr, 16);
+    }
+    if (mask.enable_sprite_rendering && cycle >= 1 && cycle < 258) {
+        for (int i = 0; i < numOfSprites; i++) {
+            // decrement sprite until its ready to render
+            if (spriteScanline[i].x > 0) {
+                spriteScanline[i].x--;
+            }
+            // Once its rendered, shift it out of the array
+            else {
+                sprite_shifter_pattern_lo[i] <<= 1;
+                sprite_shifter_pattern_hi[i] <<= 1;
             }
         }
-    };
+    }
+}
 
-    auto TransferAddressY = [&]() {
-        if (mask.enable_background_rendering || mask.enable_sprite_rendering) {
-            v.nametable_y = t.nametable_y;
-            v.fine_y = t.fine_y;
-            v.coarse_y = t.coarse_y;
-        }
-    };
+void PPU::transferAddressY() {
+    if (mask.enable_background_rendering || mask.enable_sprite_rendering) {
+        v.nametable_y = t.nametable_y;
+        v.fine_y = t.fine_y;
+        v.coarse_y = t.coarse_y;
+    }
+}
+
+// // Transfers x scrolling information from temp vram to vram
+void PPU::transferAddressX() {
+    if (mask.enable_background_rendering || mask.enable_sprite_rendering) {
+        v.nametable_x = t.nametable_x;
+        v.coarse_x = t.coarse_x;
+    }
+}
+
+void PPU::clock() {
+    // Debugging tools
+    if (scanline < 241 && cycle < 256) {
+        //displayPatternTableOnScreen();
+        //displayNameTableOnScreen(0);
+        //status.sprite_zerohit = 1;
+        //printNameTable();
+        //printf("\n");
+    }
 
-    // // Transfers x scrolling information from temp vram to vram
-    auto TransferAddressX = [&]() {
-        if (mask.enable_background_rendering || mask.enable_sprite_rendering) {
-            v.nametable_x = t.nametable_x;
-            v.coarse_x = t.coarse_x;
-        }
-    };
     if (scanline >= -1 && scanline < 240) {
         if (scanline == -1 && cycle ==1) {
             status.vblank = 0;
@@ -564,23 +672,23 @@ void PPU::clock() {
                 next_bg_tile_msb = readPPU((control.background_pattern * 4096) + (next_bg_tile_id * 16) + v.fine_y + 8);
             }
             else if(action == 7) {
-                IncrementScrollX();
+                incrementScrollX();
             }
         }
 
     }
 
     if (cycle == 256) {
-        IncrementScrollY();
+        incrementScrollY();
     }
 
     if (cycle == 257) {
         loadShiftRegisters();
-        TransferAddressX();
+        transferAddressX();
     }
 
     if (scanline == -1 && cycle >= 280 && cycle < 305) {
-        TransferAddressY();
+        transferAddressY();
     }
 
     // Foreground rendering --------------------------------------------------------------------------------------------
@@ -674,9 +782,18 @@ void PPU::clock() {
 
 
 
+    // The cartridge can count scanlines by watching A12 of the pattern fetches
+    if (mapper != nullptr && scanline < 240 && (cycle == 260 || cycle == 324) && cycle == a12RiseDot()) {
+        mapper->a12Rise();
+    }
+
     // if rendering of the screen is over, enable nmi vblank
     if (scanline == 241 && cycle == 1) {
         status.vblank = 1;
+        if (outputFrames) {
+            colorPalette.convert(framebuffer, scanlineEmphasis, frames.back());
+            frames.publish();
+        }
         // Check control register
         if (control.vblank_nmi_enable) {
             nmi = true;
@@ -758,8 +875,11 @@ void PPU::clock() {
     }
 
     // Set pixel to screen
-    if (scanline < 241 && cycle < 256) {
-        setPixel(cycle, scanline, getColor(readPPU(0x3F00 + (palette<< 2) + pixel) % 64));
+    if (scanline >= 0 && scanline < 240 && cycle < 256) {
+        if (cycle == 0) {
+            scanlineEmphasis[scanline] = mask.reg >> 5;
+        }
+        setPixel(cycle, scanline, readPPU(0x3F00 + (palette<< 2) + pixel) % 64);
     }
 
     // Advance cycle and scanline
@@ -775,3 +895,161 @@ void PPU::clock() {
         }
     }
 }
+
+void PPU::run(int dots) {
+    while (dots > 0) {
+        if (renderScanlines && cycle == 0 && scanline >= 0 && scanline < 240 && dots >= 257 && mask.enable_background_rendering) {
+            renderScanline();
+            dots -= 257;
+        }
+        else {
+            clock();
+            dots--;
+        }
+    }
+}
+
+void PPU::renderScanline() {
+    uint8_t fineY = v.fine_y;
+    uint16_t patternBase = control.background_pattern * 4096;
+
+    // Fetch the 32 tiles clock() would fetch at dots 1, 9, ..., 249
+    uint8_t tileId[32];
+    uint8_t tileAttribute[32];
+    for (int i = 0; i < 32; i++) {
+        tileId[i] = readPPU(0x2000 | (v.vram_register & 0x0FFF));
+        tileAttribute[i] = readPPU(0x23C0 | (v.nametable_y << 11)
+            | (v.nametable_x << 10)
+            | ((v.coarse_y >> 2) << 3)
+            | (v.coarse_x >> 2));
+        if (v.coarse_y & 0x02) tileAttribute[i] >>= 4;
+        if (v.coarse_x & 0x02) tileAttribute[i] >>= 2;
+        tileAttribute[i] &= 0x03;
+        incrementScrollX();
+    }
+    incrementScrollY();
+
+    // Background pixels. Dot d shows pixel d - 1 + x of the stream made of the tile already in the
+    // shifters, the one waiting in next_bg_tile_*, then the ones fetched above.
+    const uint8_t* decoded[32];
+    for (int i = 0; i < 32; i++) {
+        uint16_t addr = patternBase + tileId[i] * 16;
+        decoded[i] = chrDecodedBanks[addr >> 10] + (addr & 0x03FF) * 4 + fineY * 8;
+    }
+    uint8_t bgPixel[257];
+    uint8_t bgPalette[257];
+    for (int d = 0; d <= 256; d++) {
+        int s = d - 1 + x;
+        if (s < 8) {
+            int bit = 14 - s;
+            bgPixel[d] = (((bg_shifter_tile_hi >> bit) & 0x01) << 1) | ((bg_shifter_tile_lo >> bit) & 0x01);
+        }
+        else if (s < 16) {
+            int bit = 15 - s;
+            bgPixel[d] = (((next_bg_tile_msb >> bit) & 0x01) << 1) | ((next_bg_tile_lsb >> bit) & 0x01);
+        }
+        else {
+            bgPixel[d] = decoded[(s - 16) / 8][(s - 16) % 8];
+        }
+
+        // The palette comes from arr, which is loaded every 8 dots and read at x
+        if (d == 0) {
+            bgPalette[d] = arr[x];
+        }
+        else {
+            int load = (d - 1) / 8;
+            uint8_t loaded = load == 0 ? next_bg_tile_attribute : tileAttribute[load - 1];
+            if ((d - 1) % 8 + x >= 7) {
+                bgPalette[d] = loaded;
+            }
+            else {
+                bgPalette[d] = load == 0 ? arr[x + d] : (load == 1 ? next_bg_tile_attribute : tileAttribute[load - 2]);
+            }
+        }
+    }
+
+    // Sprite pixels, lower OAM index wins
+    uint8_t fgPixel[257]{};
+    uint8_t fgPalette[257];
+    bool fgPriority[257];
+    bool fgZero[257];
+    if (mask.enable_sprite_rendering) {
+        for (int i = numOfSprites - 1; i >= 0; i--) {
+            for (int k = 0; k < 8 && spriteScanline[i].x + k <= 256; k++) {
+                int d = spriteScanline[i].x + k;
+                uint8_t pixel = (((sprite_shifter_pattern_hi[i] << k) & 0x80) >> 6) | (((sprite_shifter_pattern_lo[i] << k) & 0x80) >> 7);
+                if (pixel != 0) {
+                    fgPixel[d] = pixel;
+                    fgPalette[d] = (spriteScanline[i].attribute & 0x03) + 0x04;
+                    fgPriority[d] = (spriteScanline[i].attribute & 0x20) == 0;
+                    fgZero[d] = i == 0;
+                }
+            }
+        }
+    }
+
+    // Palette can't change during the line
+    uint8_t colors[32];
+    for (int i = 0; i < 32; i++) {
+        colors[i] = readPPU(0x3F00 + i) % 64;
+    }
+    scanlineEmphasis[scanline] = mask.reg >> 5;
+
+    for (int d = 0; d <= 256; d++) {
+        uint8_t pixel = 0x00;
+        uint8_t palette = 0x00;
+        if (bgPixel[d] == 0 && fgPixel[d] > 0) {
+            pixel = fgPixel[d];
+            palette = fgPalette[d];
+        }
+        else if (bgPixel[d] > 0 && fgPixel[d] == 0) {
+            pixel = bgPixel[d];
+            palette = bgPalette[d];
+        }
+        else if (bgPixel[d] > 0 && fgPixel[d] > 0) {
+            if (fgPriority[d]) {
+                pixel = fgPixel[d];
+                palette = fgPalette[d];
+            }
+            else {
+                pixel = bgPixel[d];
+                palette = bgPalette[d];
+            }
+            if (fgZero[d] && bSpriteZeroHitPossible && mask.enable_sprite_rendering && d >= 9) {
+                status.sprite_zerohit = 1;
+            }
+        }
+        if (d < 256) {
+            setPixel(d, scanline, colors[(palette << 2) + pixel]);
+        }
+    }
+
+    // Leave everything the way clock() would after dot 256
+    if (mask.enable_sprite_rendering) {
+        bSpriteZeroBeingRendered = fgPixel[256] > 0 && fgZero[256];
+        for (int i = 0; i < numOfSprites; i++) {
+            int shifts = 256 - spriteScanline[i].x;
+            sprite_shifter_pattern_lo[i] = shifts < 8 ? sprite_shifter_pattern_lo[i] << shifts : 0;
+            sprite_shifter_pattern_hi[i] = shifts < 8 ? sprite_shifter_pattern_hi[i] << shifts : 0;
+            spriteScanline[i].x = 0;
+        }
+    }
+
+    // Tile 29 was loaded at dot 241, tile 30 at dot 249 and shifted 7 times since, tile 31 is waiting
+    auto lsb = [&](int i) { return readPPU(patternBase + tileId[i] * 16 + fineY); };
+    auto msb = [&](int i) { return readPPU(patternBase + tileId[i] * 16 + fineY + 8); };
+    auto fill = [](uint8_t attribute, uint8_t bit) { return (attribute & bit) ? 0xFF : 0x00; };
+    bg_shifter_tile_lo = ((lsb(29) << 8) | lsb(30)) << 7;
+    bg_shifter_tile_hi = ((msb(29) << 8) | msb(30)) << 7;
+    bg_shifter_attribute_lo = ((fill(tileAttribute[29], 0b01) << 8) | fill(tileAttribute[30], 0b01)) << 7;
+    bg_shifter_attribute_hi = ((fill(tileAttribute[29], 0b10) << 8) | fill(tileAttribute[30], 0b10)) << 7;
+    for (int i = 0; i < 15; i++) {
+        arr[i] = i < 8 ? tileAttribute[30] : arr[15];
+    }
+    next_bg_tile_id = tileId[31];
+    next_bg_tile_attribute = tileAttribute[31];
+    next_bg_tile_lsb = lsb(31);
+    next_bg_tile_msb = msb(31);
+
+    cycle = 257;
+}
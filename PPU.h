@@ -4,10 +4,22 @@
 #include <cstdint>  // For uint8_t and uint16_t
 #include <map>
 #include "ROM.h"
+#include "Mapper.h"
+#include "Palette.h"
+#include "SaveState.h"
+#include "TripleBuffer.h"
 #include <array>
 #include <cstring>
+
+// Frame timing, one dot per master clock
+const int DOTS_PER_SCANLINE = 341;
+const int SCANLINES_PER_FRAME = 262;
+const int DOTS_PER_FRAME = DOTS_PER_SCANLINE * SCANLINES_PER_FRAME;
+
 class PPU {
 public:
+    PPU();
+
     // Internal Registers
     union vram {
         struct {
@@ -37,7 +49,7 @@ public:
             uint8_t vblank: 1;
         };
         uint8_t reg;
-    } status;
+    } status{};
 
     union PPUCTRL {
         struct {
@@ -50,7 +62,7 @@ public:
             uint8_t ppu_master: 1;
             uint8_t vblank_nmi_enable: 1;
         }; uint8_t reg;
-    } control;
+    } control{};
 
     union PPUMASK {
         struct {
@@ -64,7 +76,7 @@ public:
             uint8_t emphasize_blue: 1;
         };
         uint8_t reg;
-    } mask;
+    } mask{};
 
     //uint8_t PPUCTRL = 0x00;         // Controller
     //uint8_t PPUMASK = 0x00;         // Mask
@@ -82,8 +94,8 @@ public:
         uint8_t x;          // X position of a sprite
     } OAM[64]{};
 
-    ObjectAttributeMemory spriteScanline[8];
-    uint8_t numOfSprites;
+    ObjectAttributeMemory spriteScanline[8]{};
+    uint8_t numOfSprites = 0;
 
     uint8_t* OAMDATA = reinterpret_cast<uint8_t *>(OAM);
     uint8_t OAMDMA = 0x00;          // Sprite DMA
@@ -101,13 +113,27 @@ public:
     void connectROM(NESROM& ROM);
     // Init ROM
     NESROM* ROM{};
+
+    // Cartridge the CHR and nametable layout come from, nullptr for none
+    void connectMapper(Mapper* mapper);
+    Mapper* mapper = nullptr;
+    // Pick up the cartridge's current banks and mirroring
+    void updateBanks();
+
+    // What the PPU sees at 0x0000 - 0x1FFF, in 1KB windows. The pattern tables below stand in
+    // when no cartridge is connected.
+    uint8_t* chrBanks[8]{};
+    uint8_t* chrDecodedBanks[8]{};
+    bool chrWritable = true;
+    // Nametable memory behind each of the four nametables
+    uint8_t* nameTableBanks[4]{};
     
     // Pattern tables------------------------------------------------------------------------------------
     std::array<uint8_t, 4096 * 4> patternTables; // two pattern tables of 256 tiles each (4096 / 16)
     std::array<uint8_t, 4096 * 16> patternTablesDecoded; // two pattern tables of 256 tiles each (4096 / 16) with combined bits
 
     // Palette
-    uint8_t paletteMemory[32];
+    uint8_t paletteMemory[32]{};
 
     // Data buffer
     uint8_t dataBuffer = 0x00;
@@ -124,6 +150,9 @@ public:
 
     void decodePatternTable();
 
+    // Re-decode the tile row a pattern table byte belongs to
+    void decodePatternRow(uint16_t addr);
+
     void printDecodedPatternTable();
 
     void displayPatternTableOnScreen();
@@ -134,10 +163,30 @@ public:
     // method to get a tile, returned as an 8-byte array of pixel info (0-3)
     void getTile(uint8_t tileIndex, uint8_t* tileData, bool table1);
 
-    void setPixel(uint8_t x, uint8_t y, uint32_t color);
+    // Store the palette index of a visible pixel, it's turned into a color when the frame is done
+    void setPixel(uint8_t x, uint8_t y, uint8_t index);
 
     void clock();
 
+    // Advance the PPU by a number of dots
+    void run(int dots);
+
+    // Render dots 0-256 of a visible scanline in one go, leaving the PPU in the same state clock() would
+    void renderScanline();
+
+    // Render whole scanlines at once when nothing can touch the PPU before the line is done.
+    // Turn off to A/B against the dot renderer.
+    bool renderScanlines = true;
+    // Convert and publish every finished frame at vblank, off for frames nobody will see
+    bool outputFrames = true;
+
+    // Number of clock() calls until the one that starts vblank
+    int dotsUntilVblank() const;
+    // Dot of each rendering scanline where the pattern fetches take A12 high, -1 if they don't
+    int a12RiseDot() const;
+    // Number of clock() calls until the one with the given A12 rise, -1 if it won't happen
+    int dotsUntilA12Rises(int rises) const;
+
     int16_t cycle = 0;
     int16_t scanline = 0;
     uint16_t total_frames = 1;
@@ -145,15 +194,18 @@ public:
     bool nmi = false;
 
     uint8_t framebuffer[256 * 240]{};  // 8-bit color indices
-    uint32_t rgbFramebuffer[256 * 240]{}; // 32-bit color for SDL
-    uint32_t nextFrame[256 * 240]{};
+    uint8_t scanlineEmphasis[240]{};   // PPUMASK emphasis bits each scanline was drawn with
+    TripleBuffer frames;               // 32-bit color frames for SDL, published at vblank
+
+    // Converts the finished framebuffer into frames
+    Palette colorPalette;
 
     unsigned getColor(int);
 
     void printNameTable();
 
     // Name tables
-    std::array<uint8_t, 2048> nameTables;
+    std::array<uint8_t, 2048> nameTables{};
 
     std::map<uint8_t, uint16_t> nameTableBaseAddresses = {
         {0b00000000, 0x23C0},
@@ -176,8 +228,8 @@ public:
     uint8_t arr[16] = {0};
 
     // Foreground
-    uint8_t sprite_shifter_pattern_lo[8];
-    uint8_t sprite_shifter_pattern_hi[8];
+    uint8_t sprite_shifter_pattern_lo[8]{};
+    uint8_t sprite_shifter_pattern_hi[8]{};
 
     bool bSpriteZeroHitPossible = false;
     bool bSpriteZeroBeingRendered = false;
@@ -188,7 +240,21 @@ public:
     // Uses data from PPU v register to calculate attribute table address for current tile
     uint16_t getAttributeTableAddress();
 
+    // Rendering steps shared by the dot and scanline renderers
+    void incrementScrollX();
+    void incrementScrollY();
+    void loadShiftRegisters();
+    void updateShifters();
+    void transferAddressX();
+    void transferAddressY();
+
     void reset();
+
+    // Registers, OAM, nametables, palette and the rendering pipeline, for save states. Without a
+    // cartridge the pattern tables go in too. The frame being drawn is left out, so the first
+    // complete frame after a load is the one starting at the next vblank.
+    void saveState(StateWriter& state) const;
+    void loadState(StateReader& state);
 };
 
 #endif // PPU_H
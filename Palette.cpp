@@ -0,0 +1,170 @@
+#include "Palette.h"
+#include "TripleBuffer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PALETTE_X86
+#endif
+
+namespace {
+    const uint32_t NES_COLORS[64] = {
+        0x545454, 0xB41D01, 0xA01008, 0x880030, 0x4C0044, 0x20005C, 0x000454, 0x00183C, 0x002A20, 0x003A08, 0x004000, 0x0A3C00, 0x383200, 0x000000, 0x000000, 0x000000,
+        0x969698, 0x644C07, 0xEC3230, 0xEC1E5C, 0xB01488, 0x6414A0, 0x0000FF, 0x0A3C78, 0x003C22, 0x00660A, 0x006400, 0x3A5800, 0x3B3900, 0x2A1B00, 0x1F1F1F, 0x111111,
+        0xA9A9A9, 0x9C3C02, 0xCC4924, 0xCF403E, 0x996C6B, 0xAA777F, 0xC2958B, 0x009EFA, 0xA000FF, 0x00EB74, 0x4E1A8C, 0x531D80, 0xF7D52B, 0x6E4A9E, 0x525192, 0x534E77,
+        0xFFFFFF, 0xE89D0B, 0xE0672F, 0xFF7F6A, 0xF2B9A2, 0xDBC69C, 0x70A5E9, 0xC7825C, 0x990F08, 0xF6D113, 0xFDC835, 0x9E8F7F, 0xF5E0C8, 0xFFFBF3, 0xFFEBC8, 0xF79F7F
+    };
+
+    // Each emphasis bit dims the other two channels to about 82%
+    const int EMPHASIS_DIM = 209;
+}
+
+Palette::Palette() {
+    for (int emphasis = 0; emphasis < 8; emphasis++) {
+        for (int i = 0; i < 64; i++) {
+            // red, green, blue
+            int channels[3] = {
+                static_cast<int>(NES_COLORS[i] & 0xFF),
+                static_cast<int>((NES_COLORS[i] >> 8) & 0xFF),
+                static_cast<int>((NES_COLORS[i] >> 16) & 0xFF)
+            };
+            for (int bit = 0; bit < 3; bit++) {
+                if (emphasis & (1 << bit)) {
+                    for (int c = 0; c < 3; c++) {
+                        if (c != bit) {
+                            channels[c] = channels[c] * EMPHASIS_DIM / 256;
+                        }
+                    }
+                }
+            }
+            colors[emphasis][i] = 0xFF000000 | (channels[2] << 16) | (channels[1] << 8) | channels[0];
+            for (int c = 0; c < 3; c++) {
+                planes[emphasis][c][i] = channels[c];
+            }
+        }
+    }
+
+#ifdef PALETTE_X86
+    __builtin_cpu_init();
+    hasSSE4 = __builtin_cpu_supports("sse4.1");
+    hasAVX2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+uint32_t Palette::color(uint8_t index, uint8_t emphasis) const {
+    return colors[emphasis & 0x07][index & 0x3F];
+}
+
+void Palette::convert(const uint8_t* indices, const uint8_t* emphasis, uint32_t* pixels) const {
+    if (hasAVX2) {
+        convertAVX2(indices, emphasis, pixels);
+    }
+    else if (hasSSE4) {
+        convertSSE4(indices, emphasis, pixels);
+    }
+    else {
+        convertScalar(indices, emphasis, pixels);
+    }
+}
+
+void Palette::convertScalar(const uint8_t* indices, const uint8_t* emphasis, uint32_t* pixels) const {
+    for (int y = 0; y < FRAME_HEIGHT; y++) {
+        const uint32_t* table = colors[emphasis[y] & 0x07];
+        const uint8_t* row = indices + y * FRAME_WIDTH;
+        uint32_t* out = pixels + y * FRAME_WIDTH;
+        for (int x = 0; x < FRAME_WIDTH; x++) {
+            out[x] = table[row[x] & 0x3F];
+        }
+    }
+}
+
+#ifdef PALETTE_X86
+
+// Look up 16 bytes in a 64-entry table, a 16-entry shuffle per quarter of the table
+__attribute__((target("sse4.1")))
+static inline __m128i lookup64(const uint8_t* table, __m128i low, const __m128i* selected) {
+    __m128i q0 = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(table)), low);
+    __m128i q1 = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(table + 16)), low);
+    __m128i q2 = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(table + 32)), low);
+    __m128i q3 = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(table + 48)), low);
+    return _mm_or_si128(_mm_or_si128(_mm_and_si128(selected[0], q0), _mm_and_si128(selected[1], q1)),
+                        _mm_or_si128(_mm_and_si128(selected[2], q2), _mm_and_si128(selected[3], q3)));
+}
+
+// 16 pixels at a time: red, green and blue are looked up separately, then interleaved with alpha
+__attribute__((target("sse4.1")))
+static void convertSSE4Kernel(const uint8_t (*planes)[3][64], const uint8_t* indices, const uint8_t* emphasis, uint32_t* pixels) {
+    const __m128i indexMask = _mm_set1_epi8(0x3F);
+    const __m128i lowMask = _mm_set1_epi8(0x0F);
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+
+    for (int y = 0; y < FRAME_HEIGHT; y++) {
+        const uint8_t (*plane)[64] = planes[emphasis[y] & 0x07];
+        const uint8_t* row = indices + y * FRAME_WIDTH;
+        uint32_t* out = pixels + y * FRAME_WIDTH;
+
+        for (int x = 0; x < FRAME_WIDTH; x += 16) {
+            __m128i index = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)), indexMask);
+            __m128i low = _mm_and_si128(index, lowMask);
+            __m128i quarter = _mm_srli_epi16(_mm_andnot_si128(lowMask, index), 4);
+            __m128i selected[4] = {
+                _mm_cmpeq_epi8(quarter, _mm_setzero_si128()),
+                _mm_cmpeq_epi8(quarter, _mm_set1_epi8(1)),
+                _mm_cmpeq_epi8(quarter, _mm_set1_epi8(2)),
+                _mm_cmpeq_epi8(quarter, _mm_set1_epi8(3))
+            };
+
+            __m128i red = lookup64(plane[0], low, selected);
+            __m128i green = lookup64(plane[1], low, selected);
+            __m128i blue = lookup64(plane[2], low, selected);
+
+            __m128i redGreenLow = _mm_unpacklo_epi8(red, green);
+            __m128i redGreenHigh = _mm_unpackhi_epi8(red, green);
+            __m128i blueAlphaLow = _mm_unpacklo_epi8(blue, alpha);
+            __m128i blueAlphaHigh = _mm_unpackhi_epi8(blue, alpha);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_unpacklo_epi16(redGreenLow, blueAlphaLow));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 4), _mm_unpackhi_epi16(redGreenLow, blueAlphaLow));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 8), _mm_unpacklo_epi16(redGreenHigh, blueAlphaHigh));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 12), _mm_unpackhi_epi16(redGreenHigh, blueAlphaHigh));
+        }
+    }
+}
+
+// 8 pixels at a time, gathered straight from the 32-bit color table
+__attribute__((target("avx2")))
+static void convertAVX2Kernel(const uint32_t (*colors)[64], const uint8_t* indices, const uint8_t* emphasis, uint32_t* pixels) {
+    const __m256i indexMask = _mm256_set1_epi32(0x3F);
+
+    for (int y = 0; y < FRAME_HEIGHT; y++) {
+        const int* table = reinterpret_cast<const int*>(colors[emphasis[y] & 0x07]);
+        const uint8_t* row = indices + y * FRAME_WIDTH;
+        uint32_t* out = pixels + y * FRAME_WIDTH;
+
+        for (int x = 0; x < FRAME_WIDTH; x += 8) {
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + x));
+            __m256i index = _mm256_and_si256(_mm256_cvtepu8_epi32(bytes), indexMask);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_i32gather_epi32(table, index, 4));
+        }
+    }
+}
+
+#endif
+
+void Palette::convertSSE4(const uint8_t* indices, const uint8_t* emphasis, uint32_t* pixels) const {
+#ifdef PALETTE_X86
+    if (hasSSE4) {
+        convertSSE4Kernel(planes, indices, emphasis, pixels);
+        return;
+    }
+#endif
+    convertScalar(indices, emphasis, pixels);
+}
+
+void Palette::convertAVX2(const uint8_t* indices, const uint8_t* emphasis, uint32_t* pixels) const {
+#ifdef PALETTE_X86
+    if (hasAVX2) {
+        convertAVX2Kernel(colors, indices, emphasis, pixels);
+        return;
+    }
+#endif
+    convertScalar(indices, emphasis, pixels);
+}
@@ -0,0 +1,36 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <cstdint>
+
+// Turns the PPU's 6-bit color indices into 32-bit pixels (0xAABBGGRR, the RGBA byte order SDL and
+// OpenGL are given) once a frame is finished. Grayscale is already part of the indices since the
+// PPU applies it when reading palette memory; emphasis is applied per scanline here.
+class Palette {
+public:
+    Palette();
+
+    // Color of an index with the PPUMASK emphasis bits (red, green, blue in bits 0-2)
+    uint32_t color(uint8_t index, uint8_t emphasis) const;
+
+    // Convert a 256x240 frame, emphasis holds one value per scanline.
+    // Uses the fastest kernel the CPU supports.
+    void convert(const uint8_t* indices, const uint8_t* emphasis, uint32_t* pixels) const;
+
+    // The kernels convert() picks from, so they can be checked against each other and benchmarked.
+    // The SIMD ones fall back to the scalar kernel on CPUs that don't have them.
+    void convertScalar(const uint8_t* indices, const uint8_t* emphasis, uint32_t* pixels) const;
+    void convertSSE4(const uint8_t* indices, const uint8_t* emphasis, uint32_t* pixels) const;
+    void convertAVX2(const uint8_t* indices, const uint8_t* emphasis, uint32_t* pixels) const;
+
+    bool hasSSE4 = false;
+    bool hasAVX2 = false;
+
+private:
+    // 64 colors for each of the 8 emphasis combinations
+    alignas(32) uint32_t colors[8][64];
+    // The same colors split into red, green and blue bytes for the shuffle kernel
+    alignas(16) uint8_t planes[8][3][64];
+};
+
+#endif // PALETTE_H
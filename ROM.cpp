@@ -1,75 +1,125 @@
 #include <iostream>
-#include <fstream>
 #include <cstdint>
+#include <cstring>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "ROM.h"
 
-    
+NESROM::~NESROM() {
+    unload();
+}
+
 // determine the type of mapper
-void NESROM::detect_mapper(const NESHeader& header, std::ifstream &file) {
+void NESROM::detect_mapper(const NESHeader& header) {
     if (isValidHeader(header)) {
-    	switch (header.flags6) {
-    	case 00:					// Mapper 0 (NROM)
-    	case 01: {
-    		// Calculate sizes based on the header
-       		size_t prgRomSize = header.prgRomSize * 16 * 1024;		// 2 = NROM-256, mapped into $8000-$FFFF
-       																// 1 = NROM-128, mapped into $8000-$BFFF AND $C000-$FFFF
-        	size_t chrRomSize = header.chrRomSize * 8 * 1024;
-
-        	if (header.prgRomSize == 1) mirrored = true;			// let the calling program know to mirror the memory
-
-        	// Dynamically allocate memory for PRG ROM and CHR ROM
-        	prgRom = new uint8_t[prgRomSize];
-        	file.read(reinterpret_cast<char*>(prgRom), prgRomSize);
-
-
-        	chrRom = new uint8_t[chrRomSize];
-            file.read(reinterpret_cast<char*>(chrRom), chrRomSize);
+        // The mapper number is split across the high nibbles of flags 6 and 7
+        mapper = (header.flags7 & 0xF0) | (header.flags6 >> 4);
 
-            break;
-        }
-
-        case 20:					// Mapper 2 (UNROM)
-        case 21: {
-         	// UNROM specific stuff goes here (requires bank switching)
-        	break;
-        }
+        // Calculate sizes based on the header
+        prgSize = header.prgRomSize * 16 * 1024;
+        chrSize = header.chrRomSize * 8 * 1024;
 
-        // more mapper cases to follow
+        // No CHR ROM means the cartridge has 8KB of CHR RAM instead
+        chrRam = chrSize == 0;
+        if (chrRam) {
+            chrSize = 8 * 1024;
         }
     }
 }
 
 // function to load ROM
 bool NESROM::load(const std::string& filepath) {
-    std::ifstream file(filepath, std::ios::binary);
-    if (!file.is_open()) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
         std::cerr << "Failed to open file: " << filepath << std::endl;
         return false;
     }
 
+    // Map the file read only and private, pages are only ever shared, never copied
+    struct stat info{};
+    void* data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping outlives the file descriptor
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "Failed to map file: " << filepath << std::endl;
+        return false;
+    }
+    uint8_t* file = static_cast<uint8_t*>(data);
+    size_t fileSize = info.st_size;
+
     // Read the header
     NESHeader header{};
-    file.read(reinterpret_cast<char*>(&header), NES_HEADER_SIZE);
+    if (fileSize >= NES_HEADER_SIZE) {
+        std::memcpy(&header, file, NES_HEADER_SIZE);
+    }
     if (!isValidHeader(header)) {
         std::cerr << "Invalid NES file: " << filepath << std::endl;
+        munmap(file, fileSize);
         return false;
     }
-    ROMheader = header;
 
-	detect_mapper(header, file);
+    // PRG and then CHR come after the header and the trainer, nothing uses the trainer
+    size_t prgOffset = NES_HEADER_SIZE + ((header.flags6 & 0x04) ? 512 : 0);
+    size_t chrBytes = header.chrRomSize * 8 * 1024;
+    if (fileSize < prgOffset + header.prgRomSize * 16 * 1024 + chrBytes) {
+        std::cerr << "Truncated NES file: " << filepath << std::endl;
+        munmap(file, fileSize);
+        return false;
+    }
+    // The mappers wrap bank numbers by the PRG size, there has to be some
+    if (header.prgRomSize == 0) {
+        std::cerr << "No PRG ROM in NES file: " << filepath << std::endl;
+        munmap(file, fileSize);
+        return false;
+    }
+
+    // Only now let go of the ROM loaded before
+    unload();
+    image = file;
+    imageSize = fileSize;
+    ROMheader = header;
+    detect_mapper(header);
+
+    prgRom = image + prgOffset;
+    if (chrRam) {
+        chrRamData.assign(chrSize, 0x00);
+        chrRom = chrRamData.data();
+    } else {
+        chrRom = image + prgOffset + prgSize;
+    }
 
-    // Close the file
-    file.close();
     std::cout << "Successfully loaded NES ROM: " << filepath << std::endl;
     return true;
 }
 
-uint8_t NESROM::readMemoryPRG(const uint16_t address) {
-    return prgRom[address];
+void NESROM::unload() {
+    if (image != nullptr) {
+        munmap(image, imageSize);
+    }
+    image = nullptr;
+    imageSize = 0;
+    chrRamData = std::vector<uint8_t>();
+    prgRom = nullptr;
+    chrRom = nullptr;
 }
 
-uint8_t NESROM::readMemoryCHR(uint16_t address) {
-    return chrRom[address];
+void NESROM::swap(NESROM& other) {
+    std::swap(prgRom, other.prgRom);
+    std::swap(chrRom, other.chrRom);
+    std::swap(ROMheader, other.ROMheader);
+    std::swap(mapper, other.mapper);
+    std::swap(prgSize, other.prgSize);
+    std::swap(chrSize, other.chrSize);
+    std::swap(chrRam, other.chrRam);
+    std::swap(image, other.image);
+    std::swap(imageSize, other.imageSize);
+    chrRamData.swap(other.chrRamData);
 }
 
 bool NESROM::isValidHeader(const NESHeader& header) {
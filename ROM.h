@@ -5,6 +5,7 @@
 #include <fstream>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 // NES ROM header size
 const size_t NES_HEADER_SIZE = 16;
@@ -22,24 +23,34 @@ struct NESHeader {
     uint8_t padding[5];    // Padding, should be zero
 };
 
+// A loaded ROM. The file is mapped read only and prgRom and chrRom point straight into it, so
+// every emulator loading the same file shares one copy of it.
 class NESROM {
 public:
-    uint8_t* prgRom;          // Pointer to PRG ROM data
-    uint8_t* chrRom;          // Pointer to CHR ROM data
+    NESROM() = default;
+    NESROM(const NESROM&) = delete;
+    NESROM& operator=(const NESROM&) = delete;
+    ~NESROM();
+
+    uint8_t* prgRom = nullptr;    // Pointer to PRG ROM data
+    uint8_t* chrRom = nullptr;    // Pointer to CHR ROM data, or the CHR RAM
     NESHeader ROMheader;
-    bool mirrored = false;    // Flag for NROM-128 mirroring
+    uint8_t mapper = 0;       // iNES mapper number
+    size_t prgSize = 0;       // Bytes of PRG ROM
+    size_t chrSize = 0;       // Bytes of CHR ROM, or CHR RAM when chrRam is set
+    bool chrRam = false;      // Cartridge has writable CHR RAM instead of CHR ROM
 
-    // Function to detect and initialize the mapper based on header and file data
-    void detect_mapper(const NESHeader& header, std::ifstream& file);
+    // Function to detect the mapper and PRG/CHR sizes based on the header
+    void detect_mapper(const NESHeader& header);
 
-    // Function to load the ROM from a file
+    // Function to load the ROM from a file, the one loaded before stays if it fails
     bool load(const std::string& filepath);
 
-    // Function to read PRG memory
-    uint8_t readMemoryPRG(const uint16_t address);
+    // Unmap the file and free any CHR RAM
+    void unload();
 
-    // Function to read CHR memory
-    uint8_t readMemoryCHR(uint16_t address);
+    // Trade ROMs with other. Neither image moves, so pointers into them stay good.
+    void swap(NESROM& other);
 
     // Function to validate the ROM header
     bool isValidHeader(const NESHeader& header);
@@ -47,7 +58,10 @@ public:
     // Function to print ROM header information
     void printHeaderInfo(const NESHeader& header);
 
-
+private:
+    uint8_t* image = nullptr;          // The whole mapped file
+    size_t imageSize = 0;
+    std::vector<uint8_t> chrRamData;   // Only allocated when the header asks for CHR RAM
 };
 
 #endif // NESROM_H
\ No newline at end of file
@@ -0,0 +1,986 @@
+#include "Recompiler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+
+#include "CPU.cpp"
+
+#ifdef RECOMPILER_X86_64
+#include <sys/mman.h>
+
+namespace {
+
+// x86-64 registers by their encoding
+enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15, NO_REG = -1 };
+
+// What a block keeps in the registers the calling convention preserves. Everything else is
+// scratch, blocks never call out.
+constexpr Reg CPU_REGISTERS = RBX;  // The CPU, its registers are read and written in place
+constexpr Reg CONTEXT = RBP;        // Recompiler::Context
+constexpr Reg CYCLES = R12;         // Cycles run so far
+constexpr Reg RAM = R13;            // CPU RAM, the zero page and stack are always here
+constexpr Reg READ_PAGES = R14;     // The bus's page tables
+constexpr Reg WRITE_PAGES = R15;
+// Where an instruction's byte is in host memory once its checks have passed
+constexpr Reg READ_POINTER = R8;
+constexpr Reg WRITE_POINTER = R9;
+// 1 if indexing crossed a page
+constexpr Reg CROSSED = R10;
+
+constexpr int32_t ZN_TABLE = offsetof(Recompiler::Context, zn);
+
+// [base + index * scale + disp]
+struct Mem {
+    Reg base;
+    Reg index;
+    int scale;
+    int32_t disp;
+};
+
+Mem at(Reg base, int32_t disp = 0) {
+    return {base, NO_REG, 1, disp};
+}
+
+Mem at(Reg base, Reg index, int scale, int32_t disp = 0) {
+    return {base, index, scale, disp};
+}
+
+// Just the instruction forms blocks are made of. Byte operands only ever use AL, CL and DL, which
+// mean the same with or without a REX prefix.
+class Assembler {
+public:
+    enum Alu { ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7 };
+    enum Condition { ABOVE_EQUAL = 0x3, EQUAL = 0x4, NOT_EQUAL = 0x5 };
+
+    explicit Assembler(uint8_t* start) : out(start) {}
+
+    uint8_t* here() const { return out; }
+
+    void movzxb(Reg dst, const Mem& src) { rm({0x0F, 0xB6}, dst, src); }
+    void movzxb(Reg dst, Reg src) { rr({0x0F, 0xB6}, dst, src); }
+    void storeb(const Mem& dst, Reg src) { rm({0x88}, src, dst); }
+    void storew(const Mem& dst, Reg src) { byte(0x66); rm({0x89}, src, dst); }
+    void store32(const Mem& dst, Reg src) { rm({0x89}, src, dst); }
+    void load64(Reg dst, const Mem& src) { rm({0x8B}, dst, src, true); }
+    void lea64(Reg dst, const Mem& src) { rm({0x8D}, dst, src, true); }
+    void mov32(Reg dst, Reg src) { rr({0x89}, src, dst); }
+    void mov64(Reg dst, Reg src) { rr({0x89}, src, dst, true); }
+    void movi(Reg dst, uint32_t imm) {
+        rex(false, 0, NO_REG, dst);
+        byte(0xB8 | (dst & 7));
+        dword(imm);
+    }
+    void movbi(const Mem& dst, uint8_t imm) { rm({0xC6}, 0, dst); byte(imm); }
+    void movwi(const Mem& dst, uint16_t imm) {
+        byte(0x66);
+        rm({0xC7}, 0, dst);
+        byte(imm & 0xFF);
+        byte(imm >> 8);
+    }
+
+    void alu(Alu op, Reg dst, Reg src, bool wide = false) { rr({static_cast<uint8_t>(op * 8 + 1)}, src, dst, wide); }
+    void alui(Alu op, Reg dst, int32_t imm, bool wide = false) {
+        if (imm >= -128 && imm <= 127) {
+            rr({0x83}, op, dst, wide);
+            byte(imm);
+        } else {
+            rr({0x81}, op, dst, wide);
+            dword(imm);
+        }
+    }
+    // op byte [dst], imm or op byte [dst], src
+    void alub(Alu op, const Mem& dst, uint8_t imm) { rm({0x80}, op, dst); byte(imm); }
+    void alub(Alu op, const Mem& dst, Reg src) { rm({static_cast<uint8_t>(op * 8)}, src, dst); }
+    void testb(const Mem& dst, uint8_t imm) { rm({0xF6}, 0, dst); byte(imm); }
+    void test32(Reg a, Reg b) { rr({0x85}, b, a); }
+    void test64(Reg a, Reg b) { rr({0x85}, b, a, true); }
+    void shl(Reg dst, uint8_t count) { rr({0xC1}, 4, dst); byte(count); }
+    void shr(Reg dst, uint8_t count) { rr({0xC1}, 5, dst); byte(count); }
+    void setcc(Condition condition, Reg dst) { rr({0x0F, static_cast<uint8_t>(0x90 | condition)}, 0, dst); }
+
+    // Jumps are emitted with no target and return where they end, for bind()
+    uint8_t* jcc(Condition condition) {
+        byte(0x0F);
+        byte(0x80 | condition);
+        dword(0);
+        return out;
+    }
+    uint8_t* jmp() {
+        byte(0xE9);
+        dword(0);
+        return out;
+    }
+    void bind(uint8_t* jump, const uint8_t* target) {
+        int32_t offset = static_cast<int32_t>(target - jump);
+        std::memcpy(jump - 4, &offset, 4);
+    }
+
+    void push(Reg reg) { rex(false, 0, NO_REG, reg); byte(0x50 | (reg & 7)); }
+    void pop(Reg reg) { rex(false, 0, NO_REG, reg); byte(0x58 | (reg & 7)); }
+    void ret() { byte(0xC3); }
+
+private:
+    void byte(uint8_t value) { *out++ = value; }
+    void dword(uint32_t value) {
+        std::memcpy(out, &value, 4);
+        out += 4;
+    }
+
+    // reg is a register or the opcode extension in ModRM's reg field
+    void rex(bool wide, int reg, int index, int base) {
+        uint8_t bits = (wide ? 8 : 0) | (reg >= 8 ? 4 : 0) | (index >= 8 ? 2 : 0) | (base >= 8 ? 1 : 0);
+        if (bits != 0) {
+            byte(0x40 | bits);
+        }
+    }
+    void rm(std::initializer_list<uint8_t> opcode, int reg, const Mem& mem, bool wide = false) {
+        rex(wide, reg, mem.index, mem.base);
+        for (uint8_t b : opcode) {
+            byte(b);
+        }
+        // RBP and R13 as a base always take a displacement, RSP and R12 always take a SIB byte
+        int base = mem.base & 7;
+        int mod = (mem.disp == 0 && base != 5) ? 0 : (mem.disp >= -128 && mem.disp <= 127) ? 1 : 2;
+        if (mem.index == NO_REG && base != 4) {
+            byte(mod << 6 | (reg & 7) << 3 | base);
+        } else {
+            int scale = mem.scale == 8 ? 3 : mem.scale == 4 ? 2 : mem.scale == 2 ? 1 : 0;
+            int index = mem.index == NO_REG ? 4 : (mem.index & 7);
+            byte(mod << 6 | (reg & 7) << 3 | 4);
+            byte(scale << 6 | index << 3 | base);
+        }
+        if (mod == 1) {
+            byte(mem.disp);
+        } else if (mod == 2) {
+            dword(mem.disp);
+        }
+    }
+    void rr(std::initializer_list<uint8_t> opcode, int reg, int rmReg, bool wide = false) {
+        rex(wide, reg, NO_REG, rmReg);
+        for (uint8_t b : opcode) {
+            byte(b);
+        }
+        byte(0xC0 | (reg & 7) << 3 | (rmReg & 7));
+    }
+
+    uint8_t* out;
+};
+
+// What an instruction does, as far as translating it goes
+enum Kind {
+    UNSUPPORTED, LOAD, STORE, TRANSFER, AND, ORA, EOR, ADC, SBC, COMPARE, BIT, INCREMENT, DECREMENT,
+    ASL, LSR, ROL, ROR, JMP, JSR, RTS, RTI, PHA, PHP, PLA, PLP, CLEAR_FLAG, SET_FLAG, BRANCH, NOP
+};
+
+enum Register { REG_A, REG_X, REG_Y, REG_S };
+
+struct Operation {
+    Kind kind = UNSUPPORTED;
+    Register reg = REG_A;   // Register loaded, stored, compared, counted or transferred to
+    Register from = REG_A;  // Register transferred from
+    uint8_t flag = 0;       // Flag cleared or set
+};
+
+// The official opcodes other than BRK. Unofficial ones are rare enough to leave to the interpreter.
+Operation operationOf(const CPU::Instruction& instr) {
+    auto is = [&](int (CPU::*operation)(uint16_t)) { return instr.operation == operation; };
+    auto transfer = [](Register from, Register to) { return Operation{TRANSFER, to, from, 0}; };
+
+    if (is(&CPU::LDA)) return {LOAD, REG_A};
+    if (is(&CPU::LDX)) return {LOAD, REG_X};
+    if (is(&CPU::LDY)) return {LOAD, REG_Y};
+    if (is(&CPU::STA)) return {STORE, REG_A};
+    if (is(&CPU::STX)) return {STORE, REG_X};
+    if (is(&CPU::STY)) return {STORE, REG_Y};
+    if (is(&CPU::TAX)) return transfer(REG_A, REG_X);
+    if (is(&CPU::TAY)) return transfer(REG_A, REG_Y);
+    if (is(&CPU::TSX)) return transfer(REG_S, REG_X);
+    if (is(&CPU::TXA)) return transfer(REG_X, REG_A);
+    if (is(&CPU::TXS)) return transfer(REG_X, REG_S);
+    if (is(&CPU::TYA)) return transfer(REG_Y, REG_A);
+    if (is(&CPU::AND)) return {AND};
+    if (is(&CPU::ORA)) return {ORA};
+    if (is(&CPU::EOR)) return {EOR};
+    if (is(&CPU::ADC)) return {ADC};
+    if (is(&CPU::SBC)) return {SBC};
+    if (is(&CPU::CMP)) return {COMPARE, REG_A};
+    if (is(&CPU::CPX)) return {COMPARE, REG_X};
+    if (is(&CPU::CPY)) return {COMPARE, REG_Y};
+    if (is(&CPU::BIT)) return {BIT};
+    if (is(&CPU::INC)) return {INCREMENT};
+    if (is(&CPU::INX)) return {INCREMENT, REG_X};
+    if (is(&CPU::INY)) return {INCREMENT, REG_Y};
+    if (is(&CPU::DEC)) return {DECREMENT};
+    if (is(&CPU::DEX)) return {DECREMENT, REG_X};
+    if (is(&CPU::DEY)) return {DECREMENT, REG_Y};
+    if (is(&CPU::ASL)) return {ASL};
+    if (is(&CPU::LSR)) return {LSR};
+    if (is(&CPU::ROL)) return {ROL};
+    if (is(&CPU::ROR)) return {ROR};
+    if (is(&CPU::JMP)) return {JMP};
+    if (is(&CPU::JSR)) return {JSR};
+    if (is(&CPU::RTS)) return {RTS};
+    if (is(&CPU::RTI)) return {RTI};
+    if (is(&CPU::PHA)) return {PHA};
+    if (is(&CPU::PHP)) return {PHP};
+    if (is(&CPU::PLA)) return {PLA};
+    if (is(&CPU::PLP)) return {PLP};
+    if (is(&CPU::CLC)) return {CLEAR_FLAG, REG_A, REG_A, CPU::C};
+    if (is(&CPU::CLI)) return {CLEAR_FLAG, REG_A, REG_A, CPU::I};
+    if (is(&CPU::CLD)) return {CLEAR_FLAG, REG_A, REG_A, CPU::D};
+    if (is(&CPU::CLV)) return {CLEAR_FLAG, REG_A, REG_A, CPU::V};
+    if (is(&CPU::SEC)) return {SET_FLAG, REG_A, REG_A, CPU::C};
+    if (is(&CPU::SEI)) return {SET_FLAG, REG_A, REG_A, CPU::I};
+    if (is(&CPU::SED)) return {SET_FLAG, REG_A, REG_A, CPU::D};
+    if (instr.mode == CPU::RELATIVE) return {BRANCH};
+    // The unofficial NOPs with an operand still read it, which could be a register
+    if (is(&CPU::NOP) && instr.mode == CPU::IMPLICIT) return {NOP};
+    return {};
+}
+
+// Jumps and calls to a known address carry on translating there, branches carry on with the
+// instruction after them
+bool endsBlock(Kind kind, const CPU::Instruction& instr) {
+    return (kind == JMP && instr.mode == CPU::INDIRECT_JMP) || kind == RTS || kind == RTI;
+}
+
+// Registers and cartridge space below PRG RAM, which only the interpreter can touch
+bool ioAddress(uint16_t address) {
+    return address >= 0x2000 && address < 0x6000;
+}
+
+// Whether the address an instruction uses, when it's known before it runs, is plain memory.
+// Writes to PRG ROM go to the mapper. Indexed and indirect addresses are checked when they run.
+bool plainAddress(const CPU::Instruction& instr, uint16_t operand) {
+    if (instr.mode == CPU::INDIRECT_JMP) {
+        uint16_t high = (operand & 0xFF00) | ((operand + 1) & 0x00FF);
+        return !ioAddress(operand) && !ioAddress(high);
+    }
+    if ((instr.mode != CPU::ZERO_PAGE && instr.mode != CPU::ABSOLUTE) || instr.access == CPU::NONE) {
+        return true;
+    }
+    return !ioAddress(operand) && (instr.access == CPU::READ || operand < 0x8000);
+}
+
+// Where the CPU's registers are in a CPU object
+struct Fields {
+    int32_t a, x, y, s, pc, p;
+
+    explicit Fields(const CPU& cpu) {
+        auto offset = [&](const void* field) {
+            return static_cast<int32_t>(static_cast<const uint8_t*>(field) - reinterpret_cast<const uint8_t*>(&cpu));
+        };
+        a = offset(&cpu.A);
+        x = offset(&cpu.X);
+        y = offset(&cpu.Y);
+        s = offset(&cpu.S);
+        pc = offset(&cpu.PC);
+        p = offset(&cpu.P);
+    }
+};
+
+// Emits a block an instruction at a time. Every instruction first works out its address and
+// checks the pages it touches, leaving the block with PC on it if one isn't plain memory, and
+// only then counts its cycles and changes anything.
+class Translator {
+public:
+    Translator(Assembler& as, const Fields& fields) : as(as), fields(fields) {}
+
+    void prologue() {
+        for (Reg reg : {RBX, RBP, R12, R13, R14, R15}) {
+            as.push(reg);
+        }
+        as.mov64(CPU_REGISTERS, RDI);
+        as.mov64(CONTEXT, RSI);
+        as.mov64(RAM, RDX);
+        as.mov64(READ_PAGES, RCX);
+        as.mov64(WRITE_PAGES, R8);
+        as.alu(Assembler::XOR, CYCLES, CYCLES);
+    }
+
+    // index is how many of the block's instructions come before this one
+    void instruction(uint16_t pc, const CPU::Instruction& instr, const Operation& op, uint16_t operand, uint32_t index) {
+        exits.push_back({{}, pc, index, 0});
+        bool reads = instr.access == CPU::READ || instr.access == CPU::READ_MODIFY_WRITE;
+        bool writes = instr.access == CPU::WRITE || instr.access == CPU::READ_MODIFY_WRITE;
+
+        if (op.kind == JSR || op.kind == PHA || op.kind == PHP) {
+            // The stack is in CPU RAM, whose first page can be write protected for code
+            pagePointer(WRITE_POINTER, WRITE_PAGES, 0);
+        } else if (instr.mode == CPU::INDIRECT_JMP) {
+            staticRead(READ_POINTER, operand);
+            staticRead(R11, (operand & 0xFF00) | ((operand + 1) & 0x00FF));
+        } else if (reads || writes) {
+            address(instr, operand, reads, writes);
+        }
+
+        // Nothing can stop it now
+        as.store32(at(CONTEXT, offsetof(Recompiler::Context, lastStart)), CYCLES);
+        as.alui(Assembler::ADD, CYCLES, instr.cycles);
+        if (reads && instr.pageCross) {
+            as.alu(Assembler::ADD, CYCLES, CROSSED);
+        }
+
+        switch (op.kind) {
+            case LOAD:
+                value(instr, operand);
+                as.storeb(reg(op.reg), RAX);
+                setZN();
+                break;
+            case STORE:
+                as.movzxb(RAX, reg(op.reg));
+                as.storeb(at(WRITE_POINTER), RAX);
+                break;
+            case TRANSFER:
+                as.movzxb(RAX, reg(op.from));
+                as.storeb(reg(op.reg), RAX);
+                if (op.reg != REG_S) {
+                    setZN();
+                }
+                break;
+            case AND:
+            case ORA:
+            case EOR:
+                value(instr, operand);
+                as.movzxb(RCX, reg(REG_A));
+                as.alu(op.kind == AND ? Assembler::AND : op.kind == ORA ? Assembler::OR : Assembler::XOR, RAX, RCX);
+                as.storeb(reg(REG_A), RAX);
+                setZN();
+                break;
+            case ADC:
+            case SBC:
+                value(instr, operand);
+                // A - value - (1 - C) is A + ~value + C
+                if (op.kind == SBC) {
+                    as.alui(Assembler::XOR, RAX, 0xFF);
+                }
+                addWithCarry();
+                break;
+            case COMPARE:
+                value(instr, operand);
+                as.movzxb(RCX, reg(op.reg));
+                compare();
+                break;
+            case BIT:
+                value(instr, operand);
+                bit();
+                break;
+            case INCREMENT:
+            case DECREMENT:
+                if (instr.mode == CPU::IMPLICIT) {
+                    as.movzxb(RAX, reg(op.reg));
+                } else {
+                    as.movzxb(RAX, at(READ_POINTER));
+                }
+                as.alui(Assembler::ADD, RAX, op.kind == INCREMENT ? 1 : -1);
+                as.alui(Assembler::AND, RAX, 0xFF);
+                if (instr.mode == CPU::IMPLICIT) {
+                    as.storeb(reg(op.reg), RAX);
+                } else {
+                    as.storeb(at(WRITE_POINTER), RAX);
+                }
+                setZN();
+                break;
+            case ASL:
+            case LSR:
+            case ROL:
+            case ROR:
+                shift(instr, op.kind);
+                break;
+            case JMP:
+                if (instr.mode == CPU::INDIRECT_JMP) {
+                    as.movzxb(RAX, at(READ_POINTER));
+                    as.movzxb(RCX, at(R11));
+                    as.shl(RCX, 8);
+                    as.alu(Assembler::OR, RAX, RCX);
+                    as.storew(reg16PC(), RAX);
+                } else {
+                    as.movwi(reg16PC(), operand);
+                }
+                break;
+            case JSR: {
+                // Pushes the address of its last byte, the low byte goes 0x100 + S - 1 even when
+                // S wraps, like stack_push16()
+                uint16_t last = pc + 2;
+                as.movzxb(RCX, reg(REG_S));
+                as.movbi(at(WRITE_POINTER, RCX, 1, 0x100), last >> 8);
+                as.movbi(at(WRITE_POINTER, RCX, 1, 0xFF), last & 0xFF);
+                as.alub(Assembler::SUB, reg(REG_S), 2);
+                as.movwi(reg16PC(), operand);
+                break;
+            }
+            case RTS:
+                as.movzxb(RCX, reg(REG_S));
+                pop(RAX);
+                pop(RDX);
+                as.storeb(reg(REG_S), RCX);
+                as.shl(RDX, 8);
+                as.alu(Assembler::OR, RAX, RDX);
+                as.alui(Assembler::ADD, RAX, 1);
+                as.storew(reg16PC(), RAX);
+                break;
+            case RTI:
+                as.movzxb(RCX, reg(REG_S));
+                pop(RAX);
+                pulledFlags();
+                pop(RAX);
+                pop(RDX);
+                as.storeb(reg(REG_S), RCX);
+                as.shl(RDX, 8);
+                as.alu(Assembler::OR, RAX, RDX);
+                as.storew(reg16PC(), RAX);
+                break;
+            case PHA:
+                as.movzxb(RAX, reg(REG_A));
+                push();
+                break;
+            case PHP:
+                // Pushed with B and U, and U stays set
+                as.movzxb(RAX, reg16P());
+                as.alui(Assembler::OR, RAX, CPU::B | CPU::U);
+                push();
+                as.alui(Assembler::AND, RAX, ~CPU::B & 0xFF);
+                as.storeb(reg16P(), RAX);
+                break;
+            case PLA:
+                as.movzxb(RCX, reg(REG_S));
+                pop(RAX);
+                as.storeb(reg(REG_S), RCX);
+                as.storeb(reg(REG_A), RAX);
+                setZN();
+                break;
+            case PLP:
+                as.movzxb(RCX, reg(REG_S));
+                pop(RAX);
+                as.storeb(reg(REG_S), RCX);
+                pulledFlags();
+                break;
+            case CLEAR_FLAG:
+                as.alub(Assembler::AND, reg16P(), static_cast<uint8_t>(~op.flag));
+                break;
+            case SET_FLAG:
+                as.alub(Assembler::OR, reg16P(), op.flag);
+                break;
+            case BRANCH:
+                branch(pc, instr, operand, index + 1);
+                break;
+            case NOP:
+            case UNSUPPORTED:
+                break;
+        }
+    }
+
+    // End the block after count instructions, setting PC to next if the last one didn't
+    void finish(uint32_t count, bool setPC, uint16_t next) {
+        if (setPC) {
+            as.movwi(reg16PC(), next);
+        }
+        as.movi(RAX, count);
+        const uint8_t* epilogue = as.here();
+        as.store32(at(CONTEXT, offsetof(Recompiler::Context, cycles)), CYCLES);
+        for (Reg reg : {R15, R14, R13, R12, RBP, RBX}) {
+            as.pop(reg);
+        }
+        as.ret();
+
+        // Leaving early, from a taken branch or with nothing of an instruction done
+        for (const Exit& exit : exits) {
+            if (exit.jumps.empty()) {
+                continue;
+            }
+            for (uint8_t* jump : exit.jumps) {
+                as.bind(jump, as.here());
+            }
+            if (exit.cycles != 0) {
+                as.alui(Assembler::ADD, CYCLES, exit.cycles);
+            }
+            as.movwi(reg16PC(), exit.pc);
+            as.movi(RAX, exit.index);
+            as.bind(as.jmp(), epilogue);
+        }
+    }
+
+private:
+    // Where the block can leave early, with PC and the instructions and extra cycles run
+    struct Exit {
+        std::vector<uint8_t*> jumps;
+        uint16_t pc;
+        uint32_t index;
+        int cycles;
+    };
+
+    Mem reg(Register r) const {
+        const int32_t offsets[] = {fields.a, fields.x, fields.y, fields.s};
+        return at(CPU_REGISTERS, offsets[r]);
+    }
+    Mem reg16PC() const { return at(CPU_REGISTERS, fields.pc); }
+    Mem reg16P() const { return at(CPU_REGISTERS, fields.p); }
+
+    // Leave the block on the current instruction if dst is null
+    void exitIfNull(Reg dst) {
+        as.test64(dst, dst);
+        exits.back().jumps.push_back(as.jcc(Assembler::EQUAL));
+    }
+
+    // dst = pages[page], which has to be memory
+    void pagePointer(Reg dst, Reg pages, int page) {
+        as.load64(dst, at(pages, page * 8));
+        exitIfNull(dst);
+    }
+
+    void staticRead(Reg dst, uint16_t address) {
+        if (address < 0x2000) {
+            as.lea64(dst, at(RAM, address & 0x07FF));
+            return;
+        }
+        pagePointer(dst, READ_PAGES, address >> 10);
+        as.alui(Assembler::ADD, dst, address & 0x03FF, true);
+    }
+
+    void staticWrite(Reg dst, uint16_t address) {
+        pagePointer(dst, WRITE_PAGES, address >> 10);
+        as.alui(Assembler::ADD, dst, address & 0x03FF, true);
+    }
+
+    // Look up the address in ECX in the page tables
+    void dynamicAddress(bool reads, bool writes) {
+        as.mov32(RDX, RCX);
+        as.shr(RDX, 10);
+        if (reads) {
+            as.load64(READ_POINTER, at(READ_PAGES, RDX, 8));
+            exitIfNull(READ_POINTER);
+        }
+        if (writes) {
+            as.load64(WRITE_POINTER, at(WRITE_PAGES, RDX, 8));
+            exitIfNull(WRITE_POINTER);
+        }
+        as.alui(Assembler::AND, RCX, 0x03FF);
+        if (reads) {
+            as.alu(Assembler::ADD, READ_POINTER, RCX, true);
+        }
+        if (writes) {
+            as.alu(Assembler::ADD, WRITE_POINTER, RCX, true);
+        }
+    }
+
+    // READ_POINTER and WRITE_POINTER for the instruction's address, the same as resolveOperand()
+    void address(const CPU::Instruction& instr, uint16_t operand, bool reads, bool writes) {
+        switch (instr.mode) {
+            case CPU::ZERO_PAGE:
+            case CPU::ABSOLUTE:
+                if (reads) {
+                    staticRead(READ_POINTER, operand);
+                }
+                if (writes) {
+                    staticWrite(WRITE_POINTER, operand);
+                }
+                break;
+            case CPU::ZERO_PAGE_X:
+            case CPU::ZERO_PAGE_Y:
+                as.movzxb(RCX, reg(instr.mode == CPU::ZERO_PAGE_X ? REG_X : REG_Y));
+                as.alui(Assembler::ADD, RCX, operand & 0xFF);
+                as.movzxb(RCX, RCX);
+                if (reads) {
+                    as.lea64(READ_POINTER, at(RAM, RCX, 1));
+                }
+                if (writes) {
+                    pagePointer(WRITE_POINTER, WRITE_PAGES, 0);
+                    as.alu(Assembler::ADD, WRITE_POINTER, RCX, true);
+                }
+                break;
+            case CPU::ABSOLUTE_X:
+            case CPU::ABSOLUTE_Y:
+                as.movzxb(RDX, reg(instr.mode == CPU::ABSOLUTE_X ? REG_X : REG_Y));
+                if (instr.pageCross) {
+                    // The high byte changes when the low byte carries
+                    as.mov32(CROSSED, RDX);
+                    as.alui(Assembler::ADD, CROSSED, operand & 0xFF);
+                    as.shr(CROSSED, 8);
+                }
+                as.mov32(RCX, RDX);
+                as.alui(Assembler::ADD, RCX, operand);
+                as.alui(Assembler::AND, RCX, 0xFFFF);
+                dynamicAddress(reads, writes);
+                break;
+            case CPU::INDIRECT_X:
+                // The pointer wraps around the zero page
+                as.movzxb(RCX, reg(REG_X));
+                as.alui(Assembler::ADD, RCX, operand & 0xFF);
+                as.movzxb(RCX, RCX);
+                as.movzxb(RAX, at(RAM, RCX, 1));
+                as.alui(Assembler::ADD, RCX, 1);
+                as.movzxb(RCX, RCX);
+                as.movzxb(RCX, at(RAM, RCX, 1));
+                as.shl(RCX, 8);
+                as.alu(Assembler::OR, RCX, RAX);
+                dynamicAddress(reads, writes);
+                break;
+            case CPU::INDIRECT_Y:
+                as.movzxb(RAX, at(RAM, operand & 0xFF));
+                as.movzxb(RCX, at(RAM, (operand + 1) & 0xFF));
+                as.shl(RCX, 8);
+                as.movzxb(RDX, reg(REG_Y));
+                as.alu(Assembler::ADD, RAX, RDX);
+                if (instr.pageCross) {
+                    as.mov32(CROSSED, RAX);
+                    as.shr(CROSSED, 8);
+                }
+                as.alu(Assembler::ADD, RCX, RAX);
+                as.alui(Assembler::AND, RCX, 0xFFFF);
+                dynamicAddress(reads, writes);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // EAX = the byte the instruction reads
+    void value(const CPU::Instruction& instr, uint16_t operand) {
+        if (instr.mode == CPU::IMMEDIATE) {
+            as.movi(RAX, operand & 0xFF);
+        } else {
+            as.movzxb(RAX, at(READ_POINTER));
+        }
+    }
+
+    // Replace the flags in mask with the bits in bits
+    void setFlags(uint8_t mask, Reg bits) {
+        as.alub(Assembler::AND, reg16P(), static_cast<uint8_t>(~mask));
+        as.alub(Assembler::OR, reg16P(), bits);
+    }
+
+    // Z and N for the byte in EAX
+    void setZN() {
+        as.movzxb(RDX, at(CONTEXT, RAX, 1, ZN_TABLE));
+        setFlags(CPU::Z | CPU::N, RDX);
+    }
+
+    // A + EAX + C, like CPU::addWithCarry()
+    void addWithCarry() {
+        as.movzxb(RCX, reg(REG_A));
+        as.movzxb(RDX, reg16P());
+        as.alui(Assembler::AND, RDX, CPU::C);
+        as.alu(Assembler::ADD, RDX, RAX);
+        as.alu(Assembler::ADD, RDX, RCX);
+        // V if both inputs have the same sign and the result doesn't
+        as.mov32(RSI, RDX);
+        as.alu(Assembler::XOR, RSI, RCX);
+        as.mov32(RDI, RDX);
+        as.alu(Assembler::XOR, RDI, RAX);
+        as.alu(Assembler::AND, RSI, RDI);
+        as.alui(Assembler::AND, RSI, 0x80);
+        as.shr(RSI, 1);
+        // C from the ninth bit
+        as.mov32(RDI, RDX);
+        as.shr(RDI, 8);
+        as.alu(Assembler::OR, RSI, RDI);
+        as.movzxb(RDX, RDX);
+        as.movzxb(RDI, at(CONTEXT, RDX, 1, ZN_TABLE));
+        as.alu(Assembler::OR, RSI, RDI);
+        as.storeb(reg(REG_A), RDX);
+        as.mov32(RCX, RSI);
+        setFlags(CPU::C | CPU::V | CPU::Z | CPU::N, RCX);
+    }
+
+    // Register in ECX against EAX, like CPU::compare()
+    void compare() {
+        as.alu(Assembler::SUB, RCX, RAX);
+        as.setcc(Assembler::ABOVE_EQUAL, RDX);
+        as.movzxb(RDX, RDX);
+        as.movzxb(RCX, RCX);
+        as.movzxb(RAX, at(CONTEXT, RCX, 1, ZN_TABLE));
+        as.alu(Assembler::OR, RAX, RDX);
+        setFlags(CPU::C | CPU::Z | CPU::N, RAX);
+    }
+
+    // N and V from EAX, Z from A & EAX
+    void bit() {
+        as.movzxb(RCX, reg(REG_A));
+        as.alu(Assembler::AND, RCX, RAX);
+        as.test32(RCX, RCX);
+        as.setcc(Assembler::EQUAL, RCX);
+        as.movzxb(RCX, RCX);
+        as.alu(Assembler::ADD, RCX, RCX);
+        as.alui(Assembler::AND, RAX, CPU::N | CPU::V);
+        as.alu(Assembler::OR, RAX, RCX);
+        setFlags(CPU::Z | CPU::V | CPU::N, RAX);
+    }
+
+    void shift(const CPU::Instruction& instr, Kind kind) {
+        bool accumulator = instr.mode == CPU::ACCUMULATOR;
+        as.movzxb(RAX, accumulator ? reg(REG_A) : at(READ_POINTER));
+        // ECX = the bit going out into C
+        as.mov32(RCX, RAX);
+        if (kind == ASL || kind == ROL) {
+            as.shr(RCX, 7);
+        } else {
+            as.alui(Assembler::AND, RCX, 1);
+        }
+        if (kind == ROL || kind == ROR) {
+            as.movzxb(RDX, reg16P());
+            as.alui(Assembler::AND, RDX, CPU::C);
+        }
+        if (kind == ASL || kind == ROL) {
+            as.alu(Assembler::ADD, RAX, RAX);
+            if (kind == ROL) {
+                as.alu(Assembler::OR, RAX, RDX);
+            }
+            as.movzxb(RAX, RAX);
+        } else {
+            as.shr(RAX, 1);
+            if (kind == ROR) {
+                as.shl(RDX, 7);
+                as.alu(Assembler::OR, RAX, RDX);
+            }
+        }
+        as.storeb(accumulator ? reg(REG_A) : at(WRITE_POINTER), RAX);
+        as.movzxb(RDX, at(CONTEXT, RAX, 1, ZN_TABLE));
+        as.alu(Assembler::OR, RCX, RDX);
+        setFlags(CPU::C | CPU::Z | CPU::N, RCX);
+    }
+
+    // EAX at S, S in ECX
+    void push() {
+        as.movzxb(RCX, reg(REG_S));
+        as.storeb(at(WRITE_POINTER, RCX, 1, 0x100), RAX);
+        as.alub(Assembler::SUB, reg(REG_S), 1);
+    }
+
+    // S in ECX goes up one and dst is what's there
+    void pop(Reg dst) {
+        as.alui(Assembler::ADD, RCX, 1);
+        as.movzxb(RCX, RCX);
+        as.movzxb(dst, at(RAM, RCX, 1, 0x100));
+    }
+
+    // P from the byte in EAX, which never has B and always has U
+    void pulledFlags() {
+        as.alui(Assembler::AND, RAX, ~CPU::B & 0xFF);
+        as.alui(Assembler::OR, RAX, CPU::U);
+        as.storeb(reg16P(), RAX);
+    }
+
+    // Leave the block with count instructions run if the branch is taken, otherwise carry on
+    void branch(uint16_t pc, const CPU::Instruction& instr, uint16_t operand, uint32_t count) {
+        // Branch opcodes pick N, V, C or Z with their top two bits and are taken when it's set with bit 5
+        static const uint8_t BRANCH_FLAGS[4] = {CPU::N, CPU::V, CPU::C, CPU::Z};
+        uint8_t opcode = &instr - CPU_INSTRUCTIONS.data();
+        uint16_t next = pc + 2;
+        uint16_t target = next + static_cast<int8_t>(operand);
+        // One cycle more when taken, two if it lands in another page
+        int taken = ((target & 0xFF00) != (next & 0xFF00)) ? 2 : 1;
+
+        as.testb(reg16P(), BRANCH_FLAGS[opcode >> 6]);
+        uint8_t* jump = as.jcc((opcode & 0x20) ? Assembler::NOT_EQUAL : Assembler::EQUAL);
+        exits.push_back({{jump}, target, count, taken});
+    }
+
+    Assembler& as;
+    const Fields& fields;
+    std::vector<Exit> exits;
+};
+
+} // namespace
+#endif
+
+Recompiler::Recompiler(Bus& bus) : bus(bus), prgSize(bus.rom->prgSize) {
+    size_t offsets = prgSize + bus.cpuRam.size() + bus.prgRam.size();
+    hits.resize(offsets);
+    blockIndex.resize(offsets, NOT_TRANSLATED);
+    std::copy(ZN_FLAGS.begin(), ZN_FLAGS.end(), context.zn.begin());
+#ifdef RECOMPILER_X86_64
+    // Only writable while a block is being generated
+    void* memory = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED) {
+        code = static_cast<uint8_t*>(memory);
+    }
+#endif
+}
+
+Recompiler::~Recompiler() {
+#ifdef RECOMPILER_X86_64
+    if (code != nullptr) {
+        munmap(code, CODE_SIZE);
+    }
+#endif
+}
+
+int32_t Recompiler::codeOffset(uint16_t pc) const {
+    if (pc < 0x2000) {
+        return ramStart() + (pc & 0x07FF);
+    }
+    if (pc >= 0x6000 && pc < 0x8000) {
+        return ramStart() + bus.cpuRam.size() + (pc - 0x6000);
+    }
+    if (pc >= 0x8000) {
+        // Mappers can put something other than PRG ROM there
+        ptrdiff_t offset = bus.prgROMByte(pc) - bus.rom->prgRom;
+        if (offset >= 0 && static_cast<size_t>(offset) < prgSize) {
+            return static_cast<int32_t>(offset);
+        }
+    }
+    return -1;
+}
+
+uint8_t* Recompiler::ramPage(int32_t offset) const {
+    size_t ram = offset - ramStart();
+    if (ram < bus.cpuRam.size()) {
+        return &bus.cpuRam[ram & ~(Bus::PAGE_SIZE - 1)];
+    }
+    return &bus.prgRam[(ram - bus.cpuRam.size()) & ~(Bus::PAGE_SIZE - 1)];
+}
+
+const Recompiler::Block* Recompiler::lookup(uint16_t pc) {
+    int32_t offset = codeOffset(pc);
+    if (offset < 0) {
+        return nullptr;
+    }
+
+    int32_t& index = blockIndex[offset];
+    // The same bytes seen at another PC, through a mirror or another window, jump and return
+    // somewhere else
+    if (index >= 0 && blocks[index].pc != pc) {
+        index = NOT_TRANSLATED;
+        hits[offset] = 0;
+    }
+    if (index == NOT_TRANSLATED) {
+        if (++hits[offset] < HOT_THRESHOLD) {
+            return nullptr;
+        }
+        index = translate(pc);
+        // Whatever was made of RAM, even nothing, has to be made again once it's written
+        if (offset >= ramStart()) {
+            uint8_t* page = ramPage(offset);
+            if (std::find(protectedPages.begin(), protectedPages.end(), page) == protectedPages.end()) {
+                protectedPages.push_back(page);
+                bus.protectCode(page);
+            }
+        }
+    }
+    return index >= 0 ? &blocks[index] : nullptr;
+}
+
+int32_t Recompiler::translate(uint16_t pc) {
+#ifdef RECOMPILER_X86_64
+    if (code == nullptr) {
+        return INTERPRET;
+    }
+    if (CODE_SIZE - codeUsed < MAX_BLOCK_SIZE) {
+        flush();
+    }
+    if (mprotect(code, CODE_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        return INTERPRET;
+    }
+
+    // Blocks stay in the 8KB PRG window or 1KB RAM page they start in, running off the edge or
+    // jumping out ends them. What's outside can change without this side changing.
+    uint32_t begin = pc >= 0x8000 ? (pc & 0xE000) : (pc & 0xFC00);
+    uint32_t end = pc >= 0x8000 ? (pc | 0x1FFF) : (pc | 0x03FF);
+    uint8_t* start = code + codeUsed;
+    Assembler as(start);
+    Fields fields(*bus.cpu);
+    Translator translator(as, fields);
+    translator.prologue();
+
+    uint32_t address = pc;
+    uint32_t count = 0;
+    int maxCycles = 0;
+    bool jumped = false;
+    while (count < MAX_BLOCK_INSTRUCTIONS && address <= end) {
+        uint8_t opcode = bus.read(address);
+        const CPU::Instruction& instr = CPU_INSTRUCTIONS[opcode];
+        if (address + instr.length - 1 > end) {
+            break;
+        }
+        uint16_t operand = 0;
+        if (instr.length > 1) {
+            operand = bus.read(address + 1);
+        }
+        if (instr.length > 2) {
+            operand |= bus.read(address + 2) << 8;
+        }
+        Operation op = operationOf(instr);
+        if (op.kind == UNSUPPORTED || !plainAddress(instr, operand)) {
+            break;
+        }
+
+        translator.instruction(address, instr, op, operand, count);
+        count++;
+        maxCycles += instr.cycles + instr.pageCross + (op.kind == BRANCH ? 2 : 0);
+        address += instr.length;
+        if (endsBlock(op.kind, instr)) {
+            jumped = true;
+            break;
+        }
+        if (op.kind == JMP || op.kind == JSR) {
+            // Somewhere else, so PC is already set if the block ends on it
+            if (operand < begin || operand > end) {
+                jumped = true;
+                break;
+            }
+            address = operand;
+        }
+    }
+
+    int32_t index = INTERPRET;
+    if (count > 0) {
+        translator.finish(count, !jumped, address);
+        // Start every block on a cache line
+        codeUsed = (as.here() - code + 63) & ~static_cast<size_t>(63);
+        Block block;
+        block.code = reinterpret_cast<BlockCode>(start);
+        block.pc = pc;
+        block.maxCycles = maxCycles;
+        index = blocks.size();
+        blocks.push_back(block);
+        compiled++;
+    }
+    mprotect(code, CODE_SIZE, PROT_READ | PROT_EXEC);
+    return index;
+#else
+    (void)pc;
+    return INTERPRET;
+#endif
+}
+
+Recompiler::Result Recompiler::run(const Block& block) {
+    context.cycles = 0;
+    context.lastStart = 0;
+    uint32_t instructions = block.code(bus.cpu.get(), &context, bus.cpuRam.data(), bus.readPages.data(),
+                                       bus.writePages.data());
+    return {instructions, context.cycles, context.lastStart};
+}
+
+void Recompiler::invalidatePage(uint8_t* page) {
+    size_t first;
+    if (page >= bus.cpuRam.data() && page < bus.cpuRam.data() + bus.cpuRam.size()) {
+        first = ramStart() + (page - bus.cpuRam.data());
+    } else {
+        first = ramStart() + bus.cpuRam.size() + (page - bus.prgRam.data());
+    }
+    std::fill(blockIndex.begin() + first, blockIndex.begin() + first + Bus::PAGE_SIZE, NOT_TRANSLATED);
+    std::fill(hits.begin() + first, hits.begin() + first + Bus::PAGE_SIZE, 0);
+
+    auto found = std::find(protectedPages.begin(), protectedPages.end(), page);
+    if (found != protectedPages.end()) {
+        protectedPages.erase(found);
+    }
+    bus.unprotectCode(page);
+}
+
+void Recompiler::invalidateRAM() {
+    std::vector<uint8_t*> pages = protectedPages;
+    for (uint8_t* page : pages) {
+        invalidatePage(page);
+    }
+}
+
+void Recompiler::flush() {
+    invalidateRAM();
+    blocks.clear();
+    std::fill(blockIndex.begin(), blockIndex.end(), NOT_TRANSLATED);
+    std::fill(hits.begin(), hits.end(), 0);
+    codeUsed = 0;
+}
@@ -0,0 +1,121 @@
+#ifndef RECOMPILER_H
+#define RECOMPILER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Bus.h"
+
+// Native code generation is only written for x86-64 with the System V calling convention, anywhere
+// else the recompiler never translates anything and the bus interprets as usual
+#if defined(__x86_64__) && !defined(_WIN32)
+#define RECOMPILER_X86_64 1
+#endif
+
+class CPU;
+
+// Translates straight line runs of code that keep getting run into x86-64 machine code, which
+// works on the CPU's own registers so save states, the debugger and the interpreter all see the
+// same machine. Only instructions whose memory is plain RAM or ROM are translated. One whose
+// address turns out to be a register or mapper when it runs leaves the block with PC on it, so the
+// interpreter runs it like any other.
+//
+// Blocks are found by PC and by where their first byte is in memory, so switching a bank never
+// runs the old bank's code. Blocks in RAM write protect their 1KB page through the bus's page
+// tables, and any write to it drops them before it lands.
+class Recompiler {
+public:
+    explicit Recompiler(Bus& bus);
+    ~Recompiler();
+
+    Recompiler(const Recompiler&) = delete;
+    Recompiler& operator=(const Recompiler&) = delete;
+
+    // Whether this build can generate code at all
+#ifdef RECOMPILER_X86_64
+    static constexpr bool AVAILABLE = true;
+#else
+    static constexpr bool AVAILABLE = false;
+#endif
+
+    // Counters and flag table the generated code uses, kept together so one register reaches them
+    struct Context {
+        uint32_t cycles = 0;     // Cycles of the instructions run so far
+        uint32_t lastStart = 0;  // Cycles before the last of them started
+        std::array<uint8_t, 256> zn{};
+    };
+
+    // Called with the CPU, its context, CPU RAM and the bus's read and write pages. Returns how
+    // many instructions it ran, PC is left on the next one.
+    typedef uint32_t (*BlockCode)(CPU* cpu, Context* context, uint8_t* ram, uint8_t* const* readPages,
+                                  uint8_t* const* writePages);
+
+    struct Block {
+        BlockCode code = nullptr;
+        uint16_t pc = 0;
+        // Most cycles it can take, the bus only runs it when nothing is due before then
+        int maxCycles = 0;
+    };
+
+    struct Result {
+        uint32_t instructions;
+        uint32_t cycles;
+        uint32_t lastStart;
+    };
+
+    // Times an address has to start a block before it gets translated
+    static constexpr int HOT_THRESHOLD = 8;
+    // Longest block, so one still fits in before most events
+    static constexpr int MAX_BLOCK_INSTRUCTIONS = 32;
+
+    // Block starting at pc in the current memory map, nullptr while pc isn't in RAM or PRG ROM,
+    // isn't hot yet or starts with an instruction the interpreter has to run
+    const Block* lookup(uint16_t pc);
+    // Run a block from lookup() on the bus's CPU. Nothing but the CPU and the memory it writes
+    // changes, the caller accounts for the cycles.
+    Result run(const Block& block);
+
+    // Drop every block in RAM, for when RAM is replaced without going through the bus
+    void invalidateRAM();
+    // Drop the blocks in the RAM page starting at page and let writes through to it again
+    void invalidatePage(uint8_t* page);
+
+    size_t blocksCompiled() const { return compiled; }
+
+private:
+    static constexpr int32_t NOT_TRANSLATED = -1;
+    static constexpr int32_t INTERPRET = -2;
+    // Code space, everything is dropped and translated again once it's full
+    static constexpr size_t CODE_SIZE = 4 * 1024 * 1024;
+    // Room one block can take at most
+    static constexpr size_t MAX_BLOCK_SIZE = 8 * 1024;
+
+    // Offset of the byte at pc in hits and blockIndex: PRG ROM image first, then CPU RAM, then
+    // PRG RAM. -1 if pc isn't in any of them.
+    int32_t codeOffset(uint16_t pc) const;
+    // First offset of the RAM pages, and the host memory of the RAM page holding offset
+    int32_t ramStart() const { return static_cast<int32_t>(prgSize); }
+    uint8_t* ramPage(int32_t offset) const;
+
+    // Generate the block at pc, INTERPRET if its first instruction can't be translated
+    int32_t translate(uint16_t pc);
+    // Drop every block and start filling the code space again
+    void flush();
+
+    Bus& bus;
+    size_t prgSize = 0;
+    // Both indexed by codeOffset()
+    std::vector<uint16_t> hits;
+    std::vector<int32_t> blockIndex;
+    std::vector<Block> blocks;
+    size_t compiled = 0;
+    // RAM pages write protected because they hold translated code, by host address
+    std::vector<uint8_t*> protectedPages;
+
+    Context context;
+    uint8_t* code = nullptr;
+    size_t codeUsed = 0;
+};
+
+#endif // RECOMPILER_H
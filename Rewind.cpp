@@ -0,0 +1,186 @@
+#include "Rewind.h"
+
+#include <algorithm>
+#include <cstring>
+
+Rewind::Rewind(size_t capacity, size_t keyframeInterval)
+    : frameCapacity(capacity), interval(std::max<size_t>(keyframeInterval, 1)) {}
+
+void Rewind::setCapacity(size_t frames) {
+    frameCapacity = frames;
+    if (frameCapacity == 0) {
+        clear();
+    }
+}
+
+size_t Rewind::capacity() const {
+    return frameCapacity;
+}
+
+size_t Rewind::frames() const {
+    return stored;
+}
+
+size_t Rewind::bytes() const {
+    return storedBytes;
+}
+
+void Rewind::clear() {
+    groups.clear();
+    keyframe.clear();
+    stored = 0;
+    storedBytes = 0;
+}
+
+void Rewind::push(const std::vector<uint8_t>& state) {
+    if (frameCapacity == 0) {
+        return;
+    }
+
+    // States only differ in size after a different ROM, which can't share a keyframe
+    if (groups.empty() || groups.back().deltas.size() + 1 >= interval || state.size() != keyframe.size()) {
+        groups.emplace_back();
+        Group& group = groups.back();
+        group.stateSize = state.size();
+        encode(state, {}, group.keyframe);
+        keyframe = state;
+        storedBytes += group.keyframe.size();
+    } else {
+        Group& group = groups.back();
+        group.deltas.emplace_back();
+        encode(state, keyframe, group.deltas.back());
+        storedBytes += group.deltas.back().size();
+    }
+    stored++;
+
+    // Deltas need their keyframe, so the oldest frames go a whole group at a time
+    while (stored > frameCapacity && groups.size() > 1) {
+        Group& oldest = groups.front();
+        stored -= 1 + oldest.deltas.size();
+        storedBytes -= oldest.keyframe.size();
+        for (const std::vector<uint8_t>& delta : oldest.deltas) {
+            storedBytes -= delta.size();
+        }
+        groups.pop_front();
+    }
+}
+
+bool Rewind::pop() {
+    if (groups.empty()) {
+        return false;
+    }
+    Group& newest = groups.back();
+    if (!newest.deltas.empty()) {
+        storedBytes -= newest.deltas.back().size();
+        newest.deltas.pop_back();
+    } else {
+        storedBytes -= newest.keyframe.size();
+        groups.pop_back();
+        // Later deltas are taken against the keyframe of the group now newest
+        keyframe.clear();
+        if (!groups.empty()) {
+            keyframe.assign(groups.back().stateSize, 0x00);
+            apply(groups.back().keyframe, keyframe);
+        }
+    }
+    stored--;
+    return true;
+}
+
+bool Rewind::latest(std::vector<uint8_t>& state) const {
+    if (groups.empty()) {
+        return false;
+    }
+    state = keyframe;
+    if (!groups.back().deltas.empty()) {
+        apply(groups.back().deltas.back(), state);
+    }
+    return true;
+}
+
+static void putVarint(std::vector<uint8_t>& out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static size_t getVarint(const uint8_t*& data) {
+    size_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = *data++;
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+}
+
+void Rewind::encode(const std::vector<uint8_t>& state, const std::vector<uint8_t>& base, std::vector<uint8_t>& out) {
+    out.clear();
+    const size_t size = state.size();
+    const uint8_t* a = state.data();
+    auto difference = [&](size_t i) -> uint8_t {
+        return base.empty() ? a[i] : a[i] ^ base[i];
+    };
+
+    size_t i = 0;
+    while (i < size) {
+        // Matching bytes, skipped 8 at a time where possible
+        size_t start = i;
+        while (i + 8 <= size) {
+            uint64_t left = 0;
+            uint64_t right = 0;
+            std::memcpy(&left, a + i, 8);
+            if (!base.empty()) {
+                std::memcpy(&right, base.data() + i, 8);
+            }
+            if (left != right) {
+                break;
+            }
+            i += 8;
+        }
+        while (i < size && difference(i) == 0) {
+            i++;
+        }
+        putVarint(out, i - start);
+
+        // Differing bytes, up to the next run of 4 matching ones. Shorter runs cost more to
+        // encode than to copy.
+        start = i;
+        size_t end = i;
+        while (end < size) {
+            if (difference(end) != 0) {
+                end++;
+                continue;
+            }
+            size_t zeros = 0;
+            while (zeros < 4 && end + zeros < size && difference(end + zeros) == 0) {
+                zeros++;
+            }
+            if (zeros == 4 || end + zeros == size) {
+                break;
+            }
+            end += zeros;
+        }
+        putVarint(out, end - start);
+        for (size_t j = start; j < end; j++) {
+            out.push_back(difference(j));
+        }
+        i = end;
+    }
+}
+
+void Rewind::apply(const std::vector<uint8_t>& encoded, std::vector<uint8_t>& state) {
+    const uint8_t* data = encoded.data();
+    const uint8_t* end = data + encoded.size();
+    size_t position = 0;
+    while (data < end) {
+        position += getVarint(data);
+        size_t count = getVarint(data);
+        for (size_t j = 0; j < count; j++) {
+            state[position++] ^= *data++;
+        }
+    }
+}
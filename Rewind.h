@@ -0,0 +1,55 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// The save states of the last few seconds of frames, newest last, to step back through.
+// States are kept in groups: the first of each group is a keyframe and the rest are XORed with
+// it, which leaves mostly zeros since little of the machine changes within a second. Everything
+// is then run length encoded, so a minute of frames takes a small fraction of the whole states.
+class Rewind {
+public:
+    explicit Rewind(size_t capacity = 0, size_t keyframeInterval = 60);
+
+    // Frames kept before the oldest start being dropped, 0 keeps none
+    void setCapacity(size_t frames);
+    size_t capacity() const;
+    // Frames stored and the bytes they take
+    size_t frames() const;
+    size_t bytes() const;
+    void clear();
+
+    // Store the state of a new frame, dropping the oldest group once over capacity
+    void push(const std::vector<uint8_t>& state);
+    // Forget the newest frame, false if there wasn't one
+    bool pop();
+    // Decode the newest frame's state, false if there isn't one
+    bool latest(std::vector<uint8_t>& state) const;
+
+    // Run length encode state XOR base into out, an empty base stands for all zeros. The output
+    // alternates a run of matching bytes and a run of differing ones, each count a LEB128 varint
+    // and the differing run followed by its XORed bytes.
+    static void encode(const std::vector<uint8_t>& state, const std::vector<uint8_t>& base, std::vector<uint8_t>& out);
+    // XOR encoded data back into state
+    static void apply(const std::vector<uint8_t>& encoded, std::vector<uint8_t>& state);
+
+private:
+    struct Group {
+        std::vector<uint8_t> keyframe;                  // Encoded against zeros
+        std::vector<std::vector<uint8_t>> deltas;       // Encoded against the keyframe
+        size_t stateSize = 0;
+    };
+
+    std::deque<Group> groups;
+    // The newest group's keyframe decoded, what new deltas are taken against
+    std::vector<uint8_t> keyframe;
+    size_t frameCapacity;
+    size_t interval;
+    size_t stored = 0;
+    size_t storedBytes = 0;
+};
+
+#endif // REWIND_H
@@ -0,0 +1,78 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Save states are each device's fields copied out one after another, in the byte order and sizes
+// of the build that wrote them. Anything that can be worked out again, like decoded tiles, bank
+// pointers, scheduled events and finished frames, is left out and rebuilt on load.
+
+// Bump whenever a device saves something different
+const uint32_t SAVE_STATE_VERSION = 1;
+
+// Start of every save state
+struct SaveStateHeader {
+    char magic[4];          // "NESS"
+    uint32_t version;       // SAVE_STATE_VERSION
+    uint32_t size;          // Bytes in the whole state, this header included
+    uint32_t mapper;        // Cartridge the state belongs to, 0xFFFFFFFF for none
+    uint32_t prgSize;
+    uint32_t chrSize;
+};
+
+// Appends state to a buffer, clear() the buffer first to reuse its memory
+class StateWriter {
+public:
+    explicit StateWriter(std::vector<uint8_t>& buffer) : buffer(buffer) {}
+
+    void bytes(const void* data, size_t size) {
+        const uint8_t* start = static_cast<const uint8_t*>(data);
+        buffer.insert(buffer.end(), start, start + size);
+    }
+
+    template <typename T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "only plain data goes into a save state");
+        bytes(&value, sizeof(T));
+    }
+
+private:
+    std::vector<uint8_t>& buffer;
+};
+
+// Reads state back in the order it was written. Reading past the end fails the reader and
+// leaves what was being read alone.
+class StateReader {
+public:
+    StateReader(const uint8_t* data, size_t size) : position(data), end(data + size) {}
+
+    void bytes(void* data, size_t size) {
+        if (size > static_cast<size_t>(end - position)) {
+            failed = true;
+            position = end;
+            return;
+        }
+        std::memcpy(data, position, size);
+        position += size;
+    }
+
+    template <typename T>
+    void get(T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "only plain data comes out of a save state");
+        bytes(&value, sizeof(T));
+    }
+
+    // Everything asked for was there and nothing is left over
+    bool done() const { return !failed && position == end; }
+
+private:
+    const uint8_t* position;
+    const uint8_t* end;
+    bool failed = false;
+};
+
+#endif // SAVESTATE_H
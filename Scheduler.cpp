@@ -0,0 +1,39 @@
+#include "Scheduler.h"
+
+Scheduler::Scheduler() {
+    reset();
+}
+
+void Scheduler::schedule(EVENTS event, uint64_t timestamp) {
+    timestamps[event] = timestamp;
+}
+
+void Scheduler::cancel(EVENTS event) {
+    timestamps[event] = NEVER;
+}
+
+void Scheduler::reset() {
+    timestamps.fill(NEVER);
+}
+
+uint64_t Scheduler::timestampOf(EVENTS event) const {
+    return timestamps[event];
+}
+
+bool Scheduler::pending(EVENTS event) const {
+    return timestamps[event] != NEVER;
+}
+
+Scheduler::EVENTS Scheduler::nextEvent() const {
+    int next = 0;
+    for (int i = 1; i < EVENT_COUNT; i++) {
+        if (timestamps[i] < timestamps[next]) {
+            next = i;
+        }
+    }
+    return static_cast<EVENTS>(next);
+}
+
+uint64_t Scheduler::nextTimestamp() const {
+    return timestamps[nextEvent()];
+}
@@ -0,0 +1,42 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <array>
+#include <cstdint>
+
+// Keeps track of when upcoming events happen on the master clock, so the bus can let the
+// CPU run whole instructions and only stop where something needs to happen.
+// Sprite zero hits don't need an event: the CPU can only see them through $2002, and every
+// PPU register access catches the PPU up first.
+class Scheduler {
+public:
+    enum EVENTS {
+        NMI,        // PPU enters vblank with NMI enabled
+        DMA,        // OAM DMA transfer finishes
+        IRQ,        // Cartridge raises an IRQ, MMC3 counting scanlines
+        EVENT_COUNT
+    };
+
+    static constexpr uint64_t NEVER = UINT64_MAX;
+
+    Scheduler();
+
+    // Set the master clock timestamp of an event
+    void schedule(EVENTS event, uint64_t timestamp);
+    // Remove a pending event
+    void cancel(EVENTS event);
+    // Remove all pending events
+    void reset();
+
+    uint64_t timestampOf(EVENTS event) const;
+    bool pending(EVENTS event) const;
+
+    // Earliest pending event and when it happens
+    EVENTS nextEvent() const;
+    uint64_t nextTimestamp() const;
+
+private:
+    std::array<uint64_t, EVENT_COUNT> timestamps{};
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,22 @@
+#include "TripleBuffer.h"
+
+uint32_t* TripleBuffer::back() {
+    return buffers[backIndex];
+}
+
+void TripleBuffer::publish() {
+    uint8_t previous = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel);
+    backIndex = previous & 0x03;
+}
+
+const uint32_t* TripleBuffer::acquire() {
+    if (middle.load(std::memory_order_acquire) & FRESH) {
+        uint8_t previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previous & 0x03;
+    }
+    return buffers[frontIndex];
+}
+
+bool TripleBuffer::fresh() const {
+    return middle.load(std::memory_order_acquire) & FRESH;
+}
@@ -0,0 +1,36 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+const int FRAME_WIDTH = 256;
+const int FRAME_HEIGHT = 240;
+
+// Hands finished frames from the emulation to the display without copying or locking.
+// The producer draws into the back buffer and publishes it by swapping it with the middle one,
+// the consumer swaps its front buffer with the middle one when something new was published.
+// Each side owns its buffer, so with one producer and one consumer neither ever waits or tears.
+class TripleBuffer {
+public:
+    // Buffer the producer draws the next frame into
+    uint32_t* back();
+    // Make the back buffer the latest frame
+    void publish();
+
+    // Latest published frame, stays valid until the next acquire()
+    const uint32_t* acquire();
+    // Whether a frame has been published since the last acquire()
+    bool fresh() const;
+
+private:
+    static constexpr uint8_t FRESH = 0x04;
+
+    alignas(64) uint32_t buffers[3][FRAME_WIDTH * FRAME_HEIGHT]{};
+    uint8_t backIndex = 0;
+    uint8_t frontIndex = 1;
+    // Index of the middle buffer, with FRESH set when the consumer hasn't picked it up yet
+    std::atomic<uint8_t> middle{2};
+};
+
+#endif // TRIPLEBUFFER_H
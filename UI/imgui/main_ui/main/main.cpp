@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <SDL2/SDL.h>
 #include "../../../../NES.h"
+#include "../../../../EmulatorThread.h"
 #if defined(IMGUI_IMPL_OPENGL_ES2)
 #include <SDL_opengles2.h>
 #else
@@ -24,12 +25,21 @@
 int main(int, char**)
 {
     NES nes;
+    // The NES runs on its own thread, the UI only talks to it through commands
+    EmulatorThread emulator(nes);
+    // Hold backspace to go back through the last 30 seconds
+    nes.setRewindSeconds(30);
+    Bus::controller input{};
+    uint8_t sentInput = 0x00;
+    bool sentRewind = false;
+    EmulatorThread::Timing uiTiming;
 
     float R = 1;
     float G = 1;
     float B = 1;
 
     bool showDebug = false;
+    int runAhead = 0;
 
     // Setup SDL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0)
@@ -126,9 +136,13 @@ int main(int, char**)
     io.IniFilename = nullptr;
     EMSCRIPTEN_MAINLOOP_BEGIN
 #else
+    emulator.start();
     while (!done)
 #endif
     {
+        auto uiFrameStart = std::chrono::steady_clock::now();
+        EmulatorThread::Snapshot state = emulator.snapshot();
+
         // Poll and handle events (inputs, window resize, etc.)
         // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to tell if dear imgui wants to use your inputs.
         // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application, or clear/overwrite your copy of the mouse data.
@@ -156,7 +170,7 @@ int main(int, char**)
 
         {
             // Generate random color
-            if (nes.A_changed == true && nes.paused == false) {
+            if (nes.A_changed == true && state.running) {
                 R = rand() / (float)RAND_MAX;
                 G = rand() / (float)RAND_MAX;
                 B = rand() / (float)RAND_MAX;
@@ -178,7 +192,7 @@ int main(int, char**)
             //ImGui::Begin("NES Emulator", nullptr, ImGuiWindowFlags_NoResize;		// don't allow resizing?
             ImVec2 widgetSize = ImGui::GetContentRegionAvail();
 
-            uint32_t* framebuffer = nes.getFramebuffer();
+            const uint32_t* framebuffer = nes.getFramebuffer();
 
 
             // Set the width and height of the NES screen
@@ -207,58 +221,70 @@ int main(int, char**)
             keyboard = SDL_GetKeyboardState(NULL);
             // Handle the Return key
             if (keyboard[SDL_SCANCODE_RETURN]) {
-                nes.bus.controller1.start = 1;
+                input.start = 1;
             } else {
-                nes.bus.controller1.start = 0;
+                input.start = 0;
             }
 
             // Handle the Up arrow key
             if (keyboard[SDL_SCANCODE_W]) {
-                nes.bus.controller1.up = 1;
+                input.up = 1;
             } else {
-                nes.bus.controller1.up = 0;
+                input.up = 0;
             }
 
             // Handle the Down arrow key
             if (keyboard[SDL_SCANCODE_S]) {
-                nes.bus.controller1.down = 1;
+                input.down = 1;
             } else {
-                nes.bus.controller1.down = 0;
+                input.down = 0;
             }
 
             // Handle the Left arrow key
             if (keyboard[SDL_SCANCODE_A]) {
-                nes.bus.controller1.left = 1;
+                input.left = 1;
             } else {
-                nes.bus.controller1.left = 0;
+                input.left = 0;
             }
 
             // Handle the Right arrow key
             if (keyboard[SDL_SCANCODE_D]) {
-                nes.bus.controller1.right = 1;
+                input.right = 1;
             } else {
-                nes.bus.controller1.right = 0;
+                input.right = 0;
             }
 
             // Handle the Control key
             if (keyboard[SDL_SCANCODE_LCTRL]) {
-                nes.bus.controller1.select = 1;
+                input.select = 1;
             } else {
-                nes.bus.controller1.select = 0;
+                input.select = 0;
             }
 
             // Handle the X key
             if (keyboard[SDL_SCANCODE_M]) {
-                nes.bus.controller1.a = 1;
+                input.a = 1;
             } else {
-                nes.bus.controller1.a = 0;
+                input.a = 0;
             }
 
             // Handle the Z key
             if (keyboard[SDL_SCANCODE_N]) {
-                nes.bus.controller1.b = 1;
+                input.b = 1;
             } else {
-                nes.bus.controller1.b = 0;
+                input.b = 0;
+            }
+
+            if (input.reg != sentInput) {
+                emulator.setController(input.reg);
+                sentInput = input.reg;
+            }
+
+            // Handle the Backspace key, rewinds while held
+            bool rewind = keyboard[SDL_SCANCODE_BACKSPACE];
+            if (rewind != sentRewind) {
+                emulator.setRewinding(rewind);
+                sentRewind = rewind;
             }
 
             GLuint textureID;
@@ -285,12 +311,19 @@ int main(int, char**)
             ImGui::BeginMainMenuBar();
             if (ImGui::BeginMenu("File")) {
                 if (ImGui::MenuItem("Load ROM")) {
-                    nes.on = false;
                     auto selection = pfd::open_file("NES files", std::filesystem::current_path(), {"NES Files", "*.nes"}).result();
                     if (!selection.empty()) {
-                        nes.load_rom(selection[0].c_str());
+                        emulator.loadROM(selection[0]);
+                    }
+                }
+                if (!state.recording && ImGui::MenuItem("Record Movie")) {
+                    auto path = pfd::save_file("Record movie", std::filesystem::current_path(), {"NES Movies", "*.nesm"}).result();
+                    if (!path.empty()) {
+                        emulator.recordMovie(path);
                     }
-                    nes.initNES();
+                }
+                if (state.recording && ImGui::MenuItem("Stop Recording")) {
+                    emulator.stopMovie();
                 }
                 ImGui::EndMenu();
             }
@@ -305,71 +338,71 @@ int main(int, char**)
                 ImGui::Begin("Debug");
                 // Pause button
                 if (ImGui::Button("PAUSE")) {
-                    nes.end();
-                    nes.paused = true;
+                    emulator.pause();
                 }
 
                 // Continue button
                 ImGui::SameLine();
                 if (ImGui::Button("CONTINUE")) {
-                    nes.paused = false;
-                    nes.on = true;
+                    emulator.resume();
                 }
 
                 // Cycle button
                 ImGui::SameLine();
                 if (ImGui::Button("CYCLE")) {
-                    if (nes.on == false) {
-                        nes.on = true;
-                        nes.cycle();
-                        //nes.RandomizeFramebuffer();
-                        // if (nes.A_changed == true) {
-                        //     R = rand() / (float)RAND_MAX;
-                        //     G = rand() / (float)RAND_MAX;
-                        //     B = rand() / (float)RAND_MAX;
-                        // }
-                        nes.on = false;
-                    }
+                    emulator.step();
                 }
 
                 // Display registers and buttons
                 ImGui::Text("Registers      Buttons");
                 //ImGui::TextColored(ImVec4(R, G, B, 1.0f), "A: [%02x]", nes.cpu.A);
-                ImGui::Text("A:    [%02x]     A:      [%01x]", nes.cpu.A, nes.bus.controller1.a);
-                ImGui::Text("X:    [%02x]     B:      [%01x]", nes.cpu.X, nes.bus.controller1.b);
-                ImGui::Text("Y:    [%02x]     Select: [%01x]", nes.cpu.Y, nes.bus.controller1.select);
-                ImGui::Text("PC: [%04x]     Start:  [%01x]", nes.cpu.PC, nes.bus.controller1.start);
-                ImGui::Text("S:  [%04x]     Up:     [%01x]", nes.cpu.S, nes.bus.controller1.up);
-                ImGui::Text("P:  [%04x]     Down:   [%01x]", nes.cpu.P, nes.bus.controller1.down);
-                ImGui::Text("               Left:   [%01x]", nes.bus.controller1.left);
-                ImGui::Text("               Right:  [%01x]", nes.bus.controller1.right);
+                Bus::controller buttons{};
+                buttons.reg = state.controller;
+                ImGui::Text("A:    [%02x]     A:      [%01x]", state.A, buttons.a);
+                ImGui::Text("X:    [%02x]     B:      [%01x]", state.X, buttons.b);
+                ImGui::Text("Y:    [%02x]     Select: [%01x]", state.Y, buttons.select);
+                ImGui::Text("PC: [%04x]     Start:  [%01x]", state.PC, buttons.start);
+                ImGui::Text("S:  [%04x]     Up:     [%01x]", state.S, buttons.up);
+                ImGui::Text("P:  [%04x]     Down:   [%01x]", state.P, buttons.down);
+                ImGui::Text("               Left:   [%01x]", buttons.left);
+                ImGui::Text("               Right:  [%01x]", buttons.right);
+
+                // Where each thread's time goes
+                ImGui::Text("Emulation: %llu frames, %.2f ms/frame, %.0f%% busy", (unsigned long long)state.timing.frames, state.timing.averageFrameMs, state.timing.busy * 100.0);
+                ImGui::Text("UI:        %llu frames, %.2f ms/frame, %.0f%% busy", (unsigned long long)uiTiming.frames, uiTiming.averageFrameMs, uiTiming.busy * 100.0);
+                ImGui::Text("Rewind:    %.1f s in %zu KB%s", state.rewindSeconds, state.rewindBytes / 1024, state.rewinding ? ", rewinding" : "");
+                if (state.recording) {
+                    ImGui::Text("Movie:     recording, %zu frames", state.movieFrames);
+                }
+
+                // Frames shown ahead of the machine to hide input lag, and what each one costs
+                if (ImGui::SliderInt("Run-ahead", &runAhead, 0, 4)) {
+                    emulator.setRunAhead(runAhead);
+                }
+                ImGui::Text("Run-ahead: %.2f ms per frame", state.runAhead > 0 ? state.runAheadFrameMs : 0.0);
 
                 ImGui::End();
             }
         }
 
-        // Cycle the NES
-                if (nes.on == true && nes.rom_loaded == true && nes.paused == false) {
-                    //nes.RandomizeFramebuffer();
-                    nes.cycle();
-
-                    // Get the NES framebuffer (assuming it returns 32-bit RGBA data)
-                    uint32_t* pixels = nes.getFramebuffer();
-                }
-
         // Rendering
         ImGui::Render();
         glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
         glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w, clear_color.w);
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        auto uiWorkEnd = std::chrono::steady_clock::now();
         SDL_GL_SwapWindow(window);
+        std::chrono::duration<double> uiWork = uiWorkEnd - uiFrameStart;
+        std::chrono::duration<double> uiWall = std::chrono::steady_clock::now() - uiFrameStart;
+        uiTiming.record(uiWork.count(), uiWall.count());
     }
 #ifdef __EMSCRIPTEN__
     EMSCRIPTEN_MAINLOOP_END;
 #endif
 
     // Cleanup
+    emulator.stop();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,239 @@
+// Batch runner: runs a list of emulation jobs headless, each on its own NES, spread over every
+// core, and reports how they went and how fast.
+//
+//   make nes_batch
+//   ./nes_batch <jobs.txt> [--threads N] [--timeout SECONDS] [--frames N] [--lockstep] [--skip-idle] [--recompile] [--json FILE]
+//
+// Each line of the job file is a ROM followed by either a movie to replay (see Movie.h) or a
+// number of frames to run from power-on, --frames (600) when there's neither. Paths are taken
+// as they are, blank lines and lines starting with # are skipped:
+//
+//   # rom            movie or frames
+//   nestest.nes      runs/nestest.nesm
+//   nestest.nes      1200
+//
+// --threads defaults to one per hardware thread.
+// --timeout stops any job still going after SECONDS, checked between frames.
+// --lockstep, --skip-idle and --recompile run every job the way they do in nes_bench.
+// --json writes the summary and every job's result to FILE ("-" for stdout).
+// The exit status is 1 if any job failed, diverged from its movie or timed out.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BatchRunner.h"
+
+static const char* STATUS_NAMES[] = {"done", "diverged", "timed out", "failed"};
+
+static void usage(const char* program) {
+    std::fprintf(stderr, "Usage: %s <jobs.txt> [--threads N] [--timeout SECONDS] [--frames N] [--lockstep] [--skip-idle] [--recompile] [--json FILE]\n", program);
+}
+
+static bool readJobs(const std::string& path, int defaultFrames, std::vector<BatchRunner::Job>& jobs) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        BatchRunner::Job job;
+        std::string what;
+        if (!(fields >> job.rom) || job.rom[0] == '#') {
+            continue;
+        }
+        job.frames = defaultFrames;
+        if (fields >> what) {
+            char* end;
+            long frames = std::strtol(what.c_str(), &end, 10);
+            if (*end == '\0') {
+                job.frames = frames;
+            } else {
+                job.movie = what;
+            }
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// Nearest rank percentile, sorted has to be sorted and not empty
+static double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+struct Summary {
+    int counts[4] = {};
+    uint64_t frames = 0;
+    double busySeconds = 0.0;           // Time the threads spent in jobs
+    std::vector<double> frameMs;        // Every frame of every job, sorted
+    std::vector<double> jobSeconds;     // Sorted
+};
+
+static Summary summarize(const BatchRunner::Report& report) {
+    Summary summary;
+    for (const BatchRunner::JobResult& job : report.jobs) {
+        summary.counts[job.status]++;
+        summary.frames += job.frames;
+        summary.busySeconds += job.seconds;
+        summary.frameMs.insert(summary.frameMs.end(), job.frameMs.begin(), job.frameMs.end());
+        summary.jobSeconds.push_back(job.seconds);
+    }
+    std::sort(summary.frameMs.begin(), summary.frameMs.end());
+    std::sort(summary.jobSeconds.begin(), summary.jobSeconds.end());
+    return summary;
+}
+
+static void printSummary(const BatchRunner::Report& report, const Summary& summary) {
+    std::printf("%zu jobs on %d threads in %.3f s: %d done, %d diverged, %d timed out, %d failed\n",
+        report.jobs.size(), report.threads, report.seconds,
+        summary.counts[BatchRunner::DONE], summary.counts[BatchRunner::DIVERGED],
+        summary.counts[BatchRunner::TIMED_OUT], summary.counts[BatchRunner::FAILED]);
+    std::printf("  %llu frames, %.1f fps in total, %.1f fps per thread\n",
+        (unsigned long long)summary.frames, summary.frames / report.seconds,
+        summary.busySeconds > 0.0 ? summary.frames / summary.busySeconds : 0.0);
+    // Busy time over the time the pool had, how close to linear the scaling got
+    std::printf("  %.0f%% of the pool busy, %llu jobs stolen\n",
+        summary.busySeconds / (report.seconds * report.threads) * 100.0, (unsigned long long)report.steals);
+    if (!summary.frameMs.empty()) {
+        std::printf("  frame ms: p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+            percentile(summary.frameMs, 50), percentile(summary.frameMs, 90),
+            percentile(summary.frameMs, 99), summary.frameMs.back());
+    }
+    if (!summary.jobSeconds.empty()) {
+        std::printf("  job s:    p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+            percentile(summary.jobSeconds, 50), percentile(summary.jobSeconds, 90),
+            percentile(summary.jobSeconds, 99), summary.jobSeconds.back());
+    }
+}
+
+// Escape text to go inside a JSON string
+static std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static void writeJson(FILE* out, const std::vector<BatchRunner::Job>& jobs, const BatchRunner::Report& report, const Summary& summary) {
+    std::fprintf(out,
+        "{\n"
+        "  \"threads\": %d,\n"
+        "  \"seconds\": %.6f,\n"
+        "  \"frames\": %llu,\n"
+        "  \"fps\": %.3f,\n"
+        "  \"busy\": %.4f,\n"
+        "  \"steals\": %llu,\n"
+        "  \"done\": %d,\n"
+        "  \"diverged\": %d,\n"
+        "  \"timed_out\": %d,\n"
+        "  \"failed\": %d,\n",
+        report.threads, report.seconds, (unsigned long long)summary.frames, summary.frames / report.seconds,
+        summary.busySeconds / (report.seconds * report.threads), (unsigned long long)report.steals,
+        summary.counts[BatchRunner::DONE], summary.counts[BatchRunner::DIVERGED],
+        summary.counts[BatchRunner::TIMED_OUT], summary.counts[BatchRunner::FAILED]);
+    if (!summary.frameMs.empty()) {
+        std::fprintf(out, "  \"frame_ms\": {\"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n",
+            percentile(summary.frameMs, 50), percentile(summary.frameMs, 90),
+            percentile(summary.frameMs, 99), summary.frameMs.back());
+    }
+    std::fprintf(out, "  \"jobs\": [\n");
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BatchRunner::JobResult& result = report.jobs[i];
+        std::fprintf(out,
+            "    {\"rom\": \"%s\", \"movie\": \"%s\", \"status\": \"%s\", \"frames\": %d, \"seconds\": %.6f, "
+            "\"finished_at\": %.6f, \"thread\": %d, \"hash\": \"%016llx\"}%s\n",
+            jsonEscape(jobs[i].rom).c_str(), jsonEscape(jobs[i].movie).c_str(), STATUS_NAMES[result.status], result.frames, result.seconds,
+            result.finishedAt, result.thread, (unsigned long long)result.hash, i + 1 < jobs.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::string jobPath = argv[1];
+    int frames = 600;
+    std::string jsonPath;
+    BatchRunner::Options options;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            options.threads = std::atoi(argv[++i]);
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            options.timeoutSeconds = std::atof(argv[++i]);
+        } else if (arg == "--frames" && i + 1 < argc) {
+            frames = std::atoi(argv[++i]);
+        } else if (arg == "--lockstep") {
+            options.catchUp = false;
+        } else if (arg == "--skip-idle") {
+            options.skipIdleLoops = true;
+        } else if (arg == "--recompile") {
+            options.recompile = true;
+        } else if (arg == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<BatchRunner::Job> jobs;
+    if (!readJobs(jobPath, frames, jobs)) {
+        std::fprintf(stderr, "Can't read %s\n", jobPath.c_str());
+        return 1;
+    }
+    if (jobs.empty()) {
+        std::fprintf(stderr, "No jobs in %s\n", jobPath.c_str());
+        return 1;
+    }
+
+    BatchRunner runner(options);
+    BatchRunner::Report report = runner.run(jobs);
+    Summary summary = summarize(report);
+
+    // Anything that didn't finish cleanly is listed by name
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BatchRunner::JobResult& result = report.jobs[i];
+        if (result.status != BatchRunner::DONE) {
+            std::fprintf(stderr, "%s %s: %s after %d frames\n", jobs[i].rom.c_str(), jobs[i].movie.c_str(),
+                STATUS_NAMES[result.status], result.frames);
+        }
+    }
+
+    if (jsonPath.empty()) {
+        printSummary(report, summary);
+    } else {
+        FILE* out = jsonPath == "-" ? stdout : std::fopen(jsonPath.c_str(), "w");
+        if (out == nullptr) {
+            std::fprintf(stderr, "Can't write %s\n", jsonPath.c_str());
+            return 1;
+        }
+        writeJson(out, jobs, report, summary);
+        if (out != stdout) {
+            std::fclose(out);
+        }
+    }
+
+    return summary.counts[BatchRunner::DONE] == static_cast<int>(jobs.size()) ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+// Headless throughput benchmark: loads a ROM, runs it unthrottled with no UI and reports how fast.
+//
+//   make nes_bench
+//   ./nes_bench <rom.nes> [--frames N] [--warmup N] [--lockstep | --step] [--skip-idle] [--recompile] [--json FILE]
+//   ./nes_bench <rom.nes> --bus-reads [N]
+//   ./nes_bench nestest.nes --cpu [N] [--recompile]
+//   ./nes_bench <rom.nes> --record FILE [--frames N]
+//   ./nes_bench <rom.nes> --movie FILE [--lockstep] [--skip-idle] [--recompile] [--json FILE]
+//
+// --step runs frames one Bus::step() at a time instead of with one catch-up run per frame.
+// --skip-idle lets the bus skip idle loops (Bus::skipIdleLoops), it does nothing in lockstep.
+// --recompile runs hot code as translated x86-64 blocks (Bus::recompile), also not in lockstep.
+// --json writes the results to FILE ("-" for stdout) so runs can be collected and compared.
+// --bus-reads times N million CPU bus reads over RAM and PRG-ROM instead of running frames.
+// --cpu times N million instructions of nestest's automated mode with nothing else running, to
+// compare CPU dispatch builds (make CPU_DISPATCH=table, cached or fused), or with --recompile against
+// the recompiler's blocks.
+// --record writes a movie (see Movie.h) of N frames from power-on with no buttons held, and
+// --movie replays one headless at full speed, checking every frame's state against the recording.
+// A movie recorded with one build or mode has to replay on any other, the exit status is 1 at the
+// first frame that doesn't.
+// Build with e.g. CXXFLAGS="-std=c++20 -O2" (after a make clean) to measure an optimized build.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "Movie.h"
+#include "NES.h"
+#include "Recompiler.h"
+
+struct BenchResult {
+    int frames = 0;
+    double seconds = 0.0;
+    uint64_t instructions = 0;
+    uint64_t cpuCycles = 0;
+    uint64_t ppuDots = 0;
+};
+
+static void usage(const char* program) {
+    std::fprintf(stderr, "Usage: %s <rom.nes> [--frames N] [--warmup N] [--lockstep | --step] [--skip-idle] [--recompile] [--json FILE]\n", program);
+    std::fprintf(stderr, "       %s <rom.nes> --bus-reads [N]\n", program);
+    std::fprintf(stderr, "       %s nestest.nes --cpu [N] [--recompile]\n", program);
+    std::fprintf(stderr, "       %s <rom.nes> --record FILE [--frames N]\n", program);
+    std::fprintf(stderr, "       %s <rom.nes> --movie FILE [--lockstep] [--skip-idle] [--recompile] [--json FILE]\n", program);
+}
+
+// Reads the way the CPU mostly does: zero page and stack, then a run through PRG-ROM
+static void benchBusReads(Bus& bus, int millions) {
+    uint64_t reads = (uint64_t)millions * 1000000;
+    uint32_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < reads; i++) {
+        uint16_t address = (i & 1) ? 0x8000 | (i & 0x7FFF) : (i & 0x01FF);
+        sum += bus.read(address);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::printf("%llu bus reads in %.3f s (checksum %u)\n", (unsigned long long)reads, elapsed.count(), sum);
+    std::printf("  %.1f M reads/s\n", reads / elapsed.count() / 1e6);
+    std::printf("  %.2f ns/read\n", elapsed.count() * 1e9 / reads);
+}
+
+// Escape text to go inside a JSON string
+static std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static void writeJson(FILE* out, const std::string& rom, const std::string& mode, const BenchResult& result) {
+    std::fprintf(out,
+        "{\n"
+        "  \"rom\": \"%s\",\n"
+        "  \"mode\": \"%s\",\n"
+        "  \"frames\": %d,\n"
+        "  \"seconds\": %.6f,\n"
+        "  \"fps\": %.3f,\n"
+        "  \"ns_per_frame\": %.1f,\n"
+        "  \"cpu_instructions_per_second\": %.0f,\n"
+        "  \"cpu_cycles_per_second\": %.0f,\n"
+        "  \"ppu_dots_per_second\": %.0f\n"
+        "}\n",
+        jsonEscape(rom).c_str(), mode.c_str(), result.frames, result.seconds,
+        result.frames / result.seconds,
+        result.seconds * 1e9 / result.frames,
+        result.instructions / result.seconds,
+        result.cpuCycles / result.seconds,
+        result.ppuDots / result.seconds);
+}
+
+// nestest's automated mode starts at 0xC000 and ends on the RTS here, it gets restarted each time
+static void benchCPU(NES& nes, int millions, bool recompile) {
+    const uint16_t NESTEST_START = 0xC000;
+    const uint16_t NESTEST_END = 0xC66E;
+    CPU& cpu = nes.cpu;
+    uint64_t target = (uint64_t)millions * 1000000;
+    uint64_t start = cpu.instructions;
+    int runs = 0;
+
+    auto begin = std::chrono::steady_clock::now();
+    while (cpu.instructions - start < target) {
+        cpu.PC = NESTEST_START;
+        cpu.S = 0xFD;
+        cpu.P = 0x24;
+        cpu.A = cpu.X = cpu.Y = 0;
+        while (cpu.PC != NESTEST_END) {
+            // Every way into the RTS at the end is a JMP or a JSR returning, so no block runs past it
+            const Recompiler::Block* block = recompile ? nes.bus.recompiler->lookup(cpu.PC) : nullptr;
+            if (block != nullptr) {
+                uint32_t run = nes.bus.recompiler->run(*block).instructions;
+                cpu.instructions += run;
+                if (run > 0) {
+                    continue;
+                }
+            }
+            cpu.runInstruction();
+        }
+        runs++;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    uint64_t instructions = cpu.instructions - start;
+
+#if defined(CPU_TABLE_DISPATCH)
+    const char* dispatch = "table";
+#elif defined(CPU_DECODE_CACHE)
+    const char* dispatch = "cached";
+#else
+    const char* dispatch = "fused";
+#endif
+    if (recompile) {
+        dispatch = Recompiler::AVAILABLE ? "recompiled" : "interpreted (no recompiler for this machine)";
+    }
+    std::printf("%llu instructions in %.3f s (%d nestest runs, %s dispatch)\n",
+        (unsigned long long)instructions, elapsed.count(), runs, dispatch);
+    std::printf("  %.2f M instructions/s\n", instructions / elapsed.count() / 1e6);
+}
+
+// Step mode stops on the first instruction boundary at or after the frame's end
+static void runFrame(NES& nes, const std::string& mode) {
+    if (mode != "step") {
+        nes.runFrame();
+        return;
+    }
+    uint64_t frameEnd = nes.bus.clockCounter + nes.bus.ppu.dotsUntilVblank() + 1;
+    while (nes.bus.clockCounter < frameEnd) {
+        nes.bus.step();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::string rom = argv[1];
+    int frames = 600;
+    int warmup = 60;
+    std::string mode = "catch-up";
+    bool skipIdle = false;
+    bool recompile = false;
+    int busReads = 0;
+    int cpuInstructions = 0;
+    std::string jsonPath;
+    std::string recordPath;
+    std::string moviePath;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            frames = std::atoi(argv[++i]);
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            warmup = std::atoi(argv[++i]);
+        } else if (arg == "--lockstep") {
+            mode = "lockstep";
+        } else if (arg == "--step") {
+            mode = "step";
+        } else if (arg == "--skip-idle") {
+            skipIdle = true;
+        } else if (arg == "--recompile") {
+            recompile = true;
+        } else if (arg == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (arg == "--movie" && i + 1 < argc) {
+            moviePath = argv[++i];
+        } else if (arg == "--cpu") {
+            cpuInstructions = 50;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                cpuInstructions = std::atoi(argv[++i]);
+            }
+        } else if (arg == "--bus-reads") {
+            busReads = 200;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                busReads = std::atoi(argv[++i]);
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (frames <= 0 || (mode == "step" && !moviePath.empty())) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // The NES is large, keep it off the stack
+    auto nes = std::make_unique<NES>();
+    nes->catch_up = mode != "lockstep";
+    nes->bus.skipIdleLoops = skipIdle;
+    nes->bus.recompile = recompile;
+    nes->load_rom(rom.c_str());
+    if (!nes->rom_loaded) {
+        return 1;
+    }
+    nes->initNES();
+
+    if (busReads > 0) {
+        benchBusReads(nes->bus, busReads);
+        return 0;
+    }
+    if (cpuInstructions > 0) {
+        benchCPU(*nes, cpuInstructions, recompile);
+        return 0;
+    }
+
+    if (!recordPath.empty()) {
+        Movie movie;
+        movie.start(*nes);
+        for (int i = 0; i < frames; i++) {
+            movie.recordFrame(*nes);
+        }
+        if (!movie.save(recordPath)) {
+            std::fprintf(stderr, "Can't write %s\n", recordPath.c_str());
+            return 1;
+        }
+        std::printf("%d frames recorded to %s\n", frames, recordPath.c_str());
+        return 0;
+    }
+
+    Movie movie;
+    if (!moviePath.empty()) {
+        if (!movie.load(moviePath)) {
+            std::fprintf(stderr, "Can't read %s\n", moviePath.c_str());
+            return 1;
+        }
+        // Replays start from the movie's state, so there's no warmup. Loading it here first
+        // starts the counters from there too.
+        nes->loadState(movie.startState);
+        warmup = 0;
+        mode += " replay";
+    }
+
+    for (int i = 0; i < warmup; i++) {
+        runFrame(*nes, mode);
+    }
+
+    uint64_t instructions = nes->cpu.instructions;
+    uint64_t cpuCycles = nes->bus.cpuClockCounter;
+    uint64_t ppuDots = nes->bus.ppuClockCounter;
+    Movie::ReplayResult replay;
+    auto start = std::chrono::steady_clock::now();
+    if (!moviePath.empty()) {
+        replay = movie.replay(*nes);
+        frames = replay.frames;
+    } else {
+        for (int i = 0; i < frames; i++) {
+            runFrame(*nes, mode);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    int status = 0;
+    if (!moviePath.empty()) {
+        if (!replay.started) {
+            std::fprintf(stderr, "%s was recorded with another ROM or save state version\n", moviePath.c_str());
+            return 1;
+        }
+        if (replay.diverged) {
+            std::fprintf(stderr, "Replay diverged on frame %zu of %zu\n", replay.frames, movie.frames.size());
+            status = 1;
+        }
+        if (frames == 0) {
+            return status;
+        }
+    }
+
+    BenchResult result;
+    result.frames = frames;
+    result.seconds = elapsed.count();
+    result.instructions = nes->cpu.instructions - instructions;
+    result.cpuCycles = nes->bus.cpuClockCounter - cpuCycles;
+    result.ppuDots = nes->bus.ppuClockCounter - ppuDots;
+
+    if (jsonPath.empty()) {
+        std::printf("%d frames in %.3f s (%s)\n", result.frames, result.seconds, mode.c_str());
+        std::printf("  %.1f fps\n", result.frames / result.seconds);
+        std::printf("  %.0f ns/frame\n", result.seconds * 1e9 / result.frames);
+        std::printf("  %.2f M CPU instructions/s\n", result.instructions / result.seconds / 1e6);
+        std::printf("  %.2f M PPU dots/s\n", result.ppuDots / result.seconds / 1e6);
+    } else {
+        FILE* out = jsonPath == "-" ? stdout : std::fopen(jsonPath.c_str(), "w");
+        if (out == nullptr) {
+            std::fprintf(stderr, "Can't write %s\n", jsonPath.c_str());
+            return 1;
+        }
+        writeJson(out, rom, mode, result);
+        if (out != stdout) {
+            std::fclose(out);
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,11 @@
+# CPU instruction dispatch: fused runs one specialized case per opcode, table calls through
+# member function pointers, cached is fused plus a cache of decoded PRG ROM instructions.
+# Pick with e.g. make CPU_DISPATCH=table, after a make clean. CPU.cpp is compiled into every
+# object that includes it, so the core and the UI have to be built with the same one.
+CPU_DISPATCH = fused
+ifeq ($(CPU_DISPATCH),table)
+CPPFLAGS += -DCPU_TABLE_DISPATCH
+endif
+ifeq ($(CPU_DISPATCH),cached)
+CPPFLAGS += -DCPU_DECODE_CACHE
+endif
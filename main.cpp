@@ -11,7 +11,7 @@ int main(int argc, char* argv[]) {
       // std::cout << "Debug on!\n";
       // TODO: Update debug mode
     } else if (arg.rfind("test=", 0) == 0) {
-      std::string testPath = arg.substr(5);
+      testPath = arg.substr(5);
     }
   }
 
@@ -41,8 +41,29 @@ int main(int argc, char* argv[]) {
 	// tests.test_CLD_SED_CLV();
 	// //tests.test_NES(testPath);
 	// tests.test_Bus();
+	// tests.test_memory_map();
 	// tests.test_PPU_registers();
 	tests.test_pattern_tables(testPath);
+	// tests.test_scheduler(testPath);
+	// tests.test_catch_up(testPath);
+	// tests.test_scanline_renderer(testPath);
+	// tests.test_palette_conversion();
+	// tests.test_triple_buffer();
+	// tests.test_emulator_thread(testPath);
+	// tests.test_run_frame(testPath);
+	// tests.test_mappers();
+	// tests.test_opcode_table();
+	// tests.test_step(testPath);
+	// tests.test_idle_loops(testPath);
+	// tests.test_decode_cache();
+	// tests.test_recompiler(testPath);
+	// tests.test_oam_dma();
+	// tests.test_rom_loading(testPath);
+	// tests.test_save_state(testPath);
+	// tests.test_rewind(testPath);
+	// tests.test_run_ahead(testPath);
+	// tests.test_movie(testPath);
+	// tests.test_batch_runner(testPath);
     return 0;
 }
 
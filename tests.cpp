@@ -1,5 +1,6 @@
 #include "tests.h"
 #include "CPU.cpp"
+#include "Recompiler.h"
 
 void Tests::test_cpu() {
 	std::cout << "\nCPU Tests:\n";
@@ -12,7 +13,7 @@ void Tests::test_cpu() {
 	// Check write
 	cpu.writeMemory(0x10, 0xAB);
 	cpu.writeMemory(0x0000, 0xAB);
-	cpu.printMemory();
+	printf("Value at address 0x0010: %02X\n", cpu.readMemory(0x0010));
 
 	// OOB, should return error
 	cpu.writeMemory(0x801, 0xAB); // 2049
@@ -653,6 +654,40 @@ void Tests::test_Bus() {
 	std::cout << "---------------------------\nBus tests passed!\n";
 }
 
+void Tests::test_memory_map() {
+	Bus bus;
+
+	// RAM is mirrored every 2KB up to 0x1FFF
+	bus.write(0x0123, 0x42);
+	assert(bus.read(0x0923) == 0x42);
+	assert(bus.read(0x1923) == 0x42);
+	bus.write(0x1FFF, 0x24);
+	assert(bus.cpuRam[0x07FF] == 0x24);
+
+	// PPU registers are mirrored every 8 bytes up to 0x3FFF
+	bus.write(0x3FF8, 0x80);
+	assert(bus.ppu.control.reg == 0x80);
+
+	// Cartridge space on either side of the I/O page boundary
+	bus.write(0x4020, 0x11);
+	bus.write(0x4400, 0x22);
+	bus.write(0xFFFF, 0x33);
+	assert(bus.read(0x4020) == 0x11);
+	assert(bus.read(0x4400) == 0x22);
+	assert(bus.read(0xFFFF) == 0x33);
+
+	// Remapping a page sends its accesses to the new memory
+	std::array<uint8_t, 2 * 1024> bank{};
+	bank[0x0010] = 0x55;
+	bus.mapReadPages(0x8000, 0x87FF, bank.data());
+	bus.mapWritePages(0x8000, 0x87FF, bank.data());
+	assert(bus.read(0x8010) == 0x55);
+	bus.write(0x8400, 0x66);
+	assert(bank[0x0400] == 0x66);
+
+	std::cout << "---------------------------\nMemory map tests passed!\n";
+}
+
 void Tests::test_PPU_registers() {
 	Bus bus;
 	CPU& cpu = *bus.cpu;
@@ -688,3 +723,1484 @@ void Tests::test_pattern_tables(std::string path) {
 	//nes.bus.ppu.printPaletteMemory();
 
 }
+
+void Tests::test_scheduler(std::string path) {
+	const int frames = 300;
+
+	// Step the bus one master clock at a time
+	NES lockstep;
+	lockstep.load_rom(path.c_str());
+	lockstep.initNES();
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < frames * DOTS_PER_FRAME; i++) {
+		lockstep.bus.clock();
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> lockstep_time = end - start;
+
+	// Let the scheduler run whole instructions a frame at a time
+	NES scheduled;
+	scheduled.load_rom(path.c_str());
+	scheduled.initNES();
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < frames; i++) {
+		scheduled.bus.run(scheduled.bus.clockCounter + DOTS_PER_FRAME);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> scheduled_time = end - start;
+
+	// Both should end up in exactly the same place
+	assert(lockstep.bus.clockCounter == scheduled.bus.clockCounter);
+	assert(lockstep.cpu.PC == scheduled.cpu.PC);
+	assert(lockstep.cpu.cycles == scheduled.cpu.cycles);
+	assert(std::memcmp(lockstep.getFramebuffer(), scheduled.getFramebuffer(), FRAME_WIDTH * FRAME_HEIGHT * sizeof(uint32_t)) == 0);
+
+	std::cout << "Lockstep:  " << frames / lockstep_time.count() << " fps\n";
+	std::cout << "Scheduler: " << frames / scheduled_time.count() << " fps\n";
+	std::cout << "---------------------------\nScheduler tests passed!\n";
+}
+
+// FNV-1a hash of a finished frame
+static uint64_t frameHash(const uint32_t* pixels) {
+	uint64_t hash = 0xCBF29CE484222325;
+	for (int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++) {
+		hash = (hash ^ pixels[i]) * 0x100000001B3;
+	}
+	return hash;
+}
+
+// Controller 1 on a frame of a run that taps start and then down every couple of seconds, so
+// the ROM does more than sit on its title screen
+static uint8_t scriptedButtons(int frame) {
+	if (frame % 120 >= 60 && frame % 120 < 64) {
+		return (frame % 240 < 120) ? 0x08 : 0x20;
+	}
+	return 0x00;
+}
+
+// An MMC3 cartridge whose program raises a scanline IRQ every 20 lines that moves the scroll,
+// switches a CHR bank every NMI, and polls $2002 for sprite 0 to split the screen. The IRQs,
+// sprite 0 hits and NMIs it counted, a byte each, are kept at $0020, $0022 and $0021.
+static void insertIrqROM(NES& nes, std::vector<uint8_t>& prg, std::vector<uint8_t>& chr) {
+	prg.assign(4 * 8192, 0xEA);
+	chr.resize(8 * 1024);
+	for (size_t i = 0; i < chr.size(); i++) {
+		chr[i] = ((i * 2654435761u) >> 11) & 0xFF;
+	}
+	const std::vector<uint8_t> reset = {
+		0x78, 0xA2, 0xFF, 0x9A,                         // SEI, LDX #$FF, TXS
+		0xA9, 0x06, 0x8D, 0x00, 0x80,                   // R6 = 1
+		0xA9, 0x01, 0x8D, 0x01, 0x80,
+		0xA9, 0x14, 0x8D, 0x00, 0xC0,                   // IRQ every 20 lines
+		0x8D, 0x01, 0xC0, 0x8D, 0x01, 0xE0,
+		0xA9, 0x50, 0x8D, 0x00, 0x02,                   // Sprite 0 at 100, 80 with tile 3
+		0xA9, 0x03, 0x8D, 0x01, 0x02,
+		0xA9, 0x00, 0x8D, 0x02, 0x02,
+		0xA9, 0x64, 0x8D, 0x03, 0x02,
+		0xA9, 0x02, 0x8D, 0x14, 0x40,                   // OAM DMA from $0200
+		0xA9, 0x88, 0x8D, 0x00, 0x20,                   // NMI on, sprites from $1000
+		0xA9, 0x1E, 0x8D, 0x01, 0x20,                   // Background and sprites on
+		0x58,                                           // CLI
+		0x2C, 0x02, 0x20, 0x50, 0xFB,                   // $E03D: BIT $2002, BVC $E03D
+		0xE6, 0x22, 0xA5, 0x22,                         // INC $22, LDA $22
+		0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20,             // Scroll the rest of the screen
+		0xA5, 0x21, 0xC5, 0x23, 0xF0, 0xFA,             // $E04C: LDA $21, CMP $23, BEQ $E04C
+		0x85, 0x23, 0x4C, 0x3D, 0xE0,                   // STA $23, JMP $E03D
+	};
+	const std::vector<uint8_t> irq = {
+		0x48, 0xE6, 0x20,                               // PHA, INC $20
+		0x8D, 0x00, 0xE0, 0x8D, 0x01, 0xE0,             // Acknowledge and enable again
+		0xA5, 0x20, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20, // Scroll by the count
+		0x68, 0x40,                                     // PLA, RTI
+	};
+	const std::vector<uint8_t> nmi = {
+		0x48, 0xE6, 0x21,                               // PHA, INC $21
+		0xA9, 0x02, 0x8D, 0x00, 0x80,                   // R2, the sprites' first 1KB, = count
+		0xA5, 0x21, 0x8D, 0x01, 0x80,
+		0x68, 0x40,                                     // PLA, RTI
+	};
+	// The last bank is always at $E000
+	uint8_t* last = &prg[3 * 8192];
+	std::copy(reset.begin(), reset.end(), last);
+	std::copy(irq.begin(), irq.end(), last + 0x0100);
+	std::copy(nmi.begin(), nmi.end(), last + 0x0200);
+	const uint8_t vectors[] = {0x00, 0xE2, 0x00, 0xE0, 0x00, 0xE1};
+	std::copy(vectors, vectors + 6, last + 0x1FFA);
+
+	nes.rom.prgRom = prg.data();
+	nes.rom.prgSize = prg.size();
+	nes.rom.chrRom = chr.data();
+	nes.rom.chrSize = chr.size();
+	nes.rom.mapper = 4;
+	assert(nes.bus.connectROM(nes.rom));
+	for (size_t i = 0; i < nes.bus.ppu.nameTables.size(); i++) {
+		nes.bus.ppu.nameTables[i] = ((i * 40503u) >> 5) & 0xFF;
+	}
+	for (int i = 0; i < 32; i++) {
+		nes.bus.ppu.paletteMemory[i] = (i * 7 + 3) & 0x3F;
+	}
+}
+
+// Run a lockstep and a catch-up machine side by side with the same buttons, every frame has to
+// come out the same. Returns the hash of the last one.
+static uint64_t compareCatchUp(NES& lockstep, NES& catchUp, int frames) {
+	lockstep.catch_up = false;
+	lockstep.initNES();
+	catchUp.initNES();
+
+	uint64_t hash = 0;
+	for (int i = 0; i < frames; i++) {
+		uint8_t buttons = scriptedButtons(i);
+		lockstep.bus.controller1.reg = buttons;
+		catchUp.bus.controller1.reg = buttons;
+
+		uint64_t frameEnd = lockstep.bus.clockCounter + DOTS_PER_FRAME;
+		while (lockstep.bus.clockCounter < frameEnd) {
+			lockstep.bus.clock();
+		}
+		catchUp.bus.run(frameEnd);
+
+		hash = frameHash(lockstep.getFramebuffer());
+		if (hash != frameHash(catchUp.getFramebuffer())) {
+			std::cout << "Frame " << i << " differs between lockstep and catch-up\n";
+		}
+		assert(hash == frameHash(catchUp.getFramebuffer()));
+		assert(lockstep.cpu.PC == catchUp.cpu.PC);
+	}
+	return hash;
+}
+
+void Tests::test_catch_up(std::string path) {
+	const int frames = 600;
+
+	{
+		NES lockstep;
+		lockstep.load_rom(path.c_str());
+		NES catchUp;
+		catchUp.load_rom(path.c_str());
+		uint64_t hash = compareCatchUp(lockstep, catchUp, frames);
+		std::cout << "Final frame hash: " << std::hex << hash << std::dec << "\n";
+	}
+
+	// Mapper IRQs and sprite 0 splits, which the scheduler has to land on the right dot
+	{
+		std::vector<uint8_t> prg;
+		std::vector<uint8_t> chr;
+		NES lockstep;
+		insertIrqROM(lockstep, prg, chr);
+		NES catchUp;
+		insertIrqROM(catchUp, prg, chr);
+		uint64_t hash = compareCatchUp(lockstep, catchUp, frames);
+		for (uint16_t counter : {0x20, 0x21, 0x22}) {
+			assert(lockstep.bus.cpuRam[counter] == catchUp.bus.cpuRam[counter]);
+		}
+		assert(catchUp.bus.cpuRam[0x20] > 0 && catchUp.bus.cpuRam[0x22] > 0);
+		std::cout << "MMC3 final frame hash: " << std::hex << hash << std::dec << "\n";
+	}
+
+	std::cout << "---------------------------\nCatch-up tests passed!\n";
+}
+
+void Tests::test_scanline_renderer(std::string path) {
+	const int frames = 600;
+
+	NES dots;
+	dots.bus.ppu.renderScanlines = false;
+	dots.load_rom(path.c_str());
+	dots.initNES();
+
+	NES scanlines;
+	scanlines.load_rom(path.c_str());
+	scanlines.initNES();
+
+	for (int i = 0; i < frames; i++) {
+		uint8_t buttons = scriptedButtons(i);
+		dots.bus.controller1.reg = buttons;
+		scanlines.bus.controller1.reg = buttons;
+
+		uint64_t frameEnd = dots.bus.clockCounter + DOTS_PER_FRAME;
+		dots.bus.run(frameEnd);
+		scanlines.bus.run(frameEnd);
+
+		uint64_t hash = frameHash(dots.getFramebuffer());
+		if (hash != frameHash(scanlines.getFramebuffer())) {
+			std::cout << "Frame " << i << " differs between the dot and scanline renderers\n";
+		}
+		assert(hash == frameHash(scanlines.getFramebuffer()));
+		assert(dots.bus.ppu.v.vram_register == scanlines.bus.ppu.v.vram_register);
+		assert(dots.bus.ppu.status.reg == scanlines.bus.ppu.status.reg);
+		assert(dots.cpu.PC == scanlines.cpu.PC);
+	}
+
+	// nestest barely draws sprites, so run a busy synthetic scene on two bare PPUs as well, one a
+	// dot at a time and one a scanline at a time, and compare them after every line. Tile 0 is
+	// transparent and tile 0xFF solid in both pattern tables, everything else is random.
+	PPU ppuDots;
+	PPU ppuLines;
+	srand(3);
+	std::vector<uint8_t> vram(0x4000, 0x00);
+	for (int i = 0x0010; i < 0x1FF0; i++) {
+		vram[i] = (i & 0x0FF0) ? rand() % 256 : 0x00;
+	}
+	for (int i = 0x0FF0; i < 0x2000; i += 0x1000) {
+		std::fill(&vram[i], &vram[i + 16], 0xFF);
+	}
+	for (int i = 0x2000; i < 0x2800; i++) {
+		vram[i] = rand() % 4 ? rand() % 256 : 0x00;
+	}
+	// A solid block of background under sprite 0, in both nametables whichever way they're mirrored
+	for (int table = 0x2000; table < 0x2800; table += 0x0400) {
+		for (int row = 10; row < 17; row++) {
+			std::fill(&vram[table + row * 32 + 4], &vram[table + row * 32 + 15], 0xFF);
+		}
+	}
+	for (int i = 0x3F00; i < 0x3F20; i++) {
+		vram[i] = rand() % 64;
+	}
+	uint8_t oam[256];
+	for (uint8_t& byte : oam) {
+		byte = rand() % 256;
+	}
+	for (PPU* ppu : {&ppuDots, &ppuLines}) {
+		for (int i = 0; i < 0x4000; i++) {
+			if (i < 0x2800 || i >= 0x3F00) {
+				ppu->writePPU(i, vram[i]);
+			}
+		}
+		std::memcpy(ppu->OAMDATA, oam, sizeof(oam));
+		// More than 8 sprites on a line, overlapping each other
+		for (int i = 1; i < 16; i++) {
+			ppu->OAM[i].y = 150;
+			ppu->OAM[i].x = i * 12;
+		}
+		ppu->OAM[0] = {99, 0xFF, 0x00, 60};
+		ppu->x = 5;
+		ppu->mask.reg = 0x1E;
+	}
+
+	// Sprite 0 in front and then behind the background, 8x8 and 8x16 sprites from either table
+	const uint8_t controls[] = {0x08, 0x08, 0x28, 0x20, 0x00};
+	const uint8_t attributes[] = {0x00, 0x20, 0x20, 0xE1, 0x62};
+	for (int frame = 0; frame < 5; frame++) {
+		for (PPU* ppu : {&ppuDots, &ppuLines}) {
+			ppu->control.reg = controls[frame];
+			ppu->OAM[0].attribute = attributes[frame];
+		}
+
+		// Scanline the sprite 0 hit was first seen on. The dot renderer sets it on the dot the
+		// pixels overlap, the scanline renderer when it draws the line, so they agree by its end.
+		int hitDots = -2;
+		int hitLines = -2;
+		for (int line = 0; line < SCANLINES_PER_FRAME; line++) {
+			int16_t scanline = ppuDots.scanline;
+			for (int dot = 0; dot < DOTS_PER_SCANLINE; dot++) {
+				ppuDots.clock();
+				if (ppuDots.status.sprite_zerohit && hitDots == -2) {
+					hitDots = scanline;
+				}
+			}
+			ppuLines.run(DOTS_PER_SCANLINE);
+			if (ppuLines.status.sprite_zerohit && hitLines == -2) {
+				hitLines = scanline;
+			}
+
+			assert(ppuDots.scanline == ppuLines.scanline && ppuDots.cycle == ppuLines.cycle);
+			assert(ppuDots.status.reg == ppuLines.status.reg);
+			assert(ppuDots.v.vram_register == ppuLines.v.vram_register);
+		}
+		if (std::memcmp(ppuDots.framebuffer, ppuLines.framebuffer, sizeof(ppuDots.framebuffer)) != 0) {
+			std::cout << "Synthetic frame " << frame << " differs between the dot and scanline renderers\n";
+		}
+		assert(std::memcmp(ppuDots.framebuffer, ppuLines.framebuffer, sizeof(ppuDots.framebuffer)) == 0);
+		// Sprite 0 is drawn on the lines after its y, over the solid background
+		assert(hitDots == hitLines && hitDots == 100);
+	}
+
+	std::cout << "---------------------------\nScanline renderer tests passed!\n";
+}
+
+void Tests::test_palette_conversion() {
+	const int frames = 1000;
+	Palette palette;
+
+	std::vector<uint8_t> indices(256 * 240);
+	uint8_t emphasis[240];
+	srand(1);
+	for (auto& index : indices) {
+		index = rand() % 64;
+	}
+	for (auto& bits : emphasis) {
+		bits = rand() % 8;
+	}
+
+	std::vector<uint32_t> scalar(256 * 240);
+	palette.convertScalar(indices.data(), emphasis, scalar.data());
+	for (int i = 0; i < 256 * 240; i++) {
+		assert(scalar[i] == palette.color(indices[i], emphasis[i / 256]));
+	}
+
+	// Time each kernel on its own, outside of the PPU
+	auto bench = [&](const char* name, bool supported, void (Palette::*kernel)(const uint8_t*, const uint8_t*, uint32_t*) const) {
+		std::vector<uint32_t> pixels(256 * 240);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < frames; i++) {
+			(palette.*kernel)(indices.data(), emphasis, pixels.data());
+		}
+		std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+		assert(pixels == scalar);
+		std::cout << name << (supported ? "" : " (not supported, scalar)") << ": "
+			<< elapsed.count() * 1e9 / frames << " ns/frame\n";
+	};
+	bench("Scalar", true, &Palette::convertScalar);
+	bench("SSE4", palette.hasSSE4, &Palette::convertSSE4);
+	bench("AVX2", palette.hasAVX2, &Palette::convertAVX2);
+
+	std::cout << "---------------------------\nPalette conversion tests passed!\n";
+}
+
+void Tests::test_triple_buffer() {
+	const uint32_t frames = 20000;
+	TripleBuffer buffer;
+
+	// Every frame is filled with its own number, so a torn frame would show two different values
+	std::thread producer([&]() {
+		for (uint32_t frame = 1; frame <= frames; frame++) {
+			uint32_t* pixels = buffer.back();
+			for (int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++) {
+				pixels[i] = frame;
+			}
+			buffer.publish();
+		}
+	});
+
+	uint32_t last = 0;
+	int seen = 0;
+	while (last < frames) {
+		const uint32_t* pixels = buffer.acquire();
+		for (int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++) {
+			assert(pixels[i] == pixels[0]);
+		}
+		assert(pixels[0] >= last);
+		if (pixels[0] > last) {
+			seen++;
+		}
+		last = pixels[0];
+	}
+	producer.join();
+
+	std::cout << "Displayed " << seen << " of " << frames << " frames\n";
+	std::cout << "---------------------------\nTriple buffer tests passed!\n";
+}
+
+void Tests::test_emulator_thread(std::string path) {
+	NES nes;
+	EmulatorThread emulator(nes);
+	emulator.start();
+
+	// Wait until the emulation thread has run a number of frames
+	auto waitForFrames = [&](uint64_t frames) {
+		while (emulator.snapshot().timing.frames < frames) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	};
+
+	emulator.loadROM(path);
+	emulator.setController(0x08);
+	waitForFrames(30);
+	assert(emulator.snapshot().running);
+	assert(emulator.snapshot().controller == 0x08);
+
+	// Paused, the thread shouldn't run any frames until asked to step
+	emulator.pause();
+	while (emulator.snapshot().running) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	uint64_t frames = emulator.snapshot().timing.frames;
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	assert(emulator.snapshot().timing.frames == frames);
+
+	emulator.step();
+	waitForFrames(frames + 1);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	assert(emulator.snapshot().timing.frames == frames + 1);
+
+	emulator.resume();
+	waitForFrames(frames + 30);
+	emulator.stop();
+
+	EmulatorThread::Snapshot state = emulator.snapshot();
+	std::cout << state.timing.frames << " frames, " << state.timing.averageFrameMs << " ms/frame\n";
+	std::cout << "---------------------------\nEmulator thread tests passed!\n";
+}
+
+void Tests::test_run_frame(std::string path) {
+	const int frames = 60;
+
+	NES lockstep;
+	lockstep.catch_up = false;
+	lockstep.load_rom(path.c_str());
+	lockstep.initNES();
+
+	NES catchUp;
+	catchUp.load_rom(path.c_str());
+	catchUp.initNES();
+
+	// Every call ends right after the dot that starts vblank, whatever mode the bus runs in
+	for (int i = 0; i < frames; i++) {
+		uint64_t start = catchUp.bus.clockCounter;
+		lockstep.runFrame();
+		catchUp.runFrame();
+		assert(lockstep.bus.clockCounter == catchUp.bus.clockCounter);
+		assert(catchUp.bus.ppu.scanline == 241 && catchUp.bus.ppu.cycle == 2);
+		assert(i == 0 || catchUp.bus.clockCounter - start == DOTS_PER_FRAME);
+		assert(std::memcmp(lockstep.getFramebuffer(), catchUp.getFramebuffer(), FRAME_WIDTH * FRAME_HEIGHT * sizeof(uint32_t)) == 0);
+		assert(lockstep.cpu.PC == catchUp.cpu.PC);
+	}
+
+	// The pacer's schedule, fed made-up times so it doesn't matter how busy the host is
+	using Clock = FramePacer::Clock;
+	const Clock::duration frame = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / NES_FPS));
+	FramePacer pacer;
+	Clock::time_point t0 = Clock::now();
+	assert(pacer.schedule(t0) == t0 + frame);
+	// Frames due on the same beat however early or a little late they're asked for
+	assert(pacer.schedule(t0 + frame / 2) == t0 + 2 * frame);
+	assert(pacer.schedule(t0 + 3 * frame + frame / 2) == t0 + 3 * frame);
+	for (int i = 4; i <= 600; i++) {
+		assert(pacer.schedule(t0 + (i - 1) * frame + frame / 3) == t0 + i * frame);
+	}
+	// More than a frame behind it gives up on the missed ones and starts over
+	Clock::time_point t1 = t0 + 700 * frame;
+	assert(pacer.schedule(t1) == t1);
+	assert(pacer.schedule(t1) == t1 + frame);
+	Clock::time_point t2 = t1 + frame / 4;
+	pacer.reset();
+	assert(pacer.schedule(t2) == t2 + frame);
+
+	// Paced at 60 fps the host should mostly be asleep, unthrottled it shouldn't wait at all.
+	// Only printed, a loaded host can't keep either.
+	auto paced = [&](FramePacer::MODES mode) {
+		catchUp.pacer.setMode(mode);
+		std::clock_t cpuStart = std::clock();
+		auto wallStart = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i++) {
+			catchUp.cycle();
+		}
+		std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wallStart;
+		double cpu = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+		std::cout << frames / wall.count() << " fps, " << 100.0 * cpu / wall.count() << "% CPU\n";
+	};
+	paced(FramePacer::SLEEP);
+	paced(FramePacer::UNTHROTTLED);
+
+	std::cout << "---------------------------\nRun frame tests passed!\n";
+}
+
+
+void Tests::test_mappers() {
+	// Every 8KB of PRG and 1KB of CHR starts with its bank number so the windows can be checked
+	std::vector<uint8_t> prg(16 * 8192, 0xEA);
+	std::vector<uint8_t> chr(32 * 1024, 0x00);
+	for (int i = 0; i < 16; i++) prg[i * 8192] = i;
+	for (int i = 0; i < 32; i++) chr[i * 1024] = i;
+
+	auto insert = [&](NES& nes, uint8_t mapper, size_t prgSize, size_t chrSize) {
+		nes.rom.prgRom = prg.data();
+		nes.rom.prgSize = prgSize;
+		nes.rom.chrRom = chr.data();
+		nes.rom.chrSize = chrSize;
+		nes.rom.mapper = mapper;
+		assert(nes.bus.connectROM(nes.rom));
+	};
+
+	// NROM-128 shows up twice
+	{
+		NES nes;
+		insert(nes, 0, 0x4000, 0x2000);
+		assert(nes.bus.read(0x8000) == 0 && nes.bus.read(0xA000) == 1);
+		assert(nes.bus.read(0xC000) == 0 && nes.bus.read(0xE000) == 1);
+
+		// PRG RAM below it, ROM can't be written and nothing is left under 0x6000
+		nes.bus.write(0x6000, 0x12);
+		nes.bus.write(0x7FFF, 0x34);
+		assert(nes.bus.read(0x6000) == 0x12 && nes.bus.prgRam[0x1FFF] == 0x34);
+		nes.bus.write(0xC001, 0x56);
+		assert(nes.bus.read(0xC001) == 0xEA && prg[0x0001] == 0xEA);
+		nes.bus.write(0x5000, 0x78);
+		assert(nes.bus.read(0x5000) == 0x00);
+	}
+
+	// UxROM switches 16KB at 0x8000, the last bank stays at 0xC000
+	{
+		NES nes;
+		insert(nes, 2, 8 * 0x4000, 0x2000);
+		nes.bus.write(0x8000, 3);
+		assert(nes.bus.read(0x8000) == 6 && nes.bus.read(0xA000) == 7);
+		assert(nes.bus.read(0xC000) == 14 && nes.bus.read(0xE000) == 15);
+	}
+
+	// CNROM switches all 8KB of CHR
+	{
+		NES nes;
+		insert(nes, 3, 0x8000, 4 * 0x2000);
+		nes.bus.write(0x8000, 2);
+		assert(nes.bus.ppu.readPPU(0x0000) == 16 && nes.bus.ppu.readPPU(0x1C00) == 23);
+	}
+
+	// MMC1 takes its registers one bit at a time
+	{
+		NES nes;
+		insert(nes, 1, 8 * 0x4000, 4 * 0x2000);
+		auto serial = [&](uint16_t address, uint8_t value) {
+			for (int i = 0; i < 5; i++) {
+				nes.bus.write(address, (value >> i) & 0x01);
+			}
+		};
+		serial(0x8000, 0x1E);   // Switch 0x8000, 4KB CHR banks, vertical mirroring
+		serial(0xE000, 5);
+		serial(0xA000, 9);
+		assert(nes.bus.read(0x8000) == 10 && nes.bus.read(0xC000) == 14);
+		assert(nes.bus.ppu.readPPU(0x0000) == 4 && nes.bus.ppu.readPPU(0x1000) == 0);
+		assert(nes.bus.mapper->mirroring == VERTICAL);
+		nes.bus.write(0x8000, 0x80);
+		assert(nes.bus.read(0xC000) == 14);
+	}
+
+	// MMC3 switches 8KB of PRG and 1KB of CHR, and counts scanlines through A12
+	{
+		NES nes;
+		insert(nes, 4, prg.size(), chr.size());
+		nes.bus.write(0x8000, 0x46);   // R6, with the second to last bank at 0x8000
+		nes.bus.write(0x8001, 5);
+		nes.bus.write(0x8000, 0xC2);   // R2, with the 1KB banks at 0x0000
+		nes.bus.write(0x8001, 9);
+		assert(nes.bus.read(0x8000) == 14 && nes.bus.read(0xC000) == 5 && nes.bus.read(0xE000) == 15);
+		assert(nes.bus.ppu.readPPU(0x0000) == 9);
+
+		// Background from 0x0000 and sprites from 0x1000 raise A12 once per rendering scanline
+		nes.bus.write(0xC000, 20);
+		nes.bus.write(0xC001, 0);
+		nes.bus.write(0xE001, 0);
+		nes.bus.ppu.control.reg = 0x08;
+		nes.bus.ppu.mask.reg = 0x18;
+		int irqs = 0;
+		for (int i = 0; i < DOTS_PER_FRAME * 2; i++) {
+			nes.bus.ppu.clock();
+			if (nes.bus.mapper->irq) {
+				irqs++;
+				nes.bus.write(0xE000, 0);
+				nes.bus.write(0xE001, 0);
+			}
+		}
+		// 241 rises a frame, one IRQ every 21
+		assert(irqs == 2 * 241 / 21);
+	}
+
+	std::cout << "---------------------------\nMapper tests passed!\n";
+}
+
+void Tests::test_opcode_table() {
+	// The table is checked at compile time too
+	static_assert(CPU_INSTRUCTIONS[0xBD].cycles == 4 && CPU_INSTRUCTIONS[0xBD].pageCross == 1);
+	static_assert(CPU_INSTRUCTIONS[0x9D].cycles == 5 && CPU_INSTRUCTIONS[0x9D].pageCross == 0);
+	static_assert(CPU_INSTRUCTIONS[0xFE].access == CPU::READ_MODIFY_WRITE && CPU_INSTRUCTIONS[0xFE].length == 3);
+	static_assert(CPU_INSTRUCTIONS[0x6C].mode == CPU::INDIRECT_JMP && CPU_INSTRUCTIONS[0x6C].cycles == 5);
+
+	NES nes;
+	CPU& cpu = *nes.bus.cpu;
+	auto run = [&](std::vector<uint8_t> program) {
+		for (size_t i = 0; i < program.size(); i++) {
+			nes.bus.write(0x0200 + i, program[i]);
+		}
+		cpu.PC = 0x0200;
+		return cpu.runInstruction();
+	};
+
+	// Reads pay for crossing a page, writes and read-modify-writes always take the longer time
+	cpu.X = 0x00;
+	assert(run({0xBD, 0xFF, 0x02}) == 4);   // LDA $02FF,X
+	cpu.X = 0x01;
+	assert(run({0xBD, 0xFF, 0x02}) == 5);
+	assert(run({0x9D, 0x00, 0x03}) == 5);   // STA $0300,X
+	assert(run({0xFE, 0x00, 0x03}) == 7);   // INC $0300,X
+	assert(run({0x20, 0x00, 0x03}) == 6);   // JSR $0300
+
+	// Branches add one when taken and another when they land in a different page
+	cpu.setFlag(CPU::Z, false);
+	assert(run({0xF0, 0x10}) == 2);         // BEQ not taken
+	cpu.setFlag(CPU::Z, true);
+	assert(run({0xF0, 0x10}) == 3);
+	assert(run({0xF0, 0x80}) == 4);
+
+	nes.bus.write(0x0200, 0xB1);
+	nes.bus.write(0x0201, 0x40);
+	assert(cpu.disassemble(0x0200) == "LDA ($40),Y");
+	nes.bus.write(0x0200, 0xD0);
+	nes.bus.write(0x0201, 0xFE);
+	assert(cpu.disassemble(0x0200) == "BNE $0200");
+	nes.bus.write(0x0200, 0x6C);
+	nes.bus.write(0x0201, 0x34);
+	nes.bus.write(0x0202, 0x12);
+	assert(cpu.disassemble(0x0200) == "JMP ($1234)");
+
+	std::cout << "---------------------------\nOpcode table tests passed!\n";
+}
+
+void Tests::test_step(std::string path) {
+	const int frames = 30;
+
+	// Cycles still owed are paid before the next instruction's
+	{
+		NES nes;
+		CPU& cpu = *nes.bus.cpu;
+		nes.bus.write(0x0200, 0xEA);   // NOP
+		cpu.PC = 0x0200;
+		cpu.cycles = 3;
+		assert(cpu.step() == 5 && cpu.cycles == 0 && cpu.PC == 0x0201);
+	}
+
+	NES stepped;
+	stepped.load_rom(path.c_str());
+	stepped.initNES();
+
+	NES whole;
+	whole.load_rom(path.c_str());
+	whole.initNES();
+
+	// Stepping an instruction at a time ends up exactly where one long run does
+	uint64_t cycles = 0;
+	uint64_t end = frames * DOTS_PER_FRAME;
+	while (stepped.bus.clockCounter < end) {
+		uint64_t start = stepped.bus.clockCounter;
+		int taken = stepped.bus.step();
+		assert(taken > 0 && stepped.bus.clockCounter == start + 3 * taken);
+		assert(stepped.bus.ppuClockCounter == stepped.bus.clockCounter);
+		cycles += taken;
+	}
+	whole.bus.run(stepped.bus.clockCounter);
+
+	assert(cycles * 3 == stepped.bus.clockCounter);
+	assert(stepped.bus.apuClockCounter == cycles);
+	assert(whole.bus.apuClockCounter == cycles);
+	assert(whole.cpu.cycles == stepped.cpu.cycles);
+	assert(whole.cpu.PC == stepped.cpu.PC && whole.cpu.A == stepped.cpu.A && whole.cpu.P == stepped.cpu.P);
+	assert(whole.cpu.instructions == stepped.cpu.instructions);
+	assert(std::memcmp(whole.bus.ppu.framebuffer, stepped.bus.ppu.framebuffer, sizeof(whole.bus.ppu.framebuffer)) == 0);
+
+	std::cout << "---------------------------\nStep tests passed!\n";
+}
+
+void Tests::test_idle_loops(std::string path) {
+	// Skipping idle loops has to end every frame in exactly the state running them does
+	auto same = [](NES& a, NES& b) {
+		assert(a.bus.clockCounter == b.bus.clockCounter && a.bus.cpuClockCounter == b.bus.cpuClockCounter);
+		assert(a.cpu.PC == b.cpu.PC && a.cpu.A == b.cpu.A && a.cpu.X == b.cpu.X && a.cpu.Y == b.cpu.Y);
+		assert(a.cpu.P == b.cpu.P && a.cpu.S == b.cpu.S && a.cpu.cycles == b.cpu.cycles);
+		assert(a.cpu.instructions == b.cpu.instructions);
+		assert(std::memcmp(a.bus.cpuRam.data(), b.bus.cpuRam.data(), a.bus.cpuRam.size()) == 0);
+		assert(std::memcmp(a.bus.ppu.framebuffer, b.bus.ppu.framebuffer, sizeof(a.bus.ppu.framebuffer)) == 0);
+	};
+
+	// Wait on RAM for the NMI, then on the vblank flag with LDA and BIT, then JMP * forever
+	{
+		const std::vector<uint8_t> program = {
+			0xA9, 0x80, 0x8D, 0x00, 0x20,   // LDA #$80, STA $2000
+			0xA5, 0x10, 0xF0, 0xFC,         // LDA $10, BEQ -4
+			0xA9, 0x00, 0x8D, 0x00, 0x20,   // LDA #$00, STA $2000
+			0xAD, 0x02, 0x20, 0x10, 0xFB,   // LDA $2002, BPL -5
+			0x2C, 0x02, 0x20, 0x10, 0xFB,   // BIT $2002, BPL -5
+			0xA9, 0x80, 0x8D, 0x00, 0x20,   // LDA #$80, STA $2000
+			0x4C, 0x1D, 0x02                // JMP $021D
+		};
+		NES normal;
+		NES skipping;
+		skipping.bus.skipIdleLoops = true;
+		for (NES* nes : {&normal, &skipping}) {
+			for (size_t i = 0; i < program.size(); i++) {
+				nes->bus.write(0x0200 + i, program[i]);
+			}
+			// NMI handler: INC $10, RTI
+			nes->bus.write(0x0300, 0xE6);
+			nes->bus.write(0x0301, 0x10);
+			nes->bus.write(0x0302, 0x40);
+			nes->bus.write(0xFFFA, 0x00);
+			nes->bus.write(0xFFFB, 0x03);
+			nes->initNES();
+			nes->cpu.PC = 0x0200;
+		}
+		for (int frame = 0; frame < 10; frame++) {
+			normal.runFrame();
+			skipping.runFrame();
+			same(normal, skipping);
+		}
+		assert(normal.cpu.PC == 0x021D || normal.cpu.PC == 0x0300 || normal.cpu.PC == 0x0302);
+		assert(normal.bus.idleIterationsSkipped == 0 && skipping.bus.idleIterationsSkipped > 0);
+	}
+
+	// nestest's menu, then its tests after pressing start
+	{
+		NES normal;
+		NES skipping;
+		skipping.bus.skipIdleLoops = true;
+		for (NES* nes : {&normal, &skipping}) {
+			nes->load_rom(path.c_str());
+			nes->initNES();
+		}
+		for (int frame = 0; frame < 120; frame++) {
+			uint8_t buttons = (frame >= 60 && frame < 70) ? 0x08 : 0x00;
+			normal.bus.controller1.reg = buttons;
+			skipping.bus.controller1.reg = buttons;
+			normal.runFrame();
+			skipping.runFrame();
+			same(normal, skipping);
+		}
+		std::cout << skipping.bus.idleIterationsSkipped << " idle loop iterations skipped\n";
+	}
+
+	std::cout << "---------------------------\nIdle loop tests passed!\n";
+}
+
+void Tests::test_decode_cache() {
+	// Instructions decoded once still have to follow bank switches, built with CPU_DISPATCH=cached
+	// or not. Every 8KB bank has LDA #bank or LDX #bank at 0x0010 and ends with LDA abs, whose
+	// high byte is the first byte of whatever bank comes after it.
+	std::vector<uint8_t> prg(8 * 8192, 0xEA);
+	std::vector<uint8_t> chr(8 * 1024, 0x00);
+	for (int i = 0; i < 8; i++) {
+		uint8_t* bank = &prg[i * 8192];
+		bank[0x0000] = 0x02 + i;
+		bank[0x0010] = (i % 2) ? 0xA2 : 0xA9;
+		bank[0x0011] = i;
+		bank[0x1FFE] = 0xAD;
+		bank[0x1FFF] = 0xFF;
+	}
+
+	NES nes;
+	nes.rom.prgRom = prg.data();
+	nes.rom.prgSize = prg.size();
+	nes.rom.chrRom = chr.data();
+	nes.rom.chrSize = chr.size();
+	nes.rom.mapper = 4;
+	assert(nes.bus.connectROM(nes.rom));
+	CPU& cpu = nes.cpu;
+	nes.bus.write(0x02FF, 0x11);
+	nes.bus.write(0x03FF, 0x22);
+
+	// MMC3 R6 is at 0x8000 and R7 at 0xA000
+	auto mapBank = [&](uint8_t reg, uint8_t bank) {
+		nes.bus.write(0x8000, reg);
+		nes.bus.write(0x8001, bank);
+	};
+	auto runAt = [&](uint16_t pc) {
+		cpu.PC = pc;
+		cpu.runInstruction();
+	};
+
+	// Same PC, different bank
+	mapBank(6, 0);
+	cpu.A = cpu.X = 0xFF;
+	runAt(0x8010);
+	runAt(0x8010);
+	assert(cpu.A == 0 && cpu.X == 0xFF);
+	mapBank(6, 3);
+	runAt(0x8010);
+	assert(cpu.A == 0 && cpu.X == 3 && cpu.PC == 0x8012);
+	mapBank(6, 2);
+	runAt(0x8010);
+	assert(cpu.A == 2);
+
+	// The operand of an instruction at the end of a window comes from the next window's bank
+	mapBank(7, 0);
+	runAt(0x9FFE);
+	runAt(0x9FFE);
+	assert(cpu.A == 0x11);
+	mapBank(7, 1);
+	runAt(0x9FFE);
+	assert(cpu.A == 0x22 && cpu.PC == 0xA001);
+
+	// One bank in two windows, the same bytes land in the same slot but run on from their own PC
+	mapBank(6, 3);
+	mapBank(7, 3);
+	runAt(0x8010);
+	runAt(0xA010);
+	assert(cpu.X == 3 && cpu.PC == 0xA012);
+	runAt(0x8010);
+	assert(cpu.PC == 0x8012);
+
+	// NROM-128 shows its 16KB at both 0x8000 and 0xC000
+	{
+		NES nrom;
+		nrom.rom.prgRom = prg.data();
+		nrom.rom.prgSize = 0x4000;
+		nrom.rom.chrRom = chr.data();
+		nrom.rom.chrSize = chr.size();
+		nrom.rom.mapper = 0;
+		assert(nrom.bus.connectROM(nrom.rom));
+		nrom.cpu.PC = 0x8010;
+		nrom.cpu.runInstruction();
+		nrom.cpu.PC = 0xC010;
+		nrom.cpu.runInstruction();
+		assert(nrom.cpu.A == 0 && nrom.cpu.PC == 0xC012);
+	}
+
+	std::cout << "---------------------------\nDecode cache tests passed!\n";
+}
+
+void Tests::test_recompiler(std::string path) {
+	// The recompiled machine is run a block at a time and the interpreter is caught up to the same
+	// instruction after every one, where the registers, cycles and memory all have to match
+	auto same = [](NES& a, NES& b) {
+		assert(a.bus.clockCounter == b.bus.clockCounter && a.bus.cpuClockCounter == b.bus.cpuClockCounter);
+		assert(a.cpu.PC == b.cpu.PC && a.cpu.A == b.cpu.A && a.cpu.X == b.cpu.X && a.cpu.Y == b.cpu.Y);
+		assert(a.cpu.P == b.cpu.P && a.cpu.S == b.cpu.S && a.cpu.cycles == b.cpu.cycles);
+		assert(a.cpu.instructions == b.cpu.instructions);
+		assert(std::memcmp(a.bus.cpuRam.data(), b.bus.cpuRam.data(), a.bus.cpuRam.size()) == 0);
+		assert(std::memcmp(a.bus.prgRam.data(), b.bus.prgRam.data(), a.bus.prgRam.size()) == 0);
+	};
+	auto stepBoth = [&](NES& recompiled, NES& interpreted) {
+		recompiled.bus.step();
+		while (interpreted.cpu.instructions < recompiled.cpu.instructions) {
+			interpreted.bus.step();
+		}
+		same(recompiled, interpreted);
+	};
+	if (!Recompiler::AVAILABLE) {
+		std::cout << "No recompiler for this machine, skipped\n";
+		return;
+	}
+
+	// nestest's automated mode, which ends on an RTS at $C66E with any failures in $02 and $03. It's
+	// run again until its code is hot, the later runs go through blocks.
+	{
+		NES interpreted;
+		NES recompiled;
+		recompiled.bus.recompile = true;
+		for (NES* nes : {&interpreted, &recompiled}) {
+			nes->load_rom(path.c_str());
+			nes->initNES();
+		}
+		for (int run = 0; run < Recompiler::HOT_THRESHOLD + 2; run++) {
+			for (NES* nes : {&interpreted, &recompiled}) {
+				nes->cpu.PC = 0xC000;
+				nes->cpu.S = 0xFD;
+				nes->cpu.P = 0x24;
+				nes->cpu.A = nes->cpu.X = nes->cpu.Y = 0;
+			}
+			while (recompiled.cpu.PC != 0xC66E) {
+				stepBoth(recompiled, interpreted);
+			}
+			assert(recompiled.bus.cpuRam[0x02] == 0x00 && recompiled.bus.cpuRam[0x03] == 0x00);
+		}
+		std::cout << recompiled.cpu.instructions << " nestest instructions, " << recompiled.bus.blocksRun
+		          << " blocks run, " << recompiled.bus.recompiler->blocksCompiled() << " compiled\n";
+		assert(recompiled.bus.blocksRun > 0);
+	}
+
+	// nestest's menu, then its tests after pressing start
+	{
+		NES interpreted;
+		NES recompiled;
+		recompiled.bus.recompile = true;
+		for (NES* nes : {&interpreted, &recompiled}) {
+			nes->load_rom(path.c_str());
+			nes->initNES();
+		}
+		for (int frame = 0; frame < 120; frame++) {
+			uint8_t buttons = (frame >= 60 && frame < 70) ? 0x08 : 0x00;
+			interpreted.bus.controller1.reg = buttons;
+			recompiled.bus.controller1.reg = buttons;
+			interpreted.runFrame();
+			recompiled.runFrame();
+			same(recompiled, interpreted);
+			assert(std::memcmp(interpreted.bus.ppu.framebuffer, recompiled.bus.ppu.framebuffer, sizeof(interpreted.bus.ppu.framebuffer)) == 0);
+		}
+		assert(recompiled.bus.blocksRun > 0);
+	}
+
+	// Mapper IRQs, NMIs and sprite 0 splits have to land between the same instructions
+	{
+		std::vector<uint8_t> prg;
+		std::vector<uint8_t> chr;
+		NES lockstep;
+		insertIrqROM(lockstep, prg, chr);
+		NES recompiled;
+		recompiled.bus.recompile = true;
+		insertIrqROM(recompiled, prg, chr);
+		compareCatchUp(lockstep, recompiled, 120);
+		assert(recompiled.bus.blocksRun > 0);
+	}
+
+	// An MMC3 program that switches each of six banks in at $8000 and calls the code there, every
+	// bank adding its own number to $10. A block left over from another bank would add the wrong one.
+	std::vector<uint8_t> prg(8 * 8192, 0xEA);
+	std::vector<uint8_t> chr(8 * 1024, 0x00);
+	for (int i = 0; i < 6; i++) {
+		const std::vector<uint8_t> add = {
+			0xA9, static_cast<uint8_t>(i),      // LDA #bank
+			0x18, 0x65, 0x10, 0x85, 0x10,       // CLC, ADC $10, STA $10
+			0xE6, 0x11, 0x60,                   // INC $11, RTS
+		};
+		std::copy(add.begin(), add.end(), &prg[i * 8192]);
+	}
+	const std::vector<uint8_t> reset = {
+		0x78, 0xA2, 0xFF, 0x9A,                 // SEI, LDX #$FF, TXS
+		0xA0, 0x00,                             // $E004: LDY #0
+		0xA9, 0x06, 0x8D, 0x00, 0x80,           // $E006: R6 = Y
+		0x98, 0x8D, 0x01, 0x80,
+		0x20, 0x00, 0x80,                       // JSR $8000
+		0xC8, 0xC0, 0x06, 0xD0, 0xEF,           // INY, CPY #6, BNE $E006
+		0x4C, 0x04, 0xE0,                       // JMP $E004
+	};
+	std::copy(reset.begin(), reset.end(), &prg[7 * 8192]);
+	const uint8_t vectors[] = {0x00, 0xE0, 0x00, 0xE0, 0x00, 0xE0};
+	std::copy(vectors, vectors + 6, &prg[8 * 8192 - 6]);
+	auto insert = [&](NES& nes) {
+		nes.rom.prgRom = prg.data();
+		nes.rom.prgSize = prg.size();
+		nes.rom.chrRom = chr.data();
+		nes.rom.chrSize = chr.size();
+		nes.rom.mapper = 4;
+		assert(nes.bus.connectROM(nes.rom));
+		nes.initNES();
+	};
+	{
+		NES interpreted;
+		NES recompiled;
+		recompiled.bus.recompile = true;
+		insert(interpreted);
+		insert(recompiled);
+		for (int i = 0; i < 2000; i++) {
+			stepBoth(recompiled, interpreted);
+		}
+		// One block for each bank at least
+		assert(recompiled.bus.recompiler->blocksCompiled() >= 6 && recompiled.bus.cpuRam[0x11] > 0);
+	}
+
+	// Code in RAM, changed from outside the CPU through a mirror and by itself in PRG RAM
+	{
+		const std::vector<uint8_t> loop = {
+			0xA9, 0x05, 0x18, 0x65, 0x20,       // $0300: LDA #$05, CLC, ADC $20
+			0x85, 0x20, 0xE6, 0x21,             // STA $20, INC $21
+			0x4C, 0x00, 0x03,                   // JMP $0300
+		};
+		const std::vector<uint8_t> counter = {
+			0xA9, 0x00, 0x85, 0x22,             // $6000: LDA #$00, STA $22
+			0xEE, 0x01, 0x60,                   // INC $6001
+			0x4C, 0x00, 0x60,                   // JMP $6000
+		};
+		NES interpreted;
+		NES recompiled;
+		recompiled.bus.recompile = true;
+		for (NES* nes : {&interpreted, &recompiled}) {
+			insert(*nes);
+			for (size_t i = 0; i < loop.size(); i++) {
+				nes->bus.write(0x0300 + i, loop[i]);
+			}
+			for (size_t i = 0; i < counter.size(); i++) {
+				nes->bus.write(0x6000 + i, counter[i]);
+			}
+			nes->cpu.PC = 0x0300;
+		}
+		for (int i = 0; i < 200; i++) {
+			stepBoth(recompiled, interpreted);
+		}
+		uint64_t blocks = recompiled.bus.blocksRun;
+		assert(blocks > 0);
+		interpreted.bus.write(0x0B01, 0x07);
+		recompiled.bus.write(0x0B01, 0x07);
+		uint8_t before = recompiled.bus.cpuRam[0x20];
+		for (int i = 0; i < 200; i++) {
+			stepBoth(recompiled, interpreted);
+		}
+		assert(recompiled.bus.blocksRun > blocks && recompiled.bus.cpuRam[0x20] != before);
+
+		for (NES* nes : {&interpreted, &recompiled}) {
+			nes->cpu.PC = 0x6000;
+		}
+		for (int i = 0; i < 500; i++) {
+			stepBoth(recompiled, interpreted);
+		}
+		assert(recompiled.bus.cpuRam[0x22] == static_cast<uint8_t>(recompiled.bus.read(0x6001) - 1));
+	}
+
+	std::cout << "---------------------------\nRecompiler tests passed!\n";
+}
+
+void Tests::test_oam_dma() {
+	// A write to $4014 copies the page into OAM and holds the CPU for 513 cycles, 514 if it
+	// starts on an even one. Pages in RAM are copied straight, the rest go through read().
+	for (uint8_t page : {0x02, 0x41, 0x45}) {
+		std::vector<int> stalls;
+		for (int delays = 0; delays < 2; delays++) {
+			NES nes;
+			CPU& cpu = *nes.bus.cpu;
+			for (int i = 0; i < 256; i++) {
+				nes.bus.write(page << 8 | i, i ^ 0x5A);
+			}
+			std::vector<uint8_t> program;
+			if (delays) {
+				program = {0xA5, 0x00};   // LDA $00, 3 cycles to move the write onto the other parity
+			}
+			program.insert(program.end(), {0xA9, page, 0x8D, 0x14, 0x40, 0xEA});   // LDA #page, STA $4014, NOP
+			for (size_t i = 0; i < program.size(); i++) {
+				nes.bus.write(0x0300 + i, program[i]);
+			}
+			cpu.PC = 0x0300;
+
+			for (int i = 0; i <= delays; i++) {
+				nes.bus.step();
+			}
+			stalls.push_back(nes.bus.step() - 4);
+			assert(cpu.PC == 0x0305 + 2 * delays);
+			for (int i = 0; i < 256; i++) {
+				assert(nes.bus.ppu.OAMDATA[i] == (i ^ 0x5A));
+			}
+		}
+		assert(stalls[0] + stalls[1] == 513 + 514);
+	}
+
+	// Lockstep and catch-up agree even when a run stops in the middle of the transfer
+	{
+		const std::vector<uint8_t> program = {
+			0xA9, 0x02, 0x8D, 0x14, 0x40,   // LDA #$02, STA $4014
+			0xE6, 0x10,                     // INC $10
+			0x4C, 0x00, 0x03                // JMP $0300
+		};
+		NES lockstep;
+		NES caughtUp;
+		for (NES* nes : {&lockstep, &caughtUp}) {
+			for (size_t i = 0; i < program.size(); i++) {
+				nes->bus.write(0x0300 + i, program[i]);
+			}
+			nes->bus.write(0x0200, 0x77);
+			nes->cpu.PC = 0x0300;
+		}
+		for (uint64_t until = 500; until < 20000; until += 700) {
+			while (lockstep.bus.clockCounter < until) {
+				lockstep.bus.clock();
+			}
+			caughtUp.bus.run(until);
+			assert(lockstep.cpu.PC == caughtUp.cpu.PC && lockstep.cpu.cycles == caughtUp.cpu.cycles);
+			assert(lockstep.bus.cpuRam[0x10] == caughtUp.bus.cpuRam[0x10]);
+			assert(std::memcmp(lockstep.bus.ppu.OAMDATA, caughtUp.bus.ppu.OAMDATA, 256) == 0);
+		}
+		assert(caughtUp.bus.cpuRam[0x10] > 0 && caughtUp.bus.ppu.OAMDATA[0] == 0x77);
+	}
+
+	std::cout << "---------------------------\nOAM DMA tests passed!\n";
+}
+
+void Tests::test_rom_loading(std::string path) {
+	// PRG and CHR point straight into the file, every load of it sees the same bytes
+	std::ifstream file(path, std::ios::binary);
+	std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	NESROM first;
+	NESROM second;
+	assert(first.load(path) && second.load(path));
+	assert(!first.chrRam && first.prgSize == bytes[4] * 0x4000u && first.chrSize == bytes[5] * 0x2000u);
+	assert(std::memcmp(first.prgRom, &bytes[16], first.prgSize) == 0);
+	assert(std::memcmp(first.chrRom, &bytes[16 + first.prgSize], first.chrSize) == 0);
+	assert(std::memcmp(first.prgRom, second.prgRom, first.prgSize) == 0 && first.prgRom != second.prgRom);
+
+	// No CHR ROM in the header gets 8KB of zeroed CHR RAM, which a game can write
+	std::string chrRamPath = "chr_ram_test.nes";
+	{
+		std::vector<uint8_t> image = bytes;
+		image[5] = 0;
+		image.resize(16 + first.prgSize);
+		std::ofstream out(chrRamPath, std::ios::binary);
+		out.write(reinterpret_cast<const char*>(image.data()), image.size());
+	}
+	NES nes;
+	nes.load_rom(chrRamPath.c_str());
+	assert(nes.rom_loaded && nes.rom.chrRam && nes.rom.chrSize == 0x2000);
+	for (size_t i = 0; i < nes.rom.chrSize; i++) {
+		assert(nes.rom.chrRom[i] == 0x00);
+	}
+	nes.bus.ppu.writePPU(0x0010, 0xAB);
+	assert(nes.rom.chrRom[0x0010] == 0xAB);
+
+	// A file too short for its header fails and leaves the ROM loaded before alone
+	{
+		std::ofstream out(chrRamPath, std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(bytes.data()), 16 + 100);
+	}
+	uint8_t* prg = first.prgRom;
+	assert(!first.load(chrRamPath) && first.prgRom == prg && first.prgRom[0] == bytes[16]);
+
+	// So does one without any PRG ROM
+	{
+		std::vector<uint8_t> image = bytes;
+		image[4] = 0;
+		std::ofstream out(chrRamPath, std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(image.data()), image.size());
+	}
+	assert(!first.load(chrRamPath) && first.prgRom == prg);
+
+	// So does a mapper there's no support for, and the bus keeps reading the old ROM
+	NES running;
+	running.load_rom(path.c_str());
+	assert(running.rom_loaded);
+	prg = running.rom.prgRom;
+	{
+		std::vector<uint8_t> image = bytes;
+		image[6] = (image[6] & 0x0F) | 0x80;
+		image[7] = (image[7] & 0x0F) | 0xC0;
+		std::ofstream out(chrRamPath, std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(image.data()), image.size());
+	}
+	running.load_rom(chrRamPath.c_str());
+	assert(!running.rom_loaded && running.rom.prgRom == prg && running.rom.mapper == 0);
+	assert(running.bus.read(0x8000) == bytes[16] && running.bus.read(0xFFFC) == prg[(0xFFFC - 0x8000) % running.rom.prgSize]);
+	std::remove(chrRamPath.c_str());
+
+	std::cout << "---------------------------\nROM loading tests passed!\n";
+}
+
+void Tests::test_save_state(std::string path) {
+	const int frames = 30;
+
+	// The frames after a load are the ones that followed the save, in either bus mode and in
+	// another NES with the same ROM
+	NES nes;
+	nes.load_rom(path.c_str());
+	nes.initNES();
+	for (int i = 0; i < frames; i++) {
+		nes.runFrame();
+	}
+	std::vector<uint8_t> state;
+	nes.saveState(state);
+	assert(state.size() < 16 * 1024);
+
+	std::vector<std::vector<uint8_t>> expected;
+	for (int i = 0; i < frames; i++) {
+		nes.runFrame();
+		expected.emplace_back(nes.bus.ppu.framebuffer, nes.bus.ppu.framebuffer + sizeof(nes.bus.ppu.framebuffer));
+	}
+	uint64_t endClock = nes.bus.clockCounter;
+	uint16_t endPC = nes.cpu.PC;
+
+	NES other;
+	other.load_rom(path.c_str());
+	other.initNES();
+	other.catch_up = false;
+	for (NES* restored : {&nes, &other}) {
+		assert(restored->loadState(state));
+		for (int i = 0; i < frames; i++) {
+			restored->runFrame();
+			assert(std::memcmp(restored->bus.ppu.framebuffer, expected[i].data(), expected[i].size()) == 0);
+		}
+		assert(restored->bus.clockCounter == endClock && restored->cpu.PC == endPC);
+	}
+
+	// Saving and loading are a copy of a few KB each
+	const int repeats = 1000;
+	std::vector<uint8_t> scratch;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeats; i++) {
+		nes.saveState(scratch);
+		nes.loadState(scratch);
+	}
+	std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << state.size() << " byte state, " << elapsed.count() / repeats << " us to save and load\n";
+
+	// States that don't belong to this machine are turned down before anything changes
+	uint16_t pc = nes.cpu.PC;
+	std::vector<uint8_t> truncated(state.begin(), state.end() - 1);
+	assert(!nes.loadState(truncated) && nes.cpu.PC == pc);
+	std::vector<uint8_t> newer = state;
+	newer[4]++;
+	assert(!nes.loadState(newer));
+	NES empty;
+	assert(!empty.loadState(state));
+
+	// Mapper registers and CHR RAM come back, with CHR RAM decoded again
+	{
+		std::vector<uint8_t> prg(8 * 8192);
+		std::vector<uint8_t> chr(8 * 1024);
+		for (int i = 0; i < 8; i++) {
+			prg[i * 8192] = i;
+		}
+		NES mmc3;
+		mmc3.rom.prgRom = prg.data();
+		mmc3.rom.prgSize = prg.size();
+		mmc3.rom.chrRom = chr.data();
+		mmc3.rom.chrSize = chr.size();
+		mmc3.rom.chrRam = true;
+		mmc3.rom.mapper = 4;
+		assert(mmc3.bus.connectROM(mmc3.rom));
+		mmc3.bus.write(0x8000, 6);
+		mmc3.bus.write(0x8001, 3);
+		mmc3.bus.ppu.writePPU(0x0000, 0x80);
+		mmc3.saveState(state);
+
+		mmc3.bus.write(0x8001, 5);
+		mmc3.bus.ppu.writePPU(0x0000, 0x00);
+		assert(mmc3.bus.read(0x8000) == 5);
+		assert(mmc3.loadState(state));
+		assert(mmc3.bus.read(0x8000) == 3 && mmc3.bus.ppu.readPPU(0x0000) == 0x80);
+		assert(mmc3.bus.ppu.chrDecodedBanks[0][0] == 1);
+		mmc3.bus.write(0x8001, 1);
+		assert(mmc3.bus.read(0x8000) == 1);
+	}
+
+	std::cout << "---------------------------\nSave state tests passed!\n";
+}
+
+void Tests::test_rewind(std::string path) {
+	// Encoding against a base only keeps what changed, and applying it gives the state back
+	{
+		std::vector<uint8_t> base(5000);
+		for (size_t i = 0; i < base.size(); i++) {
+			base[i] = (i * 7) & 0xFF;
+		}
+		std::vector<uint8_t> state = base;
+		for (size_t i : {0, 1, 2, 100, 103, 4000, 4999}) {
+			state[i] ^= 0x5A;
+		}
+		std::vector<uint8_t> encoded;
+		Rewind::encode(state, base, encoded);
+		assert(encoded.size() < 32);
+		std::vector<uint8_t> decoded = base;
+		Rewind::apply(encoded, decoded);
+		assert(decoded == state);
+
+		Rewind::encode(state, {}, encoded);
+		decoded.assign(state.size(), 0x00);
+		Rewind::apply(encoded, decoded);
+		assert(decoded == state);
+	}
+
+	const int frames = 200;
+	const double seconds = 2.0;
+
+	NES plain;
+	plain.load_rom(path.c_str());
+	plain.initNES();
+	NES nes;
+	nes.load_rom(path.c_str());
+	nes.initNES();
+	nes.setRewindSeconds(seconds);
+
+	// Every frame keeps its state, the picture and where the CPU was
+	std::vector<std::vector<uint8_t>> pictures;
+	std::vector<uint64_t> clocks;
+	std::chrono::duration<double> plainTime{};
+	std::chrono::duration<double> rewindTime{};
+	for (int i = 0; i < frames; i++) {
+		auto start = std::chrono::steady_clock::now();
+		plain.runFrame();
+		auto middle = std::chrono::steady_clock::now();
+		nes.runFrame();
+		rewindTime += std::chrono::steady_clock::now() - middle;
+		plainTime += middle - start;
+		pictures.emplace_back(nes.bus.ppu.framebuffer, nes.bus.ppu.framebuffer + sizeof(nes.bus.ppu.framebuffer));
+		clocks.push_back(nes.bus.clockCounter);
+	}
+	size_t capacity = static_cast<size_t>(seconds * NES_FPS);
+	assert(nes.rewind.frames() <= capacity && nes.rewind.frames() > capacity - 60);
+
+	std::vector<uint8_t> state;
+	nes.saveState(state);
+	double ratio = static_cast<double>(nes.rewind.bytes()) / (nes.rewind.frames() * state.size());
+	std::cout << nes.rewind.frames() << " frames in " << nes.rewind.bytes() << " bytes, " << ratio * 100.0 << "% of whole states, "
+		<< (rewindTime.count() / plainTime.count() - 1.0) * 100.0 << "% longer frames\n";
+	assert(ratio < 0.25);
+
+	// Going back a frame at a time shows each frame again, until the oldest one
+	int back = 0;
+	while (nes.rewindFrame()) {
+		back++;
+		int frame = frames - 1 - back;
+		assert(nes.bus.clockCounter == clocks[frame]);
+		assert(std::memcmp(nes.bus.ppu.framebuffer, pictures[frame].data(), pictures[frame].size()) == 0);
+	}
+	assert(back > 0 && nes.rewind.frames() == 2);
+
+	// Running on from there stores frames again
+	nes.runFrame();
+	assert(nes.rewind.frames() == 3 && nes.rewindFrame());
+
+	std::cout << "---------------------------\nRewind tests passed!\n";
+}
+
+void Tests::test_run_ahead(std::string path) {
+	const int frames = 60;
+	const int ahead = 2;
+
+	NES plain;
+	plain.load_rom(path.c_str());
+	plain.initNES();
+	std::vector<std::vector<uint32_t>> pictures;
+	std::vector<uint64_t> clocks;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < frames + ahead; i++) {
+		plain.runFrame();
+		const uint32_t* picture = plain.getFramebuffer();
+		pictures.emplace_back(picture, picture + FRAME_WIDTH * FRAME_HEIGHT);
+		clocks.push_back(plain.bus.clockCounter);
+	}
+	std::chrono::duration<double, std::milli> plainTime = std::chrono::steady_clock::now() - start;
+
+	// The machine moves a frame at a time like it always does, the picture is from ahead frames later
+	NES nes;
+	nes.load_rom(path.c_str());
+	nes.initNES();
+	nes.runAhead = ahead;
+	double aheadMs = 0.0;
+	for (int i = 0; i < frames; i++) {
+		nes.runFrame();
+		aheadMs += nes.runAheadFrameMs;
+		assert(nes.bus.clockCounter == clocks[i]);
+		assert(std::memcmp(nes.getFramebuffer(), pictures[i + ahead].data(), pictures[i + ahead].size() * sizeof(uint32_t)) == 0);
+	}
+	std::cout << aheadMs / frames << " ms per frame run ahead, " << plainTime.count() / (frames + ahead) << " ms per plain frame\n";
+
+	// Turning it off shows the real frame again
+	nes.runAhead = 0;
+	nes.runFrame();
+	assert(nes.bus.clockCounter == clocks[frames] && nes.bus.ppu.outputFrames);
+	assert(std::memcmp(nes.getFramebuffer(), pictures[frames].data(), pictures[frames].size() * sizeof(uint32_t)) == 0);
+
+	std::cout << "---------------------------\nRun-ahead tests passed!\n";
+}
+
+void Tests::test_movie(std::string path) {
+	const int frames = 120;
+	const std::string moviePath = "test_movie.nesm";
+
+	// Record from power-on with the buttons changing every few frames
+	NES recorder;
+	recorder.load_rom(path.c_str());
+	recorder.initNES();
+	Movie movie;
+	assert(movie.start(recorder));
+	for (int i = 0; i < frames; i++) {
+		recorder.bus.controller1.reg = static_cast<uint8_t>((i / 5) * 37);
+		movie.recordFrame(recorder);
+	}
+	assert(movie.frames.size() == frames && movie.frames[10].buttons == 74);
+	std::vector<uint8_t> recorded;
+	recorder.saveState(recorded);
+
+	assert(movie.save(moviePath));
+	Movie loaded;
+	assert(loaded.load(moviePath));
+	std::remove(moviePath.c_str());
+	assert(loaded.romHash == movie.romHash && loaded.startState == movie.startState);
+	for (int i = 0; i < frames; i++) {
+		assert(loaded.frames[i].buttons == movie.frames[i].buttons && loaded.frames[i].hash == movie.frames[i].hash);
+	}
+
+	// Every frame plays back to the same state, in lockstep too, and fast without the pictures
+	for (bool catchUp : {true, false}) {
+		NES player;
+		player.load_rom(path.c_str());
+		player.catch_up = catchUp;
+		auto start = std::chrono::steady_clock::now();
+		Movie::ReplayResult result = loaded.replay(player);
+		std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+		assert(result.started && result.frames == frames && !result.diverged);
+		assert(!player.headless);
+		std::vector<uint8_t> played;
+		player.saveState(played);
+		assert(played == recorded);
+		std::cout << (catchUp ? "catch-up" : "lockstep") << " replay: " << took.count() / frames << " ms per frame\n";
+	}
+
+	// A changed frame is caught on that frame
+	Movie tampered = loaded;
+	tampered.frames[50].buttons ^= 0x01;
+	NES player;
+	player.load_rom(path.c_str());
+	Movie::ReplayResult result = tampered.replay(player);
+	assert(result.started && result.diverged && result.frames == 50);
+
+	// Another ROM doesn't start at all
+	tampered = loaded;
+	tampered.romHash ^= 1;
+	result = tampered.replay(player);
+	assert(!result.started && result.frames == 0);
+
+	// Nor does a file that's been cut short
+	assert(loaded.save(moviePath));
+	truncate(moviePath.c_str(), 100);
+	Movie cut;
+	assert(!cut.load(moviePath) && cut.frames.empty());
+	std::remove(moviePath.c_str());
+
+	std::cout << "---------------------------\nMovie tests passed!\n";
+}
+
+void Tests::test_batch_runner(std::string path) {
+	const std::string moviePath = "test_batch.nesm";
+	const std::string tamperedPath = "test_batch_tampered.nesm";
+
+	// A movie with some buttons in it, and a copy changed halfway through
+	NES recorder;
+	recorder.load_rom(path.c_str());
+	recorder.initNES();
+	Movie movie;
+	movie.start(recorder);
+	for (int i = 0; i < 40; i++) {
+		recorder.bus.controller1.reg = static_cast<uint8_t>((i / 4) * 29);
+		movie.recordFrame(recorder);
+	}
+	assert(movie.save(moviePath));
+	movie.frames[20].buttons ^= 0x80;
+	assert(movie.save(tamperedPath));
+
+	// What a plain run of 30 frames ends on
+	NES plain;
+	plain.load_rom(path.c_str());
+	plain.initNES();
+	for (int i = 0; i < 30; i++) {
+		plain.runFrame();
+	}
+	std::vector<uint8_t> state;
+	plain.saveState(state);
+	uint64_t plainHash = Movie::hashState(state);
+	recorder.saveState(state);
+	uint64_t movieHash = Movie::hashState(state);
+
+	std::vector<BatchRunner::Job> jobs = {
+		{path, moviePath, 0},
+		{path, "", 30},
+		{path, tamperedPath, 0},
+		{"missing.nes", "", 30},
+		{path, "", 30},
+		{path, moviePath, 0},
+		{path, "missing.nesm", 0},
+		{path, "", 30},
+	};
+
+	// Machines running side by side end up exactly where they do one at a time
+	BatchRunner::Options options;
+	options.threads = 1;
+	BatchRunner::Report alone = BatchRunner(options).run(jobs);
+	options.threads = 4;
+	BatchRunner::Report together = BatchRunner(options).run(jobs);
+	assert(alone.threads == 1 && together.threads == 4 && alone.steals == 0 && together.steals <= jobs.size());
+	for (const BatchRunner::Report* report : {&alone, &together}) {
+		const std::vector<BatchRunner::JobResult>& results = report->jobs;
+		assert(results[0].status == BatchRunner::DONE && results[0].frames == 40 && results[0].hash == movieHash);
+		assert(results[1].status == BatchRunner::DONE && results[1].frames == 30 && results[1].hash == plainHash);
+		assert(results[2].status == BatchRunner::DIVERGED && results[2].frames == 20);
+		assert(results[3].status == BatchRunner::FAILED && results[6].status == BatchRunner::FAILED);
+		assert(results[4].hash == plainHash && results[5].hash == movieHash && results[7].hash == plainHash);
+		for (const BatchRunner::JobResult& result : results) {
+			assert(result.thread >= 0 && result.thread < report->threads && result.finishedAt <= report->seconds);
+			assert(result.status == BatchRunner::FAILED || result.frameMs.size() >= static_cast<size_t>(result.frames));
+		}
+	}
+	std::cout << jobs.size() << " jobs: " << alone.seconds << " s on 1 thread, " << together.seconds << " s on 4\n";
+
+	// A job that runs too long is stopped between frames
+	options.timeoutSeconds = 0.2;
+	BatchRunner::JobResult slow = BatchRunner(options).runJob({path, "", 1000000});
+	assert(slow.status == BatchRunner::TIMED_OUT && slow.frames > 0 && slow.frames < 1000000 && slow.seconds < 1.0);
+
+	std::remove(moviePath.c_str());
+	std::remove(tamperedPath.c_str());
+	std::cout << "---------------------------\nBatch runner tests passed!\n";
+}
@@ -9,7 +9,11 @@
 #include <fstream>
 #include "NES.h"
 #include "Bus.h"
+#include "EmulatorThread.h"
+#include "Movie.h"
+#include "BatchRunner.h"
 #include <string>
+#include <vector>
 
 class Tests {
 public:
@@ -33,8 +37,29 @@ public:
     void test_CLD_SED_CLV();
     void test_NES(std::string path);
     void test_Bus();
+    void test_memory_map();
     void test_PPU_registers();
     void test_pattern_tables(std::string path);
+    void test_scheduler(std::string path);
+    void test_catch_up(std::string path);
+    void test_scanline_renderer(std::string path);
+    void test_palette_conversion();
+    void test_triple_buffer();
+    void test_emulator_thread(std::string path);
+    void test_run_frame(std::string path);
+    void test_mappers();
+    void test_opcode_table();
+    void test_step(std::string path);
+    void test_idle_loops(std::string path);
+    void test_decode_cache();
+    void test_recompiler(std::string path);
+    void test_oam_dma();
+    void test_rom_loading(std::string path);
+    void test_save_state(std::string path);
+    void test_rewind(std::string path);
+    void test_run_ahead(std::string path);
+    void test_movie(std::string path);
+    void test_batch_runner(std::string path);
 };
 
 